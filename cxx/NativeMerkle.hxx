@@ -0,0 +1,624 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+#pragma once
+
+#include "PyBytesStateAccessible.hxx"
+#include "merkle.hxx"
+#include "sha256_batch.hxx"
+#include "PythonSeekableFile.hxx"
+#include "PyAllowThreads.hxx"
+#include "fd_file.hxx"
+#include "base64.h"
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NativeMerkle
+{
+
+using Swizzle::PyHeartbeatException;
+using Swizzle::PyBytesStateAccessiblePyClass;
+
+// blobs are base64 encoded in dictionaries, as heartbeat.util.hb_encode does
+inline Py::Object encode_blob(const std::string &s)
+{
+	return Py::String(base64_encode((const unsigned char*)s.data(),s.size()));
+}
+
+inline std::string decode_blob(const Py::Object &obj)
+{
+	return base64_decode(Py::String(obj).as_std_string());
+}
+
+// calls op with a seekable_file reading obj.  paths and objects with a file
+// descriptor are read natively without the interpreter lock, other file
+// objects through python
+template <typename Op>
+void with_file(const Py::Object &obj, Op op)
+{
+	std::string path;
+	int fd = -1;
+	
+	if (Swizzle::get_native_path(obj,path))
+	{
+#ifdef _WIN32
+		fd = _open(path.c_str(),_O_RDONLY | _O_BINARY);
+#else
+		fd = open(path.c_str(),O_RDONLY);
+#endif
+		if (fd < 0)
+		{
+			throw std::runtime_error("Unable to open file: " + path);
+		}
+		std::unique_ptr<fd_file> f;
+		try
+		{
+			f.reset(new fd_file(fd));
+		}
+		catch (...)
+		{
+#ifdef _WIN32
+			_close(fd);
+#else
+			close(fd);
+#endif
+			throw;
+		}
+#ifdef _WIN32
+		_close(fd);
+#else
+		close(fd);
+#endif
+		PyAllowThreads nogil;
+		op(*f);
+		return;
+	}
+	
+	if (obj.hasAttr("fileno"))
+	{
+		try
+		{
+			fd = (long)Py::Long(obj.callMemberFunction("fileno"));
+		}
+		catch (Py::Exception &e)
+		{
+			// e.g. io.BytesIO
+			e.clear();
+			fd = -1;
+		}
+	}
+	
+	if (fd >= 0)
+	{
+		fd_file f(fd);
+		PyAllowThreads nogil;
+		op(f);
+	}
+	else
+	{
+		PythonSeekableFile f(obj);
+		op(f);
+	}
+}
+
+class Tag : public PyBytesStateAccessiblePyClass<Tag,merkle_data::tag>
+{
+public:
+	Tag( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
+		: PyBytesStateAccessiblePyClass<Tag,merkle_data::tag>(self,args,kwds)
+	{}
+	
+	static void init_type()
+	{
+		PyBytesStateAccessiblePyClass<Tag,merkle_data::tag>::init_type_dont_ready("heartbeat.NativeMerkle.Tag",
+"This object represents the file tag, the merkle tree without its leaves, which should be\n\
+stored on the server, and is used for construction of a proof of storage.");
+		
+		behaviors().readyType();
+	}
+	
+	Py::Object to_dict() const
+	{
+		Py::List nodes;
+		for (size_t i=0;i<tree().nodes().size();i++)
+		{
+			nodes.append(encode_blob(tree().nodes()[i]));
+		}
+		
+		Py::Dict t;
+		t["nodes"] = nodes;
+		t["order"] = Py::Long((long)tree().order());
+		t["leaves"] = Py::List();
+		
+		Py::Dict d;
+		d["tree"] = t;
+		d["chunksz"] = Py::Long((unsigned PY_LONG_LONG)chunksz());
+		d["filesz"] = Py::Long((unsigned PY_LONG_LONG)filesz());
+		return d;
+	}
+	
+	void from_dict(const Py::Object &obj)
+	{
+		Py::Dict d(obj);
+		Py::Dict t(d["tree"]);
+		Py::Sequence nodes(t["nodes"]);
+		
+		tree().nodes().resize(nodes.size());
+		for (size_t i=0;i<tree().nodes().size();i++)
+		{
+			tree().nodes()[i] = decode_blob(nodes[i]);
+		}
+		tree().set_order(Py::Long(t["order"]).as_unsigned_long());
+		tree().check_order();
+		set_chunksz(Py::Long(d["chunksz"]).as_unsigned_long_long());
+		set_filesz(Py::Long(d["filesz"]).as_unsigned_long_long());
+	}
+};
+
+class State : public PyBytesStateAccessiblePyClass<State,merkle_data::state>
+{
+public:
+	State( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
+		: PyBytesStateAccessiblePyClass<State,merkle_data::state>(self,args,kwds)
+	{}
+	
+	static void init_type()
+	{
+		PyBytesStateAccessiblePyClass<State,merkle_data::state>::init_type_dont_ready("heartbeat.NativeMerkle.State",
+"This object represents the signed state of a file, which is stored on the server.  It holds\n\
+the merkle root and the seed of the last challenge, and advances with each challenge.");
+		
+		behaviors().readyType();
+	}
+	
+	Py::Object to_dict() const
+	{
+		Py::Dict d;
+		d["index"] = Py::Long((long)index());
+		d["seed"] = encode_blob(seed());
+		d["n"] = Py::Long((long)n());
+		d["root"] = encode_blob(root());
+		d["hmac"] = encode_blob(hmac());
+		d["timestamp"] = Py::Float(timestamp());
+		return d;
+	}
+	
+	void from_dict(const Py::Object &obj)
+	{
+		Py::Dict d(obj);
+		set_index(Py::Long(d["index"]).as_unsigned_long());
+		set_seed(decode_blob(d["seed"]));
+		set_n(Py::Long(d["n"]).as_unsigned_long());
+		set_root(decode_blob(d["root"]));
+		set_hmac(decode_blob(d["hmac"]));
+		set_timestamp(Py::Float(d["timestamp"]));
+	}
+};
+
+class Challenge : public PyBytesStateAccessiblePyClass<Challenge,merkle_data::challenge>
+{
+public:
+	Challenge( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
+		: PyBytesStateAccessiblePyClass<Challenge,merkle_data::challenge>(self,args,kwds)
+	{}
+	
+	static void init_type()
+	{
+		PyBytesStateAccessiblePyClass<Challenge,merkle_data::challenge>::init_type_dont_ready("heartbeat.NativeMerkle.Challenge",
+"This object represents the challenge sent from client to server, the seed and index of one\n\
+leaf of the merkle tree.");
+		
+		behaviors().readyType();
+	}
+	
+	Py::Object to_dict() const
+	{
+		Py::Dict d;
+		d["seed"] = encode_blob(seed());
+		d["index"] = Py::Long((long)index());
+		return d;
+	}
+	
+	void from_dict(const Py::Object &obj)
+	{
+		Py::Dict d(obj);
+		static_cast<merkle_data::challenge&>(*this) = merkle_data::challenge(decode_blob(d["seed"]),Py::Long(d["index"]).as_unsigned_long());
+	}
+};
+
+class Proof : public PyBytesStateAccessiblePyClass<Proof,merkle_data::proof>
+{
+public:
+	Proof( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
+		: PyBytesStateAccessiblePyClass<Proof,merkle_data::proof>(self,args,kwds)
+	{}
+	
+	static void init_type()
+	{
+		PyBytesStateAccessiblePyClass<Proof,merkle_data::proof>::init_type_dont_ready("heartbeat.NativeMerkle.Proof",
+"This object represents proof of storage of the file, the seeded hash of the challenged chunk\n\
+and the merkle branch of its leaf, which is sent from the server to the client.");
+		
+		behaviors().readyType();
+	}
+	
+	Py::Object to_dict() const
+	{
+		Py::Dict l;
+		l["index"] = Py::Long((long)leaf().index());
+		l["blob"] = encode_blob(leaf().blob());
+		
+		Py::List rows;
+		for (size_t i=0;i<branch().rows().size();i++)
+		{
+			rows.append(Py::TupleN(encode_blob(branch().rows()[i].first),encode_blob(branch().rows()[i].second)));
+		}
+		Py::Dict b;
+		b["rows"] = rows;
+		
+		Py::Dict d;
+		d["leaf"] = l;
+		d["branch"] = b;
+		return d;
+	}
+	
+	void from_dict(const Py::Object &obj)
+	{
+		Py::Dict d(obj);
+		Py::Dict l(d["leaf"]);
+		leaf() = merkle_data::leaf(Py::Long(l["index"]).as_unsigned_long(),decode_blob(l["blob"]));
+		
+		Py::Dict b(d["branch"]);
+		Py::Sequence rows(b["rows"]);
+		branch().rows().resize(rows.size());
+		for (size_t i=0;i<branch().rows().size();i++)
+		{
+			Py::Sequence row(rows[i]);
+			branch().rows()[i] = merkle_data::branch::row(decode_blob(row[0]),decode_blob(row[1]));
+		}
+	}
+};
+
+class Merkle : public PyBytesStateAccessiblePyClass<Merkle,merkle>
+{
+public:
+	Merkle( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
+		: PyBytesStateAccessiblePyClass<Merkle,merkle>(self,args,kwds)
+	{
+		try
+		{
+			Py::Object check_fraction = argument(args,kwds,0,"check_fraction");
+			Py::Object key = argument(args,kwds,1,"key");
+			
+			if (key.isNone())
+			{
+				gen();
+			}
+			else
+			{
+				set_key(py_array(key).as_std_string());
+			}
+			if (!check_fraction.isNone())
+			{
+				set_check_fraction(Py::Float(check_fraction));
+			}
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	
+	static void init_type()
+	{
+		PyBytesStateAccessiblePyClass<Merkle,merkle>::init_type_dont_ready("heartbeat.NativeMerkle.Merkle",
+"This class is a native implementation of heartbeat.Merkle.Merkle, a heartbeat based on a\n\
+merkle tree of seeded hashes of chunks of the file.  Its objects, and their dictionaries,\n\
+are interchangeable with those of the python scheme.\n\
+Constructor:\n\
+heartbeat.NativeMerkle.Merkle(check_fraction = None, key = None)\n\
+The check fraction is the fraction of the file checked by each challenge.  Without one\n\
+each challenge checks 8192 bytes.  Without a key a new one is generated.\n");
+		
+		PYCXX_ADD_NOARGS_METHOD( get_public, _get_public, "get_public()\nReturns the public version of this object which is stripped\n\
+of its key." );
+		PYCXX_ADD_KEYWORDS_METHOD( encode, _encode, "(tag,state) = encode(file,n=256,seed=None,chunksz=None,filesz=None)\nReturns a tuple (tag,state) of a file for n challenges.  file may be a\n\
+path, which is then read without the interpreter lock." );
+		PYCXX_ADD_VARARGS_METHOD( gen_challenge, _gen_challenge, "challenge = gen_challenge(state)\nReturns the next challenge, and advances and signs state again\n\
+for passing back to the server." );
+		PYCXX_ADD_VARARGS_METHOD( prove, _prove, "proof = prove(file,challenge,tag)\nReturns a proof that should be sent back to the client for\n\
+verification." );
+		PYCXX_ADD_VARARGS_METHOD( verify, _verify, "is_valid = verify(proof,challenge,state)\nReturns a boolean representing whether the proof is valid\n\
+given the challenge and file state." );
+		
+		add_method( "tag_type", _tag_type, METH_NOARGS | METH_STATIC, "tag_type()\nReturns the type of tag.");
+		add_method( "state_type", _state_type, METH_NOARGS | METH_STATIC, "state_type()\nReturns the type of state.");
+		add_method( "proof_type", _proof_type, METH_NOARGS | METH_STATIC, "proof_type()\nReturns the type of proof.");
+		add_method( "challenge_type", _challenge_type, METH_NOARGS | METH_STATIC, "challenge_type()\nReturns the type of challenge.");
+		
+		behaviors().readyType();
+	}
+	
+	Py::Object to_dict() const
+	{
+		Py::Dict d;
+		d["key"] = encode_blob(key());
+		if (has_check_fraction())
+		{
+			d["check_fraction"] = Py::Float(check_fraction());
+		}
+		else
+		{
+			d["check_fraction"] = Py::None();
+		}
+		return d;
+	}
+	
+	void from_dict(const Py::Object &obj)
+	{
+		Py::Dict d(obj);
+		set_key(decode_blob(d["key"]));
+		Py::Object check_fraction = d["check_fraction"];
+		if (check_fraction.isNone())
+		{
+			clear_check_fraction();
+		}
+		else
+		{
+			set_check_fraction(Py::Float(check_fraction));
+		}
+	}
+	
+	Py::Object _get_public()
+	{
+		try
+		{
+			Py::Callable class_type( Merkle::type() );
+			Py::PythonClassObject<Merkle> pyobj( class_type.apply( Py::Tuple() ) );
+			get_public(*pyobj.getCxxObject());
+			return pyobj;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	PYCXX_NOARGS_METHOD_DECL( Merkle, _get_public )
+	
+	// (tag,state) = beat.encode(file,n=256,seed=None,chunksz=None,filesz=None)
+	Py::Object _encode(const Py::Tuple &args, const Py::Dict &kwds)
+	{
+		try
+		{
+			Py::Object n = argument(args,kwds,1,"n");
+			Py::Object seed = argument(args,kwds,2,"seed");
+			Py::Object chunksz = argument(args,kwds,3,"chunksz");
+			Py::Object filesz = argument(args,kwds,4,"filesz");
+			
+			Py::Callable tag_type( Tag::type() );
+			Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+			Tag *tag = pytag.getCxxObject();
+			
+			Py::Callable state_type( State::type() );
+			Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
+			State *state = pystate.getCxxObject();
+			
+			unsigned int count = n.isNone() ? merkle_data::default_challenge_count : Py::Long(n).as_unsigned_long();
+			std::string root_seed = seed.isNone() ? std::string() : py_array(seed).as_std_string();
+			size_t chunk_size = chunksz.isNone() ? unspecified : (size_t)Py::Long(chunksz).as_unsigned_long_long();
+			size_t file_size = filesz.isNone() ? unspecified : (size_t)Py::Long(filesz).as_unsigned_long_long();
+			
+			with_file(args[0],[&](seekable_file &f)
+			{
+				encode(*tag,*state,f,count,root_seed,chunk_size,file_size);
+			});
+			
+			return Py::TupleN(pytag,pystate);
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	PYCXX_KEYWORDS_METHOD_DECL( Merkle, _encode )
+	
+	// challenge = beat.gen_challenge(state)
+	Py::Object _gen_challenge(const Py::Tuple &args)
+	{
+		try
+		{
+			State *state = Py::PythonClassObject<State>( args[0] ).getCxxObject();
+			
+			Py::Callable challenge_type( Challenge::type() );
+			Py::PythonClassObject<Challenge> pychallenge( challenge_type.apply( Py::Tuple() ) );
+			Challenge *challenge = pychallenge.getCxxObject();
+			
+			gen_challenge(*challenge,static_cast<merkle_data::state&>(*state));
+			state->invalidate();
+			
+			return pychallenge;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Merkle, _gen_challenge )
+	
+	// proof = beat.prove(file,challenge,tag)
+	Py::Object _prove(const Py::Tuple &args)
+	{
+		try
+		{
+			Challenge *challenge = Py::PythonClassObject<Challenge>( args[1] ).getCxxObject();
+			Tag *tag = Py::PythonClassObject<Tag>( args[2] ).getCxxObject();
+			
+			Py::Callable proof_type( Proof::type() );
+			Py::PythonClassObject<Proof> pyproof( proof_type.apply( Py::Tuple() ) );
+			Proof *proof = pyproof.getCxxObject();
+			
+			with_file(args[0],[&](seekable_file &f)
+			{
+				prove(*proof,f,*challenge,*tag);
+			});
+			
+			return pyproof;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Merkle, _prove )
+	
+	// is_valid = beat.verify(proof,challenge,state)
+	Py::Object _verify(const Py::Tuple &args)
+	{
+		try
+		{
+			Proof *proof = Py::PythonClassObject<Proof>( args[0] ).getCxxObject();
+			Challenge *challenge = Py::PythonClassObject<Challenge>( args[1] ).getCxxObject();
+			State *state = Py::PythonClassObject<State>( args[2] ).getCxxObject();
+			
+			if (verify(*proof,*challenge,*state))
+			{
+				return Py::True();
+			}
+			return Py::False();
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Merkle, _verify )
+	
+	static PyObject * _tag_type( PyObject *, PyObject *)
+	{
+		return Py::new_reference_to( reinterpret_cast<PyObject*>(Tag::type_object()) );
+	}
+	
+	static PyObject * _state_type( PyObject *, PyObject *)
+	{
+		return Py::new_reference_to( reinterpret_cast<PyObject*>(State::type_object()) );
+	}
+	
+	static PyObject * _proof_type( PyObject *, PyObject *)
+	{
+		return Py::new_reference_to( reinterpret_cast<PyObject*>(Proof::type_object()) );
+	}
+	
+	static PyObject * _challenge_type( PyObject *, PyObject *)
+	{
+		return Py::new_reference_to( reinterpret_cast<PyObject*>(Challenge::type_object()) );
+	}
+	
+private:
+	// the argument at position i or with keyword name, or None
+	static Py::Object argument(const Py::Tuple &args, const Py::Dict &kwds, size_t i, const char *name)
+	{
+		if (args.size() > i)
+		{
+			return args[i];
+		}
+		if (kwds.hasKey(name))
+		{
+			return kwds[name];
+		}
+		return Py::None();
+	}
+};
+
+}
+
+class Module : public Py::ExtensionModule<Module>
+{
+public:
+	Module()
+		: Py::ExtensionModule<Module>("NativeMerkle")
+	{
+#if PY_VERSION_HEX < 0x03070000
+		// files read natively release the interpreter lock
+		PyEval_InitThreads();
+#endif
+		NativeMerkle::Merkle::init_type();
+		NativeMerkle::Tag::init_type();
+		NativeMerkle::State::init_type();
+		NativeMerkle::Challenge::init_type();
+		NativeMerkle::Proof::init_type();
+		
+		add_varargs_method("sha256_batch", &Module::_sha256_batch, "digests = sha256_batch(messages)\nReturns a list of the sha256 digests of a sequence of independent messages,\n\
+which are hashed side by side in the lanes of the vector unit of the processor.");
+		
+		initialize(
+"This module implements the merkle tree heartbeat of heartbeat.Merkle natively.  Its objects\n\
+convert to and from the same dictionaries as those of heartbeat.Merkle.\n");
+		
+		Py::Dict d( moduleDictionary() );
+		d["Merkle"] = Py::Object(NativeMerkle::Merkle::type());
+		d["Tag"] = Py::Object(NativeMerkle::Tag::type());
+		d["State"] = Py::Object(NativeMerkle::State::type());
+		d["Challenge"] = Py::Object(NativeMerkle::Challenge::type());
+		d["Proof"] = Py::Object(NativeMerkle::Proof::type());
+		
+		Py::Object heartbeatExceptionModule = Py::asObject(PyImport_ImportModule("heartbeat.exc"));
+		Py::Object heartbeatException = heartbeatExceptionModule.getAttr("HeartbeatError");
+		Swizzle::PyHeartbeatException::set_exception(heartbeatException);
+	}
+	
+	// digests = sha256_batch(messages)
+	Py::Object _sha256_batch(const Py::Tuple &args)
+	{
+		Py::Sequence seq(args[0]);
+		size_t n = seq.size();
+		
+		std::vector<std::string> messages(n);
+		std::vector<const unsigned char*> pointers(n);
+		std::vector<size_t> lengths(n);
+		for (size_t i=0;i<n;i++)
+		{
+			messages[i] = py_array(seq[i]).as_std_string();
+			pointers[i] = (const unsigned char*)messages[i].data();
+			lengths[i] = messages[i].size();
+		}
+		
+		std::vector<unsigned char> digests(n*sha256_digest_size);
+		{
+			PyAllowThreads nogil;
+			sha256_batch(pointers.data(),lengths.data(),n,digests.data());
+		}
+		
+		Py::List l;
+		for (size_t i=0;i<n;i++)
+		{
+			l.append(py_array((const char*)&digests[i*sha256_digest_size],sha256_digest_size));
+		}
+		return l;
+	}
+};
@@ -0,0 +1,67 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <Python.h>
+
+// releases the python global interpreter lock for the lifetime of the object,
+// so that long running native work does not block other python threads.
+// no python objects may be touched while it is held
+class PyAllowThreads
+{
+public:
+	PyAllowThreads() : _state(PyEval_SaveThread()) {}
+	
+	~PyAllowThreads()
+	{
+		PyEval_RestoreThread(_state);
+	}
+private:
+	PyAllowThreads(const PyAllowThreads &);
+	PyAllowThreads &operator=(const PyAllowThreads &);
+	
+	PyThreadState *_state;
+};
+
+
+// acquires the python global interpreter lock for the lifetime of the object,
+// from any thread, including threads not created by python
+class PyAcquireGIL
+{
+public:
+	PyAcquireGIL() : _state(PyGILState_Ensure()) {}
+	
+	~PyAcquireGIL()
+	{
+		PyGILState_Release(_state);
+	}
+private:
+	PyAcquireGIL(const PyAcquireGIL &);
+	PyAcquireGIL &operator=(const PyAcquireGIL &);
+	
+	PyGILState_STATE _state;
+};
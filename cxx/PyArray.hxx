@@ -5,6 +5,7 @@
 typedef Py::String py_array;
 #define py_from_string_and_size PyString_FromStringAndSize
 #define py_get_size PyString_GET_SIZE
+#define py_as_string PyString_AS_STRING
 #define py_resize _PyString_Resize
 #define py_as_string_and_size PyString_AsStringAndSize
 
@@ -13,6 +14,7 @@ typedef Py::String py_array;
 typedef Py::Bytes py_array;
 #define py_from_string_and_size PyBytes_FromStringAndSize
 #define py_get_size PyBytes_GET_SIZE
+#define py_as_string PyBytes_AS_STRING
 #define py_resize _PyBytes_Resize
 #define py_as_string_and_size PyBytes_AsStringAndSize
 
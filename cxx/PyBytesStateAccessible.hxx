@@ -0,0 +1,433 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+// python wrappers shared by the native schemes: the exception raised for
+// scheme errors and a python class base for objects that serialize
+
+#pragma once
+
+// must include cmath before python to avoid clash of hypot later.
+#include <cmath>
+#include <Python.h>
+#include <CXX/Objects.hxx>
+#include <CXX/Extensions.hxx>
+#include <string>
+#include "serializable.hxx"
+#include "PyBytesSink.hxx"
+#include "PyArray.hxx"
+#include "base64.h"
+
+#include <cryptopp/sha.h>
+
+namespace Swizzle
+{
+
+class PyHeartbeatException : public Py::Exception
+{
+public:
+	PyHeartbeatException(const std::string &reason)
+		: Py::Exception()
+	{
+		PyErr_SetString( _exception.ptr(), reason.c_str() );
+	}
+	
+	static Py::Object get_exception() { return _exception; }
+	static void set_exception(Py::Object exc) { 
+		_exception = exc; 
+	}
+private:
+	static Py::Object _exception;
+};
+
+// if obj is a path (str or bytes) stores it in path and returns true.  files
+// given by path can be read without holding the interpreter lock
+inline bool get_native_path(const Py::Object &obj, std::string &path)
+{
+#if PY_MAJOR_VERSION == 2
+	if (PyString_Check(obj.ptr()))
+	{
+		path = Py::String(obj).as_std_string();
+		return true;
+	}
+	if (PyUnicode_Check(obj.ptr()))
+	{
+		path = Py::String(obj).as_std_string(Py_FileSystemDefaultEncoding);
+		return true;
+	}
+#else
+	if (PyBytes_Check(obj.ptr()))
+	{
+		path = Py::Bytes(obj).as_std_string();
+		return true;
+	}
+	if (PyUnicode_Check(obj.ptr()))
+	{
+		Py::Bytes encoded(PyUnicode_EncodeFSDefault(obj.ptr()),true);
+		path = encoded.as_std_string();
+		return true;
+	}
+#endif
+	return false;
+}
+
+// This encapsulates a wrapper class for a serializable class
+template<typename T>
+class PyBytesStateAccessible : public T
+{
+public:
+	enum encoding_type { inherit = -1, binary = 0, base64 = 1 };
+	
+	PyBytesStateAccessible() : _encoding(binary), _digest_valid(false) {}
+
+	py_array get_state(encoding_type encoding = inherit) const
+	{
+		//std::cout << "Entering get_state()" << std::endl;
+		if (encoding == inherit)
+		{
+			encoding = _encoding;
+		}
+		// serialize the underlying and output
+		if (encoding == binary)
+		{
+			PyBytesSink sink;
+			this->serialize(sink);
+			
+			//std::cout << "Leaving get_state()" << std::endl;
+			return sink.finish();
+		}
+		else
+		{
+			std::string bin;
+			CryptoPP::StringSink sink(bin);
+			this->serialize(sink);
+			
+			// encode straight into a python buffer of the exact encoded size
+			PyObject *b64 = py_from_string_and_size(0,base64_encoded_size(bin.size()));
+			if (!b64)
+			{
+				throw std::runtime_error("Unable to create python array object");
+			}
+			base64_encode((const unsigned char*)bin.data(),bin.size(),py_as_string(b64));
+			
+			//std::cout << "Leaving get_state()" << std::endl;
+			return py_array(b64,true);
+		}
+	}
+	
+	void set_state(py_array state, encoding_type encoding = inherit)
+	{
+		//std::cout << "Entering set_state()" << std::endl;
+		if (encoding == inherit)
+		{
+			encoding = _encoding;
+		}
+		CryptoPP::StringSource *ss;
+		if (encoding == binary)
+		{
+			ss = new CryptoPP::StringSource(state,true);
+		}
+		else
+		{
+			// decode straight from the python buffer
+			char *b64;
+			Py_ssize_t b64_sz;
+			if (py_as_string_and_size(state.ptr(),&b64,&b64_sz))
+			{
+				throw std::runtime_error("Unable to read base64 encoded state.");
+			}
+			std::string bin(base64_decoded_size(b64,b64_sz),'\0');
+			if (!bin.empty())
+			{
+				bin.resize(base64_decode(b64,b64_sz,(unsigned char*)&bin[0]));
+			}
+			ss = new CryptoPP::StringSource(bin,true);
+		}
+		// deserializep takes ownership of the stringsource and deletes it after use, so we do not have to cleanup StringSource
+		this->deserializep(ss);
+		invalidate();
+		
+		//std::cout << "Leaving get_state()" << std::endl;
+	}
+	
+	encoding_type get_encoding() const { return _encoding; }
+	void set_encoding(encoding_type encoding) { _encoding = encoding; }
+	
+	// returns a SHA-256 digest of the canonical serialization of the object,
+	// which is the same for objects that compare equal.  the digest is cached
+	// until invalidate() is called, which must be done whenever the underlying
+	// object is modified
+	const byte *digest() const
+	{
+		if (!_digest_valid)
+		{
+			CryptoPP::SHA256 sha;
+			CryptoPP::HashFilter hf(sha,new CryptoPP::ArraySink(_digest,sizeof(_digest)));
+			this->serialize_canonical(hf);
+			hf.MessageEnd();
+			_digest_valid = true;
+		}
+		return _digest;
+	}
+	
+	void invalidate() { _digest_valid = false; }
+	
+	// compares the underlying objects.  equal objects have equal digests, so
+	// different cached digests show objects differ without comparing them
+	bool equals(const PyBytesStateAccessible<T> &other) const
+	{
+		if (this == &other)
+		{
+			return true;
+		}
+		if (_digest_valid && other._digest_valid && memcmp(_digest,other._digest,sizeof(_digest)) != 0)
+		{
+			return false;
+		}
+		return static_cast<const T&>(*this) == static_cast<const T&>(other);
+	}
+	
+private:
+	encoding_type _encoding;
+	
+	mutable byte _digest[CryptoPP::SHA256::DIGESTSIZE];
+	mutable bool _digest_valid;
+};
+
+template<typename Tthis, typename Tbase>
+class PyBytesStateAccessiblePyClass : public Py::PythonClass<Tthis>, public PyBytesStateAccessible<Tbase>
+{
+public:
+	typedef PyBytesStateAccessiblePyClass<Tthis,Tbase> this_type;
+
+	PyBytesStateAccessiblePyClass( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
+		: Py::PythonClass< Tthis >::PythonClass( self, args, kwds ) 
+	{
+		//std::cout << "PyBytesStateAccessiblePyClass<Tthis,Tbase> constructor called." << std::endl;
+	}
+
+	static void init_type_dont_ready(const char *T_type_name,const char *doc = "")
+	{
+		Tthis::behaviors().name(T_type_name);
+		Tthis::behaviors().doc(doc);
+		Tthis::behaviors().supportRichCompare();
+		Tthis::behaviors().supportHash();
+		
+		Tthis::PYCXX_ADD_NOARGS_METHOD( __getstate__, _get_state, "__getstate__()\nReturns the state of this object for serialization." );
+		Tthis::PYCXX_ADD_VARARGS_METHOD(  __setstate__, _set_state, "__setstate__( state )\nTakes the state as returned by __getstate__ as an argument.  Sets the object's internal state to that specified.");
+		Tthis::PYCXX_ADD_NOARGS_METHOD(  __reduce__, _reduce, "__reduce__()\nReduces the object and returns a tuple of the callable constructor, any arguments to that constructor, and the object state.");
+		Tthis::PYCXX_ADD_NOARGS_METHOD( todict, _todict, "todict()\nReturns a dictionary fully representing this object.");
+		
+		Tthis::add_method("fromdict", _fromdict, METH_VARARGS | METH_STATIC, "fromdict(dict)\nReturns a new object of this type from the given dictionary.");
+	}
+	
+	static void init_type(const char *T_type_name,const char *doc = "")
+	{
+		init_type_dont_ready(T_type_name,doc);
+		
+		Tthis::behaviors.readyType();
+	}
+	
+	Py::Object getattro( const Py::String &name_ )
+    {
+        return this->genericGetAttro( name_ );
+    }
+	
+	int setattro( const Py::String &name_, const Py::Object &value )
+    {
+        return this->genericSetAttro( name_, value );
+    }
+	
+	Py::Object _get_state()
+	{
+		try 
+		{
+			return this->get_state();
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+		return Py::None();
+	}
+	PYCXX_NOARGS_METHOD_DECL( Tthis, _get_state )
+	
+	Py::Object _set_state(const Py::Tuple &args )
+	{
+		if (args.length() != 1)
+		{
+			throw PyHeartbeatException("__setstate__ only takes one argument: state");
+		}
+		try 
+		{
+			this->set_state(args[0]);
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+		return Py::None();
+	}
+	PYCXX_VARARGS_METHOD_DECL( Tthis, _set_state )
+	
+	Py::Object _reduce()
+	{
+		return Py::TupleN( Tthis::type(), Py::TupleN(), _get_state() );
+	}
+	PYCXX_NOARGS_METHOD_DECL( Tthis, _reduce )
+	
+	Py::Object _todict()
+	{
+		try 
+		{
+			//std::cout << "Entering _todict()" << std::endl;
+			return static_cast<Tthis*>(this)->to_dict();
+		} 
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	PYCXX_NOARGS_METHOD_DECL( Tthis, _todict )
+	
+	// the object returned by todict(), by default the base64 encoded
+	// serialization.  a class may hide this with its own representation,
+	// along with from_dict()
+	Py::Object to_dict() const
+	{
+		Py::String s;
+		s = this->get_state(PyBytesStateAccessible<Tbase>::base64).decode("utf-8");
+		return s;
+	}
+	
+	// sets this object from the object returned by to_dict()
+	void from_dict(const Py::Object &d)
+	{
+		Py::String s(d);
+		this->set_state(s.encode("utf-8"),PyBytesStateAccessible<Tbase>::base64);
+	}
+	
+	Py::Object rich_compare( const Py::Object &other, int op )
+	{
+		try {
+			// std::cout << "rich compare called." << std::endl;
+			bool c = false;
+			const Tthis *obj;
+			
+			try
+			{
+				obj = Py::PythonClassObject<Tthis>( other ).getCxxObject();
+			} catch (Py::TypeError &e)
+			{
+				e.clear();
+				obj = 0;
+			}
+			
+			if (obj)
+			{
+				switch (op)
+				{
+					case Py_LT: throw Py::NotImplementedError("Less than operator is not implemented.");
+					case Py_LE: throw Py::NotImplementedError("Less than or equal to operator is not implemented.");
+					case Py_EQ: c = this->equals(*obj); break;
+					case Py_NE: c = !this->equals(*obj); break;
+					case Py_GT: throw Py::NotImplementedError("Greater than operator is not implemented.");
+					case Py_GE: throw Py::NotImplementedError("Greater than or equal to operator is not implemented.");
+				}
+			}
+			else
+			{
+				// types are not the same
+				switch (op)
+				{
+					case Py_LT: c = false; break;
+					case Py_LE: c = false; break;
+					case Py_EQ: c = false; break;
+					case Py_NE: c = true; break;
+					case Py_GT: c = false; break;
+					case Py_GE: c = false; break;
+				}
+			}
+			
+			// std::cout << "comparison yielded: " << c << std::endl;
+			if (c)
+			{
+				return Py::True();
+			}
+			else
+			{
+				return Py::False();
+			}
+		}
+		catch (std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	
+	long hash()
+	{
+		try
+		{
+			long h;
+			memcpy(&h,this->digest(),sizeof(h));
+			// -1 is reserved for errors
+			return h == -1 ? -2 : h;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	
+	static PyObject * _fromdict( PyObject *, PyObject *_a)
+	{
+		try
+		{
+			//std::cout << "Entering _fromdict()" << std::endl;
+			Py::Callable class_type( Tthis::type() );
+			Py::PythonClassObject<Tthis> pyobj( class_type.apply( Py::Tuple() ) );
+			Tthis *obj = pyobj.getCxxObject();
+			
+			Py::Tuple a(_a);
+			obj->from_dict(a[0]);
+			obj->invalidate();
+			
+			//std::cout << "Leaving _fromdict()" << std::endl;
+			return Py::new_reference_to( pyobj.ptr() );
+		}
+		catch (const std::exception &e)
+		{
+			PyHeartbeatException(e.what());
+			return 0;
+		}
+		catch ( Py::Exception & )
+		{
+			return 0;
+		}
+	}
+};
+
+}
@@ -29,7 +29,9 @@ THE SOFTWARE.
 #include <Python.h>
 #include <CXX/Objects.hxx>
 #include "PyArray.hxx"
-#include "simple_file.hxx"
+#include "PyAllowThreads.hxx"
+#include "seekable_file.hxx"
+#include <stdexcept>
 
 class PythonSeekableFile : public seekable_file
 {
@@ -72,3 +74,74 @@ private:
 	Py::Callable _read;
 	Py::Callable _seek;
 };
+
+// forwards to a PythonSeekableFile, taking the interpreter lock for each call,
+// so that a python file can be read from native worker threads.  python
+// errors are rethrown as std::runtime_error
+class PythonLockedSeekableFile : public seekable_file
+{
+public:
+	PythonLockedSeekableFile(PythonSeekableFile &file) : _file(file)
+	{}
+	
+	virtual size_t read(unsigned char *buffer,size_t sz)
+	{
+		PyAcquireGIL gil;
+		try
+		{
+			return _file.read(buffer,sz);
+		}
+		catch (Py::Exception &e)
+		{
+			throw std::runtime_error(error_string(e));
+		}
+	}
+	
+	virtual size_t seek(size_t i)
+	{
+		PyAcquireGIL gil;
+		try
+		{
+			return _file.seek(i);
+		}
+		catch (Py::Exception &e)
+		{
+			throw std::runtime_error(error_string(e));
+		}
+	}
+	
+	virtual size_t bytes_remaining()
+	{
+		PyAcquireGIL gil;
+		try
+		{
+			return _file.bytes_remaining();
+		}
+		catch (Py::Exception &e)
+		{
+			throw std::runtime_error(error_string(e));
+		}
+	}
+private:
+	// the error does not survive releasing the lock, so take its message now
+	static std::string error_string(Py::Exception &)
+	{
+		PyObject *type, *value, *traceback;
+		PyErr_Fetch(&type,&value,&traceback);
+		std::string msg = "Error reading from file.";
+		if (value)
+		{
+			PyObject *str = PyObject_Str(value);
+			if (str)
+			{
+				msg = Py::String(str,true).as_std_string();
+			}
+		}
+		Py_XDECREF(type);
+		Py_XDECREF(value);
+		Py_XDECREF(traceback);
+		return msg;
+	}
+	
+	PythonSeekableFile &_file;
+};
@@ -34,282 +34,27 @@ THE SOFTWARE.
 #include <iostream>
 #include "serializable.hxx"
 #include "shacham_waters_private.hxx"
+#include "PyBytesStateAccessible.hxx"
 #include "PyBytesSink.hxx"
 #include "PythonSeekableFile.hxx"
 #include "PyArray.hxx"
+#include "PyAllowThreads.hxx"
+#include "stream_file.hxx"
+#include "thread_pool.hxx"
+#include "fd_file.hxx"
+#include "cancellable_file.hxx"
 #include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
 #include "base64.h"
 
-namespace Swizzle
-{
-
-class PyHeartbeatException : public Py::Exception
-{
-public:
-	PyHeartbeatException(const std::string &reason)
-		: Py::Exception()
-	{
-		PyErr_SetString( _exception.ptr(), reason.c_str() );
-	}
-	
-	static Py::Object get_exception() { return _exception; }
-	static void set_exception(Py::Object exc) { 
-		_exception = exc; 
-	}
-private:
-	static Py::Object _exception;
-};
-
-// This encapsulates a wrapper class for a serializable class
-template<typename T>
-class PyBytesStateAccessible : public T
-{
-public:
-	enum encoding_type { inherit = -1, binary = 0, base64 = 1 };
-	
-	PyBytesStateAccessible() : _encoding(binary) {}
-
-	py_array get_state(encoding_type encoding = inherit) const
-	{
-		//std::cout << "Entering get_state()" << std::endl;
-		if (encoding == inherit)
-		{
-			encoding = _encoding;
-		}
-		// serialize the underlying and output
-		if (encoding == binary)
-		{
-			PyBytesSink sink;
-			this->serialize(sink);
-			
-			//std::cout << "Leaving get_state()" << std::endl;
-			return sink.finish();
-		}
-		else
-		{
-			std::string bin;
-			CryptoPP::StringSink sink(bin);
-			this->serialize(sink);
-			std::string b64 = base64_encode((const unsigned char*)bin.c_str(),bin.size());
-			
-			//std::cout << "Leaving get_state()" << std::endl;
-			return py_array(b64);
-		}
-	}
-	
-	void set_state(py_array state, encoding_type encoding = inherit)
-	{
-		//std::cout << "Entering set_state()" << std::endl;
-		if (encoding == inherit)
-		{
-			encoding = _encoding;
-		}
-		CryptoPP::StringSource *ss;
-		if (encoding == binary)
-		{
-			ss = new CryptoPP::StringSource(state,true);
-		}
-		else
-		{
-			std::string bin = base64_decode(state);
-			ss = new CryptoPP::StringSource(bin,true);
-		}
-		// deserializep takes ownership of the stringsource and deletes it after use, so we do not have to cleanup StringSource
-		this->deserializep(ss);
-		
-		//std::cout << "Leaving get_state()" << std::endl;
-	}
-	
-	encoding_type get_encoding() const { return _encoding; }
-	void set_encoding(encoding_type encoding) { _encoding = encoding; }
-	
-private:
-	encoding_type _encoding;
-};
+#include <cryptopp/sha.h>
 
-template<typename Tthis, typename Tbase>
-class PyBytesStateAccessiblePyClass : public Py::PythonClass<Tthis>, public PyBytesStateAccessible<Tbase>
+namespace Swizzle
 {
-public:
-	typedef PyBytesStateAccessiblePyClass<Tthis,Tbase> this_type;
-
-	PyBytesStateAccessiblePyClass( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
-		: Py::PythonClass< Tthis >::PythonClass( self, args, kwds ) 
-	{
-		//std::cout << "PyBytesStateAccessiblePyClass<Tthis,Tbase> constructor called." << std::endl;
-	}
-
-	static void init_type_dont_ready(const char *T_type_name,const char *doc = "")
-	{
-		Tthis::behaviors().name(T_type_name);
-		Tthis::behaviors().doc(doc);
-		Tthis::behaviors().supportRichCompare();
-		
-		Tthis::PYCXX_ADD_NOARGS_METHOD( __getstate__, _get_state, "__getstate__()\nReturns the state of this object for serialization." );
-		Tthis::PYCXX_ADD_VARARGS_METHOD(  __setstate__, _set_state, "__setstate__( state )\nTakes the state as returned by __getstate__ as an argument.  Sets the object's internal state to that specified.");
-		Tthis::PYCXX_ADD_NOARGS_METHOD(  __reduce__, _reduce, "__reduce__()\nReduces the object and returns a tuple of the callable constructor, any arguments to that constructor, and the object state.");
-		Tthis::PYCXX_ADD_NOARGS_METHOD( todict, _todict, "todict()\nReturns a dictionary fully representing this object.");
-		
-		Tthis::add_method("fromdict", _fromdict, METH_VARARGS | METH_STATIC, "fromdict(dict)\nReturns a new object of this type from the given dictionary.");
-	}
-	
-	static void init_type(const char *T_type_name,const char *doc = "")
-	{
-		init_type_dont_ready(T_type_name,doc);
-		
-		Tthis::behaviors.readyType();
-	}
-	
-	Py::Object getattro( const Py::String &name_ )
-    {
-        return this->genericGetAttro( name_ );
-    }
-	
-	int setattro( const Py::String &name_, const Py::Object &value )
-    {
-        return this->genericSetAttro( name_, value );
-    }
-	
-	Py::Object _get_state()
-	{
-		try 
-		{
-			return this->get_state();
-		}
-		catch (const std::exception &e)
-		{
-			throw PyHeartbeatException(e.what());
-		}
-		return Py::None();
-	}
-	PYCXX_NOARGS_METHOD_DECL( Tthis, _get_state )
-	
-	Py::Object _set_state(const Py::Tuple &args )
-	{
-		if (args.length() != 1)
-		{
-			throw PyHeartbeatException("__setstate__ only takes one argument: state");
-		}
-		try 
-		{
-			this->set_state(args[0]);
-		}
-		catch (const std::exception &e)
-		{
-			throw PyHeartbeatException(e.what());
-		}
-		return Py::None();
-	}
-	PYCXX_VARARGS_METHOD_DECL( Tthis, _set_state )
-	
-	Py::Object _reduce()
-	{
-		return Py::TupleN( Tthis::type(), Py::TupleN(), _get_state() );
-	}
-	PYCXX_NOARGS_METHOD_DECL( Tthis, _reduce )
-	
-	Py::Object _todict()
-	{
-		try 
-		{
-			//std::cout << "Entering _todict()" << std::endl;
-			Py::String s;
-			s = this->get_state(PyBytesStateAccessible<Tbase>::base64).decode("utf-8");
-			//std::cout << "Leaving _todict()" << std::endl;
-			return s;
-		} 
-		catch (const std::exception &e)
-		{
-			throw PyHeartbeatException(e.what());
-		}
-	}
-	PYCXX_NOARGS_METHOD_DECL( Tthis, _todict )
-	
-	Py::Object rich_compare( const Py::Object &other, int op )
-	{
-		try {
-			// std::cout << "rich compare called." << std::endl;
-			bool c = false;
-			const Tthis *obj;
-			
-			try
-			{
-				obj = Py::PythonClassObject<Tthis>( other ).getCxxObject();
-			} catch (Py::TypeError &e)
-			{
-				e.clear();
-				obj = 0;
-			}
-			
-			if (obj)
-			{
-				switch (op)
-				{
-					case Py_LT: throw Py::NotImplementedError("Less than operator is not implemented.");
-					case Py_LE: throw Py::NotImplementedError("Less than or equal to operator is not implemented.");
-					case Py_EQ: c = this->get_state() == obj->get_state(); break;
-					case Py_NE: c = this->get_state() != obj->get_state(); break;
-					case Py_GT: throw Py::NotImplementedError("Greater than operator is not implemented.");
-					case Py_GE: throw Py::NotImplementedError("Greater than or equal to operator is not implemented.");
-				}
-			}
-			else
-			{
-				// types are not the same
-				switch (op)
-				{
-					case Py_LT: c = false; break;
-					case Py_LE: c = false; break;
-					case Py_EQ: c = false; break;
-					case Py_NE: c = true; break;
-					case Py_GT: c = false; break;
-					case Py_GE: c = false; break;
-				}
-			}
-			
-			// std::cout << "comparison yielded: " << c << std::endl;
-			if (c)
-			{
-				return Py::True();
-			}
-			else
-			{
-				return Py::False();
-			}
-		}
-		catch (std::exception &e)
-		{
-			throw PyHeartbeatException(e.what());
-		}
-	}
-	
-	static PyObject * _fromdict( PyObject *, PyObject *_a)
-	{
-		try
-		{
-			//std::cout << "Entering _fromdict()" << std::endl;
-			Py::Callable class_type( Tthis::type() );
-			Py::PythonClassObject<Tthis> pyobj( class_type.apply( Py::Tuple() ) );
-			Tthis *obj = pyobj.getCxxObject();
-			
-			Py::Tuple a(_a);
-			Py::String s(a[0]);
-			obj->set_state(s.encode("utf-8"),PyBytesStateAccessible<Tbase>::base64);
-			
-			//std::cout << "Leaving _fromdict()" << std::endl;
-			return Py::new_reference_to( pyobj.ptr() );
-		}
-		catch (const std::exception &e)
-		{
-			PyHeartbeatException(e.what());
-			return 0;
-		}
-		catch ( Py::Exception & )
-		{
-			return 0;
-		}
-	}
-};
 
 class Tag : public PyBytesStateAccessiblePyClass<Tag,shacham_waters_private_data::tag>
 {
@@ -375,6 +120,7 @@ if it is generated by the Swizzle.encode() method.  It should be retrieved for g
 			}
 			
 			encrypt_and_sign(key_enc,key_mac,use_convergent);
+			invalidate();
 		}
 		catch (const std::exception &e)
 		{
@@ -401,6 +147,7 @@ if it is generated by the Swizzle.encode() method.  It should be retrieved for g
 			convert_and_check_key(args[1],&key_mac,&mac_sz);
 			
 			check_sig_and_decrypt(key_enc,key_mac);
+			invalidate();
 		}
 		catch (const std::exception &e)
 		{
@@ -450,6 +197,24 @@ public:
 	}
 };
 
+class Token : public PyBytesStateAccessiblePyClass<Token,shacham_waters_private_data::token>
+{
+public:
+	Token( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
+		: PyBytesStateAccessiblePyClass<Token,shacham_waters_private_data::token>(self,args,kwds) 
+	{
+	}
+	
+	static void init_type()
+	{
+		PyBytesStateAccessiblePyClass<Token,shacham_waters_private_data::token>::init_type_dont_ready("heartbeat.Swizzle.Token",
+"This object holds the part of the verification of a challenge which can be computed\n\
+when the challenge is issued.  It is kept by the client and not sent to the server.");
+		
+		behaviors().readyType();
+	}
+};
+
 class Proof : public PyBytesStateAccessiblePyClass<Proof,shacham_waters_private_data::proof>
 {
 public:
@@ -469,90 +234,478 @@ public:
 };
 
 
-class Swizzle : public PyBytesStateAccessiblePyClass<Swizzle,shacham_waters_private>
+// runs a single scheme operation on the shared thread pool and resolves a
+// concurrent.futures.Future with its result.  cancelling the future stops the
+// operation at the next chunk read.  jobs are created and deleted with the
+// interpreter lock held, and delete themselves once the future is resolved
+class AsyncJob
 {
 public:
-	Swizzle( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
-		: PyBytesStateAccessiblePyClass<Swizzle,shacham_waters_private>(self,args,kwds) 
+	AsyncJob() : _cancelled(new std::atomic<bool>(false))
 	{
-		//std::cout << "Swizzle constructor called..." << std::endl;
-		try 
+		PyObject *futures = PyImport_ImportModule("concurrent.futures");
+		if (!futures)
 		{
-			if (!kwds.hasKey("initialize") || kwds["initialize"].isTrue())
+			throw Py::Exception();
+		}
+		_future = Py::Callable(Py::Module(futures,true).getAttr("Future")).apply(Py::Tuple());
+		
+		// the future only tells us about cancellation through its callbacks, so
+		// hand it a function which raises our flag
+		static PyMethodDef on_done = { "_on_done", _on_done, METH_O, 0 };
+		Py::Object flag( PyCapsule_New(new std::shared_ptr<std::atomic<bool> >(_cancelled),"heartbeat.Swizzle.cancelled",_delete_flag), true );
+		Py::Object callback( PyCFunction_New(&on_done,flag.ptr()), true );
+		_future.callMemberFunction("add_done_callback",Py::TupleN(callback));
+	}
+	
+	virtual ~AsyncJob() {}
+	
+	Py::Object future() const
+	{
+		return _future;
+	}
+	
+	// queues the job on the shared pool and gives up ownership of it
+	void start()
+	{
+		AsyncJob *job = this;
+		
+		thread_pool::shared().submit([job]()
+		{
+			std::string error;
+			bool failed = false;
+			
+			try
 			{
-				// we initialize now
-				init(args);
+				if (*job->_cancelled)
+				{
+					throw std::runtime_error("Operation cancelled.");
+				}
+				job->run();
 			}
-			//std::cout << "heartbeat generated." << std::endl;
+			catch (const std::exception &e)
+			{
+				failed = true;
+				error = e.what();
+			}
+			catch (...)
+			{
+				failed = true;
+				error = "Unknown error.";
+			}
+			
+			PyAcquireGIL gil;
+			job->finish(failed,error);
+			delete job;
+		});
+	}
+	
+protected:
+	// does the work, on a worker thread without the interpreter lock
+	virtual void run() = 0;
+	
+	// the value of the future once run has returned, with the interpreter lock
+	virtual Py::Object result() = 0;
+	
+	// opens file for reading from a worker thread.  paths and objects with a 
+	// file descriptor are read natively, other file objects through python
+	seekable_file &open(const Py::Object &file)
+	{
+		std::string path;
+		int fd = -1;
+		size_t pos = 0;
+		
+		if (get_native_path(file,path))
+		{
+			_stream.reset(new std::ifstream(path.c_str(),std::ifstream::in | std::ifstream::binary));
+			if (!*_stream)
+			{
+				throw std::runtime_error("Unable to open file: " + path);
+			}
+			_source.reset(new stream_file(*_stream));
 		}
-		catch (const std::exception &e)
+		else if (file.hasAttr("fileno"))
 		{
-			throw PyHeartbeatException(e.what());
+			try
+			{
+				fd = (long)Py::Long(file.callMemberFunction("fileno"));
+				pos = (long)Py::Long(file.callMemberFunction("tell"));
+			}
+			catch (Py::Exception &e)
+			{
+				// e.g. io.BytesIO
+				e.clear();
+				fd = -1;
+			}
+		}
+		
+		if (fd >= 0)
+		{
+			_source.reset(new fd_file(fd,pos));
+		}
+		else if (!_source)
+		{
+			_python_file.reset(new PythonSeekableFile(file));
+			_source.reset(new PythonLockedSeekableFile(*_python_file));
 		}
+		
+		_file.reset(new cancellable_file(*_source,*_cancelled));
+		return *_file;
 	}
 	
-	void init(Py::Tuple &args)
+private:
+	void finish(bool failed, const std::string &error)
 	{
-		if (args.size() > 1)
+		try
 		{
-			shacham_waters_private::init(Py::Float(args[0]),(long)Py::Long(args[1]));
+			// a cancelled future is already resolved
+			if (_future.callMemberFunction("cancelled").isTrue())
+			{
+				return;
+			}
+			
+			if (failed)
+			{
+				Py::Callable exception_type( PyHeartbeatException::get_exception() );
+				_future.callMemberFunction("set_exception",Py::TupleN(exception_type.apply(Py::TupleN(Py::String(error)))));
+			}
+			else
+			{
+				_future.callMemberFunction("set_result",Py::TupleN(result()));
+			}
 		}
-		else if (args.size() > 0)
+		catch (Py::Exception &e)
 		{
-			shacham_waters_private::init(Py::Float(args[0]));			
+			// the future was cancelled while we were resolving it
+			e.clear();
 		}
-		else
+	}
+	
+	static PyObject *_on_done(PyObject *flag, PyObject *future)
+	{
+		PyObject *cancelled = PyObject_CallMethod(future,(char*)"cancelled",NULL);
+		if (!cancelled)
 		{
-			shacham_waters_private::init();
+			return NULL;
+		}
+		if (PyObject_IsTrue(cancelled))
+		{
+			(*static_cast<std::shared_ptr<std::atomic<bool> >*>(PyCapsule_GetPointer(flag,"heartbeat.Swizzle.cancelled")))->store(true);
 		}
+		Py_DECREF(cancelled);
+		Py_RETURN_NONE;
 	}
+	
+	static void _delete_flag(PyObject *flag)
+	{
+		delete static_cast<std::shared_ptr<std::atomic<bool> >*>(PyCapsule_GetPointer(flag,"heartbeat.Swizzle.cancelled"));
+	}
+	
+	Py::Object _future;
+	std::shared_ptr<std::atomic<bool> > _cancelled;
+	
+	std::unique_ptr<std::ifstream> _stream;
+	std::unique_ptr<PythonSeekableFile> _python_file;
+	std::unique_ptr<seekable_file> _source;
+	std::unique_ptr<cancellable_file> _file;
+};
 
-	static void init_type()
+class EncodeJob : public AsyncJob
+{
+public:
+	EncodeJob(Py::Object beat, shacham_waters_private &scheme, const Py::Object &file)
+		: _beat(beat), _scheme(scheme), _file(open(file))
 	{
-		PyBytesStateAccessiblePyClass<Swizzle,shacham_waters_private>::init_type_dont_ready("heartbeat.Swizzle.Swizzle",
-"This class contains methods for verification of storage of a file on a remote\n\
-server.  The internal state of this object is necessary for the client to\n\
-decrypt the state in order to verify the proof sent from the remote server.\n\
-Before sending this object to the server it is necessary to get the public\n\
-version which strips the encryption keys for the state.  If the remote server\n\
-has access to these keys, the remote server can pretend to hold the file.\n\
-This class provides the following methods for verification of proof of storage:\n\
-get_public() which returns the public version of this object which is stripped\n\
-of the secret verification data.\n\
-encode(file) which returns a tuple (tag,state) for sending to the remote server.\n\
-The state information will be encrypted and is ready for serialization.\n\
-gen_challenge(state) which returns a challenge for sending to the server.  The\n\
-state should be retreived from the server and this function will decrypt it and\n\
-verify its signature before generating a challenge.  Upon failure it will raise\n\
-a runtime error.\n\
-prove(file,challenge,tag) which returns a proof that should be sent back to\n\
-the client for verification.\n\
-verify(proof,challenge,state) which returns a boolean representing whether the\n\
-proof is valid given the challenge and file state.  This function will decypt\n\
-the state if necessary.\n\
-Constructor:\n\
-heartbeat.Swizzle.Swizzle(check_fraction = 1.0)\n\
-The check fraction is the fraction of the file that will be checked on each\n\
-challenge.\n");
+		Py::Callable tag_type( Tag::type() );
+		Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+		_pytag = pytag;
+		_tag = pytag.getCxxObject();
 		
-		PYCXX_ADD_NOARGS_METHOD( get_public, _get_public, "get_public()\nReturns the public version of this object which is stripped\n\
-of the secret verification data." );
-		PYCXX_ADD_VARARGS_METHOD( encode, _encode, "(tag,state) = encode(file)\nReturns a tuple (tag,state) for sending to the remote server.\n\
-The state information will be encrypted and is ready for serialization." );
-		PYCXX_ADD_VARARGS_METHOD( gen_challenge, _gen_challenge, "challenge = gen_challenge(state)\nReturns a challenge for sending to the server.  The\n\
+		Py::Callable state_type( State::type() );
+		Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
+		_pystate = pystate;
+		_state = pystate.getCxxObject();
+	}
+protected:
+	virtual void run()
+	{
+		_scheme.encode(*_tag,*_state,_file);
+	}
+	
+	virtual Py::Object result()
+	{
+		return Py::TupleN(_pytag,_pystate);
+	}
+private:
+	Py::Object _beat;
+	shacham_waters_private &_scheme;
+	seekable_file &_file;
+	Py::Object _pytag;
+	Tag *_tag;
+	Py::Object _pystate;
+	State *_state;
+};
+
+class ProveJob : public AsyncJob
+{
+public:
+	ProveJob(Py::Object beat, shacham_waters_private &scheme, const Py::Object &file, const Py::Object &challenge, const Py::Object &tag)
+		: _beat(beat), _scheme(scheme), _file(open(file)), _pychallenge(challenge), _pytag(tag)
+	{
+		_challenge = Py::PythonClassObject<Challenge>( challenge ).getCxxObject();
+		_tag = Py::PythonClassObject<Tag>( tag ).getCxxObject();
+		
+		Py::Callable proof_type( Proof::type() );
+		Py::PythonClassObject<Proof> pyproof( proof_type.apply( Py::Tuple() ) );
+		_pyproof = pyproof;
+		_proof = pyproof.getCxxObject();
+	}
+protected:
+	virtual void run()
+	{
+		_scheme.prove(*_proof,_file,*_challenge,*_tag);
+	}
+	
+	virtual Py::Object result()
+	{
+		return _pyproof;
+	}
+private:
+	Py::Object _beat;
+	shacham_waters_private &_scheme;
+	seekable_file &_file;
+	Py::Object _pychallenge;
+	Challenge *_challenge;
+	Py::Object _pytag;
+	Tag *_tag;
+	Py::Object _pyproof;
+	Proof *_proof;
+};
+
+class VerifyJob : public AsyncJob
+{
+public:
+	VerifyJob(Py::Object beat, shacham_waters_private &scheme, const Py::Object &proof, const Py::Object &challenge, const Py::Object &state)
+		: _beat(beat), _scheme(scheme), _pyproof(proof), _pychallenge(challenge), _pystate(state), _valid(false)
+	{
+		_proof = Py::PythonClassObject<Proof>( proof ).getCxxObject();
+		_challenge = Py::PythonClassObject<Challenge>( challenge ).getCxxObject();
+		_state = Py::PythonClassObject<State>( state ).getCxxObject();
+	}
+protected:
+	virtual void run()
+	{
+		_valid = _scheme.verify(*_proof,*_challenge,*_state);
+	}
+	
+	virtual Py::Object result()
+	{
+		return Py::Boolean(_valid);
+	}
+private:
+	Py::Object _beat;
+	shacham_waters_private &_scheme;
+	Py::Object _pyproof;
+	Proof *_proof;
+	Py::Object _pychallenge;
+	Challenge *_challenge;
+	Py::Object _pystate;
+	State *_state;
+	bool _valid;
+};
+
+class Swizzle : public PyBytesStateAccessiblePyClass<Swizzle,shacham_waters_private>
+{
+public:
+	Swizzle( Py::PythonClassInstance *self, Py::Tuple &args, Py::Dict &kwds )
+		: PyBytesStateAccessiblePyClass<Swizzle,shacham_waters_private>(self,args,kwds) 
+	{
+		//std::cout << "Swizzle constructor called..." << std::endl;
+		try 
+		{
+			if (!kwds.hasKey("initialize") || kwds["initialize"].isTrue())
+			{
+				// we initialize now
+				init(args,kwds);
+			}
+			//std::cout << "heartbeat generated." << std::endl;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+		}
+	}
+	
+	void init(Py::Tuple &args, Py::Dict &kwds)
+	{
+		if (kwds.hasKey("parameters"))
+		{
+			Py::Object name_or_id( kwds["parameters"] );
+			const parameter_set *params = name_or_id.isNumeric() 
+				? find_parameter_set((long)Py::Long(name_or_id)) 
+				: find_parameter_set(Py::String(name_or_id).as_std_string());
+			if (!params)
+			{
+				throw std::runtime_error("Unknown parameter set.");
+			}
+			double check_fraction = args.size() > 0 ? (double)Py::Float(args[0]) : 1.0;
+			unsigned int sectors = args.size() > 1 ? (long)Py::Long(args[1]) : 0;
+			shacham_waters_private::init(*params,check_fraction,sectors);
+		}
+		else if (args.size() > 1)
+		{
+			shacham_waters_private::init(Py::Float(args[0]),(long)Py::Long(args[1]));
+		}
+		else if (args.size() > 0)
+		{
+			shacham_waters_private::init(Py::Float(args[0]));			
+		}
+		else
+		{
+			shacham_waters_private::init();
+		}
+	}
+
+	static void init_type()
+	{
+		PyBytesStateAccessiblePyClass<Swizzle,shacham_waters_private>::init_type_dont_ready("heartbeat.Swizzle.Swizzle",
+"This class contains methods for verification of storage of a file on a remote\n\
+server.  The internal state of this object is necessary for the client to\n\
+decrypt the state in order to verify the proof sent from the remote server.\n\
+Before sending this object to the server it is necessary to get the public\n\
+version which strips the encryption keys for the state.  If the remote server\n\
+has access to these keys, the remote server can pretend to hold the file.\n\
+This class provides the following methods for verification of proof of storage:\n\
+get_public() which returns the public version of this object which is stripped\n\
+of the secret verification data.\n\
+encode(file) which returns a tuple (tag,state) for sending to the remote server.\n\
+The state information will be encrypted and is ready for serialization.\n\
+gen_challenge(state,distinct=False) which returns a challenge for sending to\n\
+the server.  The state should be retreived from the server and this function\n\
+will decrypt it and verify its signature before generating a challenge.  Upon\n\
+failure it will raise a runtime error.\n\
+prove(file,challenge,tag) which returns a proof that should be sent back to\n\
+the client for verification.\n\
+verify(proof,challenge,state) which returns a boolean representing whether the\n\
+proof is valid given the challenge and file state.  This function will decypt\n\
+the state if necessary.\n\
+Constructor:\n\
+heartbeat.Swizzle.Swizzle(check_fraction = 1.0, sectors = 10, parameters = None)\n\
+The check fraction is the fraction of the file that will be checked on each\n\
+challenge.  parameters selects a standard prime by name or id, one of\n\
+'modp1024' (1, the default), 'modp1536' (2), 'modp2048' (3), or the faster\n\
+special form primes 'p25519' (4) and 'p521' (5), which have smaller sectors.\n\
+sectors then defaults to the sector count of the parameter set.\n");
+		
+		PYCXX_ADD_NOARGS_METHOD( parameters, _parameters, "parameters()\nReturns the name of the standard parameter set of this object,\n\
+or None if its prime was generated." );
+		PYCXX_ADD_NOARGS_METHOD( get_public, _get_public, "get_public()\nReturns the public version of this object which is stripped\n\
+of the secret verification data." );
+		PYCXX_ADD_NOARGS_METHOD( alpha_epoch, _alpha_epoch, "alpha_epoch()\nReturns the epoch of the key from which the secret coefficients of\n\
+encoded files are derived.  Files encoded in one epoch share coefficients, so\n\
+their proofs can be aggregated." );
+		PYCXX_ADD_NOARGS_METHOD( rotate_alpha, _rotate_alpha, "rotate_alpha()\nMoves to the next alpha epoch, so that files encoded from now on\n\
+get secret coefficients unrelated to those of earlier files.  This object must\n\
+be saved again to keep the epoch." );
+		PYCXX_ADD_VARARGS_METHOD( encode, _encode, "(tag,state) = encode(file,cache=None)\nReturns a tuple (tag,state) for sending to the remote server.\n\
+The state information will be encrypted and is ready for serialization.  If a\n\
+cache, such as a heartbeat.cache.DirectoryTagCache, is given the file is first\n\
+hashed with the keys and parameters of this object, and the tag and state are\n\
+taken from cache.get(key) if it has them, otherwise they are encoded and given\n\
+to cache.put(key,tag,state).  The file must then be seekable." );
+		PYCXX_ADD_VARARGS_METHOD( encode_append, _encode_append, "(tag,state) = encode_append(file,tag,state)\nReturns the tag and state of a file which has been\n\
+appended to since tag and state were returned for it, with the same keys.  Only\n\
+the last chunk of the file as encoded and the appended data are read, so the\n\
+cost is proportional to the size of the append.  The file must be seekable." );
+		PYCXX_ADD_VARARGS_METHOD( gen_state, _gen_state, "state = gen_state(size)\nReturns a state, with new keys, for a file of size bytes\n\
+which is tagged in parts with encode_range().  The state is encrypted like the\n\
+state returned by encode()." );
+		PYCXX_ADD_VARARGS_METHOD( encode_range, _encode_range, "segment = encode_range(file,state,first,count)\nReturns the tag segment of count chunks\n\
+of the file from chunk first, for the file of a state from gen_state().  Only\n\
+those chunks are read, so the parts of a file can be tagged by different\n\
+processes or machines.  The segments of all of the chunks merged in order with\n\
+merge_tags() are the tag encode() would give with the keys of the state." );
+		PYCXX_ADD_VARARGS_METHOD( merge_tags, _merge_tags, "tag = merge_tags(segments)\nReturns the tag made of a list of tag segments in\n\
+chunk order." );
+		PYCXX_ADD_VARARGS_METHOD( encode_checkpointed, _encode_checkpointed, "(tag,state) = encode_checkpointed(file,checkpoint,interval)\nLike encode(), but calls\n\
+checkpoint(segment,state) after every interval chunks, with the tag segment of\n\
+the chunks tagged since the last checkpoint and the encrypted state of all of\n\
+the chunks tagged so far.  If the encode is interrupted it can be continued\n\
+from the last checkpoint with resume_encode()." );
+		PYCXX_ADD_VARARGS_METHOD( resume_encode, _resume_encode, "(tag,state) = resume_encode(file,tag,state,checkpoint=None,interval=0)\nContinues an\n\
+encode from its last checkpoint, where tag is the segments of the checkpoints\n\
+merged with merge_tags() and state is the state of the last checkpoint.  Only\n\
+the chunks after the checkpoint are read.  Further checkpoints are given to\n\
+checkpoint as by encode_checkpointed().  The file must be seekable." );
+		PYCXX_ADD_VARARGS_METHOD( update_chunks, _update_chunks, "(tag,state) = update_chunks(file,tag,state,ranges)\nReturns the tag and state of a file some\n\
+chunks of which were rewritten in place since tag and state were returned for\n\
+it, without changing its size.  ranges is a list of (first,last) tuples of the\n\
+first chunk and one past the last chunk rewritten, and only those chunks are\n\
+read.  The rewritten chunks are tagged under a new version of the state's PRF,\n\
+recorded in the returned state, which must replace the old one." );
+		PYCXX_ADD_VARARGS_METHOD( update_serialized_chunks, _update_serialized_chunks, "state = update_serialized_chunks(buffer,file,state,ranges)\nLike update_chunks(), but\n\
+patches the sigmas of the rewritten chunks in place in a writable buffer\n\
+holding a binary serialized tag, such as an mmap of a stored tag file, and\n\
+returns the new state." );
+		PYCXX_ADD_VARARGS_METHOD( gen_challenge, _gen_challenge, "challenge = gen_challenge(state,distinct=False)\nReturns a challenge for sending to the server.  The\n\
 state should be retreived from the server and this function will decrypt it and\n\
 verify its signature before generating a challenge.  Upon failure it will raise\n\
-a runtime error." );
+a runtime error.  If distinct is true the challenge checks different chunks,\n\
+selected by a keyed permutation, instead of independently drawn chunks which\n\
+may repeat, so fewer chunks are read for the same detection probability." );
+		PYCXX_ADD_VARARGS_METHOD( gen_token, _gen_token, "token = gen_token(challenge,state)\nReturns the verification token of the challenge, the part\n\
+of verification which does not depend on the proof.  Verifying with the token\n\
+only has work proportional to the number of sectors left.  The token must be\n\
+kept private." );
+		PYCXX_ADD_VARARGS_METHOD( gen_challenges, _gen_challenges, "[(challenge,token),...] = gen_challenges(state,count,distinct=False)\nReturns count challenges\n\
+for the file of state, each with its verification token, generated in parallel\n\
+without holding the interpreter lock." );
 		PYCXX_ADD_VARARGS_METHOD( prove, _prove, "proof = prove(file,challenge,tag)\nReturns a proof that should be sent back to\n\
 the client for verification." );
-		PYCXX_ADD_VARARGS_METHOD( verify, _verify, "is_valid = verify(proof,challenge,state)\nReturns a boolean representing whether the\n\
+		PYCXX_ADD_VARARGS_METHOD( prove_partial, _prove_partial, "proof = prove_partial(file,challenge,tag,first,last)\nReturns the part of a proof for the\n\
+challenged chunks from first up to last, for a shard file holding the file from\n\
+chunk first on.  The parts for shards covering the file are added into its\n\
+proof by combine_proofs()." );
+		PYCXX_ADD_VARARGS_METHOD( combine_proofs, _combine_proofs, "proof = combine_proofs(partials)\nReturns the proof made of a list of partial proofs\n\
+of a file, for chunk ranges which do not overlap." );
+		PYCXX_ADD_VARARGS_METHOD( verify, _verify, "is_valid = verify(proof,challenge,state,token=None)\nReturns a boolean representing whether the\n\
 proof is valid given the challenge and file state. This function will decypt\n\
-the state if necessary." );
+the state if necessary.  If the token of the challenge is given only the work\n\
+which depends on the proof is done." );
+		PYCXX_ADD_VARARGS_METHOD( prove_many, _prove_many, "proofs = prove_many([(file,challenge,tag),...])\nReturns a list of proofs, one for each (file,challenge,tag)\n\
+tuple.  Files given as paths are read and proved in parallel without holding\n\
+the interpreter lock, file objects are proved in the calling thread." );
+		PYCXX_ADD_VARARGS_METHOD( verify_many, _verify_many, "results = verify_many([(proof,challenge,state),...])\nReturns a list of booleans, one for each\n\
+(proof,challenge,state) tuple.  Proofs are verified in parallel without holding\n\
+the interpreter lock and each distinct state object is decrypted only once.\n\
+Items may also be (proof,challenge,state,token) tuples." );
+		PYCXX_ADD_VARARGS_METHOD( prove_aggregate, _prove_aggregate, "proof = prove_aggregate([(file,challenge,tag),...])\nReturns a single proof for several files, each\n\
+with its own challenge, folding their proofs with weights derived from all of\n\
+the challenges.  The proof is the size of the proof of one file.  Files are\n\
+proved as by prove_many()." );
+		PYCXX_ADD_VARARGS_METHOD( verify_aggregate, _verify_aggregate, "is_valid = verify_aggregate(proof,[(challenge,state),...])\nReturns whether an aggregated\n\
+proof is valid for the challenges and states of its files, in the order they\n\
+were proved.  The files must have been encoded with the keys of this object." );
+		PYCXX_ADD_VARARGS_METHOD( verify_batch, _verify_batch, "results = verify_batch([(proof,challenge,state),...])\nLike verify_many(), but checks a random linear\n\
+combination of the proofs instead of each one, so proofs sharing a state object\n\
+share the work on its sectors.  If the combination fails the batch is bisected\n\
+to find the invalid proofs.  Returns a list of booleans, one for each item." );
+		PYCXX_ADD_VARARGS_METHOD( encode_async, _encode_async, "future = encode_async(file)\nLike encode(), but runs on a background thread and returns a\n\
+concurrent.futures.Future resolving to (tag,state).  Wrap the future with\n\
+asyncio.wrap_future() to await it.  Cancelling the future stops the encode.\n\
+The file may be a path or a file object.  File objects with a file descriptor\n\
+are read from their current position without moving it." );
+		PYCXX_ADD_VARARGS_METHOD( prove_async, _prove_async, "future = prove_async(file,challenge,tag)\nLike prove(), but runs on a background thread and\n\
+returns a concurrent.futures.Future resolving to the proof.  Cancelling the\n\
+future stops the proof." );
+		PYCXX_ADD_VARARGS_METHOD( verify_async, _verify_async, "future = verify_async(proof,challenge,state)\nLike verify(), but runs on a background thread\n\
+and returns a concurrent.futures.Future resolving to a boolean." );
 
 		add_method( "tag_type", _tag_type, METH_NOARGS | METH_STATIC, "tag_type()\nReturns the type of tag.");
 		add_method( "state_type", _state_type, METH_NOARGS | METH_STATIC, "state_type()\nReturns the type of state.");
 		add_method( "proof_type", _proof_type, METH_NOARGS | METH_STATIC, "proof_type()\nReturns the type of proof.");
 		add_method( "challenge_type", _challenge_type, METH_NOARGS | METH_STATIC, "challenge_type()\nReturns the type of challenge.");
+		add_method( "token_type", _token_type, METH_NOARGS | METH_STATIC, "token_type()\nReturns the type of token.");
 		
 		behaviors().readyType();
 	}
@@ -581,7 +734,38 @@ the state if necessary." );
 	}
 	PYCXX_NOARGS_METHOD_DECL( Swizzle, _get_public )
 	
-	// (tag,state) = encode(file)
+	Py::Object _parameters()
+	{
+		if (!get_parameter_set())
+		{
+			return Py::None();
+		}
+		return Py::String(get_parameter_set()->name);
+	}
+	PYCXX_NOARGS_METHOD_DECL( Swizzle, _parameters )
+	
+	Py::Object _alpha_epoch()
+	{
+		return Py::Long((long)alpha_epoch());
+	}
+	PYCXX_NOARGS_METHOD_DECL( Swizzle, _alpha_epoch )
+	
+	Py::Object _rotate_alpha()
+	{
+		try
+		{
+			rotate_alpha();
+			return Py::None();
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_NOARGS_METHOD_DECL( Swizzle, _rotate_alpha )
+	
+	// (tag,state) = encode(file,cache=None)
 	Py::Object _encode(const Py::Tuple &args )
 	{
 		try 
@@ -600,10 +784,35 @@ the state if necessary." );
 			
 			//std::cout << "stream file generated..." << std::endl;
 			
+			// identical content is encoded once with a cache, at the cost of
+			// hashing the file first
+			Py::Object cache = args.size() > 1 ? args[1] : Py::None();
+			py_array key;
+			if (!cache.isNone())
+			{
+				size_t pos = (long)Py::Long(args[0].callMemberFunction("tell"));
+				byte k[cache_key_size];
+				cache_key(k,psf);
+				key = py_array((const char*)k,cache_key_size);
+				
+				Py::Object cached = cache.callMemberFunction("get",Py::TupleN(key));
+				if (!cached.isNone())
+				{
+					Py::Sequence item( cached );
+					return Py::TupleN(Py::PythonClassObject<Tag>( item[0] ),Py::PythonClassObject<State>( item[1] ));
+				}
+				psf.seek(pos);
+			}
+			
 			encode(*tag,*state,psf);
 			
 			//std::cout << "done" << std::endl;
 			
+			if (!cache.isNone())
+			{
+				cache.callMemberFunction("put",Py::TupleN(key,pytag,pystate));
+			}
+			
 			return Py::TupleN(pytag,pystate);
 		} 
 		catch (const std::exception &e)
@@ -614,108 +823,994 @@ the state if necessary." );
 	}
 	PYCXX_VARARGS_METHOD_DECL( Swizzle, _encode )
 	
-	// challenge = gen_challenge(state)
-	Py::Object _gen_challenge(const Py::Tuple &args )
+	// (tag,state) = beat.encode_append(file,tag,state)
+	Py::Object _encode_append(const Py::Tuple &args )
 	{
-		try
+		try 
 		{
-			//std::cout << "generating challenge...";
+			PythonSeekableFile psf(args[0]);
+			Tag *old_tag = Py::PythonClassObject<Tag>( args[1] ).getCxxObject();
+			State *old_state = Py::PythonClassObject<State>( args[2] ).getCxxObject();
 			
-			Py::Callable challenge_type( Challenge::type() );
-			Py::PythonClassObject<Challenge> pychallenge( challenge_type.apply( Py::Tuple() ) );
-			Challenge *challenge = pychallenge.getCxxObject();
-		
-			Py::PythonClassObject<State> pystate( args[0] );
+			Py::Callable tag_type( Tag::type() );
+			Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+			Tag *tag = pytag.getCxxObject();
+			
+			Py::Callable state_type( State::type() );
+			Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
 			State *state = pystate.getCxxObject();
-		 
-			gen_challenge(*challenge,*state);
-		
-			//std::cout << "done." << std::endl;
 			
-			return pychallenge;
-		}
+			static_cast<shacham_waters_private_data::tag&>(*tag) = *old_tag;
+			static_cast<shacham_waters_private_data::state&>(*state) = *old_state;
+			
+			size_t offset = append_offset(*tag);
+			psf.seek(0);
+			if (psf.bytes_remaining() < offset)
+			{
+				throw std::runtime_error("File is shorter than when it was encoded.");
+			}
+			psf.seek(offset);
+			
+			encode_append(*tag,*state,psf);
+			
+			return Py::TupleN(pytag,pystate);
+		} 
 		catch (const std::exception &e)
 		{
 			throw PyHeartbeatException(e.what());
 			return Py::None();
 		}
 	}
-	PYCXX_VARARGS_METHOD_DECL( Swizzle, _gen_challenge )
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _encode_append )
 	
-	// proof = public_beat.prove(file,challenge,tag)
-	Py::Object _prove(const Py::Tuple &args )
+	// state = beat.gen_state(size)
+	Py::Object _gen_state(const Py::Tuple &args )
 	{
-		try
+		try 
 		{
-			PythonSeekableFile psf(args[0]);
+			size_t size = Py::Long(args[0]).as_unsigned_long_long();
 			
-			Py::PythonClassObject<Challenge> pychallenge( args[1] );
-			Challenge *challenge = pychallenge.getCxxObject();
-			
-			Py::PythonClassObject<Tag> pytag( args[2] );
-			Tag *tag = pytag.getCxxObject();
-			
-			Py::Callable proof_type( Proof::type() );
-			Py::PythonClassObject<Proof> pyproof( proof_type.apply( Py::Tuple() ) );
-			Proof *proof = pyproof.getCxxObject();
+			Py::Callable state_type( State::type() );
+			Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
+			State *state = pystate.getCxxObject();
 			
-			prove(*proof,psf,*challenge,*tag);
+			gen_state(*state,size);
 			
-			return pyproof;
-		}
+			return pystate;
+		} 
 		catch (const std::exception &e)
 		{
 			throw PyHeartbeatException(e.what());
 			return Py::None();
 		}
 	}
-	PYCXX_VARARGS_METHOD_DECL( Swizzle, _prove )
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _gen_state )
 	
-	// is_valid = beat.verify(proof,challenge,state)
-	Py::Object _verify(const Py::Tuple &args )
+	// segment = beat.encode_range(file,state,first,count)
+	Py::Object _encode_range(const Py::Tuple &args )
 	{
-		try
+		try 
 		{
-			Py::PythonClassObject<Proof> pyproof( args[0] );
-			Proof *proof = pyproof.getCxxObject();
-		
-			Py::PythonClassObject<Challenge> pychallenge( args[1] );
-			Challenge *challenge = pychallenge.getCxxObject();
+			PythonSeekableFile psf(args[0]);
+			State *state = Py::PythonClassObject<State>( args[1] ).getCxxObject();
+			unsigned int first = Py::Long(args[2]).as_unsigned_long();
+			unsigned int count = Py::Long(args[3]).as_unsigned_long();
 			
-			Py::PythonClassObject<State> pystate( args[2] );
-			State *state = pystate.getCxxObject();
+			Py::Callable tag_type( Tag::type() );
+			Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+			Tag *tag = pytag.getCxxObject();
 			
-			bool is_valid = verify(*proof,*challenge,*state);
+			encode_range(*tag,*state,psf,first,count);
 			
-			if (is_valid)
-			{
-				return Py::True();
-			}
-			else
-			{
-				return Py::False();
-			}
-		}
+			return pytag;
+		} 
 		catch (const std::exception &e)
 		{
 			throw PyHeartbeatException(e.what());
 			return Py::None();
 		}
-		catch (const Py::Exception &)
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _encode_range )
+	
+	// tag = beat.merge_tags(segments)
+	Py::Object _merge_tags(const Py::Tuple &args )
+	{
+		try 
+		{
+			Py::Sequence items( args[0] );
+			std::vector<const shacham_waters_private_data::tag*> segments(items.size());
+			for (size_t i=0;i<segments.size();i++)
+			{
+				segments[i] = Py::PythonClassObject<Tag>( items[i] ).getCxxObject();
+			}
+			
+			Py::Callable tag_type( Tag::type() );
+			Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+			Tag *tag = pytag.getCxxObject();
+			
+			merge_tags(*tag,segments);
+			
+			return pytag;
+		} 
+		catch (const std::exception &e)
 		{
+			throw PyHeartbeatException(e.what());
 			return Py::None();
 		}
 	}
-	PYCXX_VARARGS_METHOD_DECL( Swizzle, _verify )
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _merge_tags )
 	
-	static PyObject * _tag_type( PyObject *, PyObject *)
+	// gives the checkpoints of an encode to a python callable
+	class python_checkpoint_sink : public checkpoint_sink
 	{
-		return Py::new_reference_to( reinterpret_cast<PyObject*>(Tag::type_object()) );
-	}
+	public:
+		python_checkpoint_sink(const Py::Object &fn) : _fn(fn) {}
+		
+		virtual void checkpoint(const tag &segment, const state &s)
+		{
+			Py::Callable tag_type( Tag::type() );
+			Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+			static_cast<shacham_waters_private_data::tag&>(*pytag.getCxxObject()) = segment;
+			
+			Py::Callable state_type( State::type() );
+			Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
+			static_cast<shacham_waters_private_data::state&>(*pystate.getCxxObject()) = s;
+			
+			// an exception raised by the callable stops the encode
+			if (_fn.apply(Py::TupleN(pytag,pystate)).isNull())
+			{
+				throw Py::Exception();
+			}
+		}
+	private:
+		Py::Callable _fn;
+	};
 	
-	static PyObject * _state_type( PyObject *, PyObject * )
+	// (tag,state) = beat.encode_checkpointed(file,checkpoint,interval)
+	Py::Object _encode_checkpointed(const Py::Tuple &args )
 	{
-		return Py::new_reference_to( reinterpret_cast<PyObject*>(State::type_object()) );
+		try 
+		{
+			PythonSeekableFile psf(args[0]);
+			python_checkpoint_sink sink(args[1]);
+			unsigned int interval = Py::Long(args[2]).as_unsigned_long();
+			
+			Py::Callable tag_type( Tag::type() );
+			Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+			Tag *tag = pytag.getCxxObject();
+			
+			Py::Callable state_type( State::type() );
+			Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
+			State *state = pystate.getCxxObject();
+			
+			encode_checkpointed(*tag,*state,psf,sink,interval);
+			
+			return Py::TupleN(pytag,pystate);
+		} 
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _encode_checkpointed )
+	
+	// (tag,state) = beat.resume_encode(file,tag,state,checkpoint=None,interval=0)
+	Py::Object _resume_encode(const Py::Tuple &args )
+	{
+		try 
+		{
+			PythonSeekableFile psf(args[0]);
+			Tag *old_tag = Py::PythonClassObject<Tag>( args[1] ).getCxxObject();
+			State *old_state = Py::PythonClassObject<State>( args[2] ).getCxxObject();
+			
+			std::unique_ptr<python_checkpoint_sink> sink;
+			if (args.size() > 3 && !args[3].isNone())
+			{
+				sink.reset(new python_checkpoint_sink(args[3]));
+			}
+			unsigned int interval = args.size() > 4 ? Py::Long(args[4]).as_unsigned_long() : 0;
+			
+			Py::Callable tag_type( Tag::type() );
+			Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+			Tag *tag = pytag.getCxxObject();
+			
+			Py::Callable state_type( State::type() );
+			Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
+			State *state = pystate.getCxxObject();
+			
+			static_cast<shacham_waters_private_data::tag&>(*tag) = *old_tag;
+			static_cast<shacham_waters_private_data::state&>(*state) = *old_state;
+			
+			size_t offset = resume_offset(*tag);
+			psf.seek(0);
+			if (psf.bytes_remaining() < offset)
+			{
+				throw std::runtime_error("File is shorter than the checkpoint.");
+			}
+			psf.seek(offset);
+			
+			resume_encode(*tag,*state,psf,sink.get(),interval);
+			
+			return Py::TupleN(pytag,pystate);
+		} 
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _resume_encode )
+	
+	static std::vector<std::pair<unsigned int,unsigned int> > to_ranges(const Py::Object &obj)
+	{
+		Py::Sequence items( obj );
+		std::vector<std::pair<unsigned int,unsigned int> > ranges(items.size());
+		for (size_t i=0;i<ranges.size();i++)
+		{
+			Py::Sequence range( items[i] );
+			if (range.size() != 2)
+			{
+				throw std::runtime_error("Chunk ranges must be (first,last) tuples.");
+			}
+			ranges[i] = std::make_pair((unsigned int)Py::Long(range[0]).as_unsigned_long(),(unsigned int)Py::Long(range[1]).as_unsigned_long());
+		}
+		return ranges;
+	}
+	
+	// (tag,state) = beat.update_chunks(file,tag,state,ranges)
+	Py::Object _update_chunks(const Py::Tuple &args )
+	{
+		try 
+		{
+			PythonSeekableFile psf(args[0]);
+			Tag *old_tag = Py::PythonClassObject<Tag>( args[1] ).getCxxObject();
+			State *old_state = Py::PythonClassObject<State>( args[2] ).getCxxObject();
+			std::vector<std::pair<unsigned int,unsigned int> > ranges = to_ranges(args[3]);
+			
+			Py::Callable tag_type( Tag::type() );
+			Py::PythonClassObject<Tag> pytag( tag_type.apply( Py::Tuple() ) );
+			Tag *tag = pytag.getCxxObject();
+			
+			Py::Callable state_type( State::type() );
+			Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
+			State *state = pystate.getCxxObject();
+			
+			static_cast<shacham_waters_private_data::tag&>(*tag) = *old_tag;
+			static_cast<shacham_waters_private_data::state&>(*state) = *old_state;
+			
+			update_chunks(*tag,*state,psf,ranges);
+			
+			return Py::TupleN(pytag,pystate);
+		} 
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _update_chunks )
+	
+	// state = beat.update_serialized_chunks(buffer,file,state,ranges)
+	Py::Object _update_serialized_chunks(const Py::Tuple &args )
+	{
+		Py_buffer view;
+		if (PyObject_GetBuffer(args[0].ptr(),&view,PyBUF_WRITABLE) != 0)
+		{
+			throw Py::Exception();
+		}
+		Py::Object result;
+		try 
+		{
+			PythonSeekableFile psf(args[1]);
+			State *old_state = Py::PythonClassObject<State>( args[2] ).getCxxObject();
+			std::vector<std::pair<unsigned int,unsigned int> > ranges = to_ranges(args[3]);
+			
+			Py::Callable state_type( State::type() );
+			Py::PythonClassObject<State> pystate( state_type.apply( Py::Tuple() ) );
+			State *state = pystate.getCxxObject();
+			
+			static_cast<shacham_waters_private_data::state&>(*state) = *old_state;
+			
+			update_serialized_chunks((unsigned char*)view.buf,view.len,*state,psf,ranges);
+			result = pystate;
+		} 
+		catch (const std::exception &e)
+		{
+			PyBuffer_Release(&view);
+			throw PyHeartbeatException(e.what());
+		}
+		catch (...)
+		{
+			PyBuffer_Release(&view);
+			throw;
+		}
+		PyBuffer_Release(&view);
+		return result;
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _update_serialized_chunks )
+	
+	// challenge = gen_challenge(state,distinct=False)
+	Py::Object _gen_challenge(const Py::Tuple &args )
+	{
+		try
+		{
+			//std::cout << "generating challenge...";
+			
+			Py::Callable challenge_type( Challenge::type() );
+			Py::PythonClassObject<Challenge> pychallenge( challenge_type.apply( Py::Tuple() ) );
+			Challenge *challenge = pychallenge.getCxxObject();
+		
+			Py::PythonClassObject<State> pystate( args[0] );
+			State *state = pystate.getCxxObject();
+		 
+			bool distinct = args.size() > 1 && args[1].isTrue();
+		 
+			gen_challenge(*challenge,*state,distinct);
+		
+			//std::cout << "done." << std::endl;
+			
+			return pychallenge;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _gen_challenge )
+	
+	// token = beat.gen_token(challenge,state)
+	Py::Object _gen_token(const Py::Tuple &args )
+	{
+		try
+		{
+			Challenge *challenge = Py::PythonClassObject<Challenge>( args[0] ).getCxxObject();
+			State *state = Py::PythonClassObject<State>( args[1] ).getCxxObject();
+			
+			Py::Callable token_type( Token::type() );
+			Py::PythonClassObject<Token> pytoken( token_type.apply( Py::Tuple() ) );
+			
+			gen_token(*pytoken.getCxxObject(),*challenge,*state);
+			
+			return pytoken;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _gen_token )
+	
+	// [(challenge,token),...] = beat.gen_challenges(state,count,distinct=False)
+	Py::Object _gen_challenges(const Py::Tuple &args )
+	{
+		try
+		{
+			State *state = Py::PythonClassObject<State>( args[0] ).getCxxObject();
+			long count = Py::Long(args[1]);
+			bool distinct = args.size() > 2 && args[2].isTrue();
+			
+			if (count < 0)
+			{
+				throw PyHeartbeatException("The challenge count must not be negative.");
+			}
+			
+			Py::Callable challenge_type( Challenge::type() );
+			Py::Callable token_type( Token::type() );
+			Py::List pairs;
+			std::vector<Challenge*> challenges(count);
+			std::vector<Token*> tokens(count);
+			
+			for (long i=0;i<count;i++)
+			{
+				Py::PythonClassObject<Challenge> pychallenge( challenge_type.apply( Py::Tuple() ) );
+				Py::PythonClassObject<Token> pytoken( token_type.apply( Py::Tuple() ) );
+				challenges[i] = pychallenge.getCxxObject();
+				tokens[i] = pytoken.getCxxObject();
+				pairs.append(Py::TupleN(pychallenge,pytoken));
+			}
+			
+			{
+				PyAllowThreads nogil;
+				
+				shacham_waters_private_data::state decrypted;
+				if (!decrypt_state(decrypted,*state))
+				{
+					throw std::runtime_error("Signature check or decryption failed in generating challenge.  State of remote file cannot be verified.");
+				}
+				
+				// prf evaluation is not reentrant, so each challenge works on
+				// its own copy of the decrypted state
+				thread_pool::shared().parallel_for(count,[&](size_t i)
+				{
+					shacham_waters_private_data::state s = decrypted;
+					gen_challenge_decrypted(*challenges[i],s,distinct);
+					gen_token_decrypted(*tokens[i],*challenges[i],s);
+				});
+			}
+			
+			return pairs;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _gen_challenges )
+	
+	// proof = public_beat.prove(file,challenge,tag)
+	Py::Object _prove(const Py::Tuple &args )
+	{
+		try
+		{
+			PythonSeekableFile psf(args[0]);
+			
+			Py::PythonClassObject<Challenge> pychallenge( args[1] );
+			Challenge *challenge = pychallenge.getCxxObject();
+			
+			Py::PythonClassObject<Tag> pytag( args[2] );
+			Tag *tag = pytag.getCxxObject();
+			
+			Py::Callable proof_type( Proof::type() );
+			Py::PythonClassObject<Proof> pyproof( proof_type.apply( Py::Tuple() ) );
+			Proof *proof = pyproof.getCxxObject();
+			
+			prove(*proof,psf,*challenge,*tag);
+			
+			return pyproof;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _prove )
+	
+	// proof = beat.prove_partial(file,challenge,tag,first,last)
+	Py::Object _prove_partial(const Py::Tuple &args )
+	{
+		try
+		{
+			PythonSeekableFile psf(args[0]);
+			Challenge *challenge = Py::PythonClassObject<Challenge>( args[1] ).getCxxObject();
+			Tag *tag = Py::PythonClassObject<Tag>( args[2] ).getCxxObject();
+			unsigned int first = Py::Long(args[3]).as_unsigned_long();
+			unsigned int last = Py::Long(args[4]).as_unsigned_long();
+			
+			Py::Callable proof_type( Proof::type() );
+			Py::PythonClassObject<Proof> pyproof( proof_type.apply( Py::Tuple() ) );
+			Proof *proof = pyproof.getCxxObject();
+			
+			prove_partial(*proof,psf,*challenge,*tag,first,last);
+			
+			return pyproof;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _prove_partial )
+	
+	// proof = beat.combine_proofs(partials)
+	Py::Object _combine_proofs(const Py::Tuple &args )
+	{
+		try
+		{
+			Py::Sequence items( args[0] );
+			std::vector<const shacham_waters_private_data::proof*> partials(items.size());
+			for (size_t i=0;i<partials.size();i++)
+			{
+				partials[i] = Py::PythonClassObject<Proof>( items[i] ).getCxxObject();
+			}
+			
+			Py::Callable proof_type( Proof::type() );
+			Py::PythonClassObject<Proof> pyproof( proof_type.apply( Py::Tuple() ) );
+			Proof *proof = pyproof.getCxxObject();
+			
+			combine_proofs(*proof,partials);
+			
+			return pyproof;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _combine_proofs )
+	
+	// is_valid = beat.verify(proof,challenge,state)
+	Py::Object _verify(const Py::Tuple &args )
+	{
+		try
+		{
+			Py::PythonClassObject<Proof> pyproof( args[0] );
+			Proof *proof = pyproof.getCxxObject();
+		
+			Py::PythonClassObject<Challenge> pychallenge( args[1] );
+			Challenge *challenge = pychallenge.getCxxObject();
+			
+			Py::PythonClassObject<State> pystate( args[2] );
+			State *state = pystate.getCxxObject();
+			
+			bool is_valid;
+			if (args.size() > 3 && !args[3].isNone())
+			{
+				Token *token = Py::PythonClassObject<Token>( args[3] ).getCxxObject();
+				is_valid = verify_token(*proof,*challenge,*token,*state);
+			}
+			else
+			{
+				is_valid = verify(*proof,*challenge,*state);
+			}
+			
+			if (is_valid)
+			{
+				return Py::True();
+			}
+			else
+			{
+				return Py::False();
+			}
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+		catch (const Py::Exception &)
+		{
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _verify )
+	
+	// proofs = public_beat.prove_many([(file,challenge,tag),...])
+	Py::Object _prove_many(const Py::Tuple &args )
+	{
+		try
+		{
+			Py::Sequence items( args[0] );
+			size_t n = items.length();
+			
+			Py::Callable proof_type( Proof::type() );
+			Py::List pyproofs;
+			std::vector<Proof*> proofs(n);
+			std::vector<Challenge*> challenges(n);
+			std::vector<Tag*> tags(n);
+			std::vector<std::string> paths(n);
+			std::vector<size_t> native;
+			std::vector<Py::Object> refs;
+			
+			for (size_t i=0;i<n;i++)
+			{
+				Py::Sequence item( items[i] );
+				if (item.length() != 3)
+				{
+					throw PyHeartbeatException("prove_many() takes a list of (file,challenge,tag) tuples.");
+				}
+				
+				challenges[i] = Py::PythonClassObject<Challenge>( item[1] ).getCxxObject();
+				tags[i] = Py::PythonClassObject<Tag>( item[2] ).getCxxObject();
+				refs.push_back(item[1]);
+				refs.push_back(item[2]);
+				
+				Py::PythonClassObject<Proof> pyproof( proof_type.apply( Py::Tuple() ) );
+				proofs[i] = pyproof.getCxxObject();
+				pyproofs.append(pyproof);
+				
+				if (get_native_path(item[0],paths[i]))
+				{
+					native.push_back(i);
+				}
+				else
+				{
+					PythonSeekableFile psf(item[0]);
+					prove(*proofs[i],psf,*challenges[i],*tags[i]);
+				}
+			}
+			
+			{
+				PyAllowThreads nogil;
+				
+				thread_pool::shared().parallel_for(native.size(),[&](size_t k)
+				{
+					size_t i = native[k];
+					fd_file f(paths[i]);
+					prove(*proofs[i],f,*challenges[i],*tags[i]);
+				});
+			}
+			
+			return pyproofs;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _prove_many )
+	
+	// the (proof,challenge,state) or (proof,challenge,state,token) items of a
+	// batch verification.  items sharing a state object share its decryption
+	struct verify_items
+	{
+		std::vector<Proof*> proofs;
+		std::vector<Challenge*> challenges;
+		std::vector<Token*> tokens;
+		std::map<State*,size_t> state_index;
+		std::vector<State*> states;
+		std::vector<size_t> item_state;
+		// keeps the objects alive while the interpreter lock is released
+		std::vector<Py::Object> refs;
+		
+		verify_items(const std::string &method, const Py::Object &arg)
+		{
+			Py::Sequence items( arg );
+			size_t n = items.length();
+			
+			proofs.resize(n);
+			challenges.resize(n);
+			tokens.assign(n,(Token*)0);
+			item_state.resize(n);
+			
+			for (size_t i=0;i<n;i++)
+			{
+				Py::Sequence item( items[i] );
+				if (item.length() != 3 && item.length() != 4)
+				{
+					throw PyHeartbeatException(method + "() takes a list of (proof,challenge,state) or (proof,challenge,state,token) tuples.");
+				}
+				
+				proofs[i] = Py::PythonClassObject<Proof>( item[0] ).getCxxObject();
+				challenges[i] = Py::PythonClassObject<Challenge>( item[1] ).getCxxObject();
+				State *state = Py::PythonClassObject<State>( item[2] ).getCxxObject();
+				refs.push_back(item[0]);
+				refs.push_back(item[1]);
+				refs.push_back(item[2]);
+				
+				if (item.length() == 4 && !Py::Object(item[3]).isNone())
+				{
+					tokens[i] = Py::PythonClassObject<Token>( item[3] ).getCxxObject();
+					refs.push_back(item[3]);
+				}
+				
+				std::map<State*,size_t>::iterator it = state_index.find(state);
+				if (it == state_index.end())
+				{
+					it = state_index.insert(std::make_pair(state,states.size())).first;
+					states.push_back(state);
+				}
+				item_state[i] = it->second;
+			}
+		}
+		
+		size_t size() const { return proofs.size(); }
+	};
+	
+	static Py::Object to_list(const std::vector<unsigned char> &results)
+	{
+		Py::List pyresults;
+		for (size_t i=0;i<results.size();i++)
+		{
+			pyresults.append(results[i] ? Py::True() : Py::False());
+		}
+		return pyresults;
+	}
+	
+	// results = beat.verify_many([(proof,challenge,state),...])
+	Py::Object _verify_many(const Py::Tuple &args )
+	{
+		try
+		{
+			verify_items v("verify_many",args[0]);
+			size_t n = v.size();
+			std::vector<Proof*> &proofs = v.proofs;
+			std::vector<Challenge*> &challenges = v.challenges;
+			std::vector<Token*> &tokens = v.tokens;
+			std::vector<State*> &states = v.states;
+			std::vector<size_t> &item_state = v.item_state;
+			
+			std::vector<unsigned char> results(n,0);
+			
+			{
+				PyAllowThreads nogil;
+				thread_pool &pool = thread_pool::shared();
+				
+				std::vector<shacham_waters_private_data::state> decrypted(states.size());
+				std::vector<unsigned char> valid(states.size(),0);
+				
+				pool.parallel_for(states.size(),[&](size_t k)
+				{
+					valid[k] = decrypt_state(decrypted[k],*states[k]);
+				});
+				
+				// prf evaluation is not reentrant, so each run of items works on
+				// its own copy of the decrypted state.  runs are sized to give
+				// each worker a few of them
+				size_t run = std::max<size_t>(1,n / (4 * (pool.size() + 1)));
+				
+				pool.parallel_for((n + run - 1) / run,[&](size_t r)
+				{
+					size_t end = std::min(n,(r+1)*run);
+					size_t current = states.size();
+					shacham_waters_private_data::state s;
+					
+					for (size_t i=r*run;i<end;i++)
+					{
+						if (!valid[item_state[i]])
+						{
+							continue;
+						}
+						if (item_state[i] != current)
+						{
+							current = item_state[i];
+							s = decrypted[current];
+						}
+						results[i] = tokens[i] 
+							? verify_token_decrypted(*proofs[i],*challenges[i],*tokens[i],s)
+							: verify_decrypted(*proofs[i],*challenges[i],s);
+					}
+				});
+			}
+			
+			return to_list(results);
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _verify_many )
+	
+	// proof = public_beat.prove_aggregate([(file,challenge,tag),...])
+	Py::Object _prove_aggregate(const Py::Tuple &args )
+	{
+		try
+		{
+			Py::Sequence items( args[0] );
+			Py::Sequence pyproofs( _prove_many(args) );
+			
+			std::vector<const shacham_waters_private_data::proof*> proofs(items.length());
+			std::vector<const shacham_waters_private_data::challenge*> challenges(items.length());
+			for (size_t i=0;i<proofs.size();i++)
+			{
+				proofs[i] = Py::PythonClassObject<Proof>( pyproofs[i] ).getCxxObject();
+				challenges[i] = Py::PythonClassObject<Challenge>( Py::Sequence( items[i] )[1] ).getCxxObject();
+			}
+			
+			Py::Callable proof_type( Proof::type() );
+			Py::PythonClassObject<Proof> pyproof( proof_type.apply( Py::Tuple() ) );
+			
+			aggregate(*pyproof.getCxxObject(),proofs,challenges);
+			
+			return pyproof;
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _prove_aggregate )
+	
+	// is_valid = beat.verify_aggregate(proof,[(challenge,state),...])
+	Py::Object _verify_aggregate(const Py::Tuple &args )
+	{
+		try
+		{
+			Proof *proof = Py::PythonClassObject<Proof>( args[0] ).getCxxObject();
+			Py::Sequence items( args[1] );
+			
+			std::vector<const shacham_waters_private_data::challenge*> challenges(items.length());
+			std::vector<const shacham_waters_private_data::state*> states(items.length());
+			for (size_t i=0;i<challenges.size();i++)
+			{
+				Py::Sequence item( items[i] );
+				if (item.length() != 2)
+				{
+					throw PyHeartbeatException("verify_aggregate() takes a proof and a list of (challenge,state) tuples.");
+				}
+				challenges[i] = Py::PythonClassObject<Challenge>( item[0] ).getCxxObject();
+				states[i] = Py::PythonClassObject<State>( item[1] ).getCxxObject();
+			}
+			
+			bool is_valid;
+			{
+				PyAllowThreads nogil;
+				is_valid = verify_aggregate(*proof,challenges,states);
+			}
+			
+			return is_valid ? Py::True() : Py::False();
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _verify_aggregate )
+	
+	// results = beat.verify_batch([(proof,challenge,state),...])
+	Py::Object _verify_batch(const Py::Tuple &args )
+	{
+		try
+		{
+			verify_items v("verify_batch",args[0]);
+			size_t n = v.size();
+			
+			std::vector<unsigned char> results(n,0);
+			
+			{
+				PyAllowThreads nogil;
+				thread_pool &pool = thread_pool::shared();
+				
+				std::vector<shacham_waters_private_data::state> decrypted(v.states.size());
+				std::vector<unsigned char> valid(v.states.size(),0);
+				
+				pool.parallel_for(v.states.size(),[&](size_t k)
+				{
+					valid[k] = decrypt_state(decrypted[k],*v.states[k]);
+				});
+				
+				// the challenge sums are the bulk of the work, and are computed
+				// in parallel as in verify_many.  items without a valid state or
+				// with the token of another challenge are invalid
+				std::vector<batch_item> items(n);
+				std::vector<unsigned char> usable(n,0);
+				size_t run = std::max<size_t>(1,n / (4 * (pool.size() + 1)));
+				
+				pool.parallel_for((n + run - 1) / run,[&](size_t r)
+				{
+					size_t end = std::min(n,(r+1)*run);
+					size_t current = v.states.size();
+					shacham_waters_private_data::state s;
+					
+					for (size_t i=r*run;i<end;i++)
+					{
+						size_t k = v.item_state[i];
+						if (!valid[k])
+						{
+							continue;
+						}
+						
+						items[i].p = v.proofs[i];
+						items[i].s = &decrypted[k];
+						if (v.tokens[i])
+						{
+							if (!v.tokens[i]->matches(*v.challenges[i]))
+							{
+								continue;
+							}
+							items[i].sum = v.tokens[i]->sum();
+						}
+						else
+						{
+							if (k != current)
+							{
+								current = k;
+								s = decrypted[current];
+							}
+							items[i].sum = challenge_sum(*v.challenges[i],s);
+						}
+						usable[i] = 1;
+					}
+				});
+				
+				std::vector<batch_item> combined;
+				std::vector<size_t> index;
+				for (size_t i=0;i<n;i++)
+				{
+					if (usable[i])
+					{
+						combined.push_back(items[i]);
+						index.push_back(i);
+					}
+				}
+				
+				std::vector<unsigned char> combined_valid;
+				verify_combined(combined_valid,combined);
+				
+				for (size_t j=0;j<index.size();j++)
+				{
+					results[index[j]] = combined_valid[j];
+				}
+			}
+			
+			return to_list(results);
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _verify_batch )
+	
+	// future = beat.encode_async(file)
+	Py::Object _encode_async(const Py::Tuple &args )
+	{
+		if (args.length() != 1)
+		{
+			throw PyHeartbeatException("encode_async() takes one argument: the file.");
+		}
+		
+		try
+		{
+			return start_job(new EncodeJob(self(),*this,args[0]));
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _encode_async )
+	
+	// future = public_beat.prove_async(file,challenge,tag)
+	Py::Object _prove_async(const Py::Tuple &args )
+	{
+		if (args.length() != 3)
+		{
+			throw PyHeartbeatException("prove_async() takes three arguments: the file, the challenge and the tag.");
+		}
+		
+		try
+		{
+			return start_job(new ProveJob(self(),*this,args[0],args[1],args[2]));
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _prove_async )
+	
+	// future = beat.verify_async(proof,challenge,state)
+	Py::Object _verify_async(const Py::Tuple &args )
+	{
+		if (args.length() != 3)
+		{
+			throw PyHeartbeatException("verify_async() takes three arguments: the proof, the challenge and the state.");
+		}
+		
+		try
+		{
+			return start_job(new VerifyJob(self(),*this,args[0],args[1],args[2]));
+		}
+		catch (const std::exception &e)
+		{
+			throw PyHeartbeatException(e.what());
+			return Py::None();
+		}
+	}
+	PYCXX_VARARGS_METHOD_DECL( Swizzle, _verify_async )
+	
+	// starts job and returns its future
+	static Py::Object start_job(AsyncJob *job)
+	{
+		std::unique_ptr<AsyncJob> owned(job);
+		Py::Object future = job->future();
+		owned.release()->start();
+		return future;
+	}
+	
+	static PyObject * _tag_type( PyObject *, PyObject *)
+	{
+		return Py::new_reference_to( reinterpret_cast<PyObject*>(Tag::type_object()) );
+	}
+	
+	static PyObject * _state_type( PyObject *, PyObject * )
+	{
+		return Py::new_reference_to( reinterpret_cast<PyObject*>(State::type_object()) );
 	}
 	
 	static PyObject * _proof_type( PyObject *, PyObject *)
@@ -727,6 +1822,11 @@ the state if necessary." );
 	{
 		return Py::new_reference_to( reinterpret_cast<PyObject*>(Challenge::type_object()) );
 	}
+	
+	static PyObject * _token_type( PyObject *, PyObject *)
+	{
+		return Py::new_reference_to( reinterpret_cast<PyObject*>(Token::type_object()) );
+	}
 };
 
 }
@@ -737,10 +1837,15 @@ public:
 	Module()
 		: Py::ExtensionModule<Module>("Swizzle")
 	{
+#if PY_VERSION_HEX < 0x03070000
+		// the batch methods release the interpreter lock
+		PyEval_InitThreads();
+#endif
 		Swizzle::Swizzle::init_type();
 		Swizzle::State::init_type();
 		Swizzle::Tag::init_type();
 		Swizzle::Challenge::init_type();
+		Swizzle::Token::init_type();
 		Swizzle::Proof::init_type();
 		
 		initialize(
@@ -753,6 +1858,7 @@ generating challenges and proofs, and verifying those proofs.\n");
 		d["State"] = Py::Object(Swizzle::State::type());
 		d["Tag"] = Py::Object(Swizzle::Tag::type());
 		d["Challenge"] = Py::Object(Swizzle::Challenge::type());
+		d["Token"] = Py::Object(Swizzle::Token::type());
 		d["Proof"] = Py::Object(Swizzle::Proof::type());
 		
 		Py::Object heartbeatExceptionModule = Py::asObject(PyImport_ImportModule("heartbeat.exc"));
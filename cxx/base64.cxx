@@ -25,99 +25,286 @@
 
 */
 
+/*
+
+   Altered for heartbeat: see base64.h.  The SSSE3 and AVX2 paths follow the
+   vectorised base64 algorithms described by Wojciech Mula and Daniel Lemire.
+
+*/
+
 #include "base64.h"
-#include <iostream>
 
-static const std::string base64_chars = 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+static const char base64_chars[] =
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
              "abcdefghijklmnopqrstuvwxyz"
              "0123456789+/";
 
+static const unsigned char base64_invalid = 0xff;
 
-static inline bool is_base64(unsigned char c) {
-  return (isalnum(c) || (c == '+') || (c == '/'));
+// maps each character to its 6 bit value, or base64_invalid
+class base64_decode_table {
+public:
+  base64_decode_table() {
+    for (int i = 0; i < 256; i++)
+      values[i] = base64_invalid;
+    for (int i = 0; i < 64; i++)
+      values[(unsigned char)base64_chars[i]] = (unsigned char)i;
+  }
+  unsigned char values[256];
+};
+
+static const base64_decode_table base64_table;
+
+#ifdef BASE64_X86_DISPATCH
+
+static bool base64_has_ssse3() {
+  static const bool has = __builtin_cpu_supports("ssse3");
+  return has;
 }
 
-std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
-  std::string ret;
-  int i = 0;
-  int j = 0;
-  unsigned char char_array_3[3];
-  unsigned char char_array_4[4];
-
-  while (in_len--) {
-    char_array_3[i++] = *(bytes_to_encode++);
-    if (i == 3) {
-      char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-      char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-      char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-      char_array_4[3] = char_array_3[2] & 0x3f;
-
-      for(i = 0; (i <4) ; i++)
-        ret += base64_chars[char_array_4[i]];
-      i = 0;
-    }
-  }
+static bool base64_has_avx2() {
+  static const bool has = __builtin_cpu_supports("avx2");
+  return has;
+}
 
-  if (i)
-  {
-    for(j = i; j < 3; j++)
-      char_array_3[j] = '\0';
+// splits the 3 byte groups in each 32 bit lane, already shuffled into place,
+// into four 6 bit indices and translates those indices into the alphabet
+__attribute__((target("ssse3")))
+static inline __m128i base64_encode_lanes(__m128i in) {
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  const __m128i indices = _mm_or_si128(t1, t3);
 
-    char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-    char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-    char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-    char_array_4[3] = char_array_3[2] & 0x3f;
+  __m128i offset = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  offset = _mm_or_si128(offset, _mm_and_si128(less, _mm_set1_epi8(13)));
+  const __m128i shift_lut = _mm_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+    '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, offset), indices);
+}
 
-    for (j = 0; (j < i + 1); j++)
-      ret += base64_chars[char_array_4[j]];
+__attribute__((target("avx2")))
+static inline __m256i base64_encode_lanes(__m256i in) {
+  const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+  const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+  const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+  const __m256i indices = _mm256_or_si256(t1, t3);
 
-    while((i++ < 3))
-      ret += '=';
+  __m256i offset = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+  offset = _mm256_or_si256(offset, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+  const __m128i shift_lut = _mm_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+    '/' - 63, 'A', 0, 0);
+  const __m256i shift_lut2 = _mm256_inserti128_si256(_mm256_castsi128_si256(shift_lut), shift_lut, 1);
+  return _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut2, offset), indices);
+}
 
+// encodes 12 bytes into 16 characters per iteration.  each load reads 16
+// bytes so we stop while at least 16 bytes of input remain
+__attribute__((target("ssse3")))
+static void base64_encode_ssse3(const unsigned char *in, size_t len, size_t &i, char *&o) {
+  const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  for (; i + 16 <= len; i += 12, o += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+    v = _mm_shuffle_epi8(v, shuffle);
+    _mm_storeu_si128((__m128i*)o, base64_encode_lanes(v));
   }
+}
 
-  return ret;
+// encodes 24 bytes into 32 characters per iteration, 12 bytes in each lane
+__attribute__((target("avx2")))
+static void base64_encode_avx2(const unsigned char *in, size_t len, size_t &i, char *&o) {
+  const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m256i shuffle2 = _mm256_inserti128_si256(_mm256_castsi128_si256(shuffle), shuffle, 1);
+  for (; i + 28 <= len; i += 24, o += 32) {
+    const __m128i lo = _mm_loadu_si128((const __m128i*)(in + i));
+    const __m128i hi = _mm_loadu_si128((const __m128i*)(in + i + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    v = _mm256_shuffle_epi8(v, shuffle2);
+    _mm256_storeu_si256((__m256i*)o, base64_encode_lanes(v));
+  }
+  base64_encode_ssse3(in, len, i, o);
+}
+
+// lookup tables for validating and translating characters, indexed by nibble
+#define BASE64_SHIFT_LUT 0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+#define BASE64_MASK_LUT (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, \
+  (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf0, 0x54, \
+  0x50, 0x50, 0x50, 0x54
+#define BASE64_BITPOS_LUT 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, \
+  0, 0, 0, 0, 0, 0, 0, 0
+#define BASE64_PACK_SHUFFLE 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
 
+// decodes 16 characters into 12 bytes per iteration.  each store writes 16
+// bytes so we stop while at least 16 bytes of output remain.  a block with any
+// character outside the alphabet is left for the scalar decoder
+__attribute__((target("ssse3")))
+static void base64_decode_ssse3(const char *in, size_t len, size_t &i, unsigned char *&o, const unsigned char *out_end) {
+  const __m128i shift_lut = _mm_setr_epi8(BASE64_SHIFT_LUT);
+  const __m128i mask_lut = _mm_setr_epi8(BASE64_MASK_LUT);
+  const __m128i bitpos_lut = _mm_setr_epi8(BASE64_BITPOS_LUT);
+  const __m128i pack = _mm_setr_epi8(BASE64_PACK_SHUFFLE);
+  for (; i + 16 <= len && o + 16 <= out_end; i += 16, o += 12) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+    const __m128i hi = _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi8(0x0f));
+    const __m128i lo = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+    const __m128i m = _mm_shuffle_epi8(mask_lut, lo);
+    const __m128i bit = _mm_shuffle_epi8(bitpos_lut, hi);
+    const __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(m, bit), _mm_setzero_si128());
+    if (_mm_movemask_epi8(invalid))
+      break;
+    // '/' shares its high nibble with '+' so it gets its own shift
+    const __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8(0x2f));
+    const __m128i shift = _mm_or_si128(_mm_andnot_si128(slash, _mm_shuffle_epi8(shift_lut, hi)),
+                                       _mm_and_si128(slash, _mm_set1_epi8(16)));
+    const __m128i values = _mm_add_epi8(v, shift);
+    const __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i*)o, _mm_shuffle_epi8(packed, pack));
+  }
 }
 
-std::string base64_decode(std::string const& encoded_string) {
-  int in_len = encoded_string.size();
-  int i = 0;
-  int j = 0;
-  int in_ = 0;
-  unsigned char char_array_4[4], char_array_3[3];
-  std::string ret;
-
-  while (in_len-- && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-    char_array_4[i++] = encoded_string[in_]; in_++;
-    if (i ==4) {
-      for (i = 0; i <4; i++)
-        char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-      char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-      char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-      char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-      for (i = 0; (i < 3); i++)
-        ret += char_array_3[i];
-      i = 0;
-    }
+// decodes 32 characters into 24 bytes per iteration
+__attribute__((target("avx2")))
+static void base64_decode_avx2(const char *in, size_t len, size_t &i, unsigned char *&o, const unsigned char *out_end) {
+  const __m128i shift_lut1 = _mm_setr_epi8(BASE64_SHIFT_LUT);
+  const __m128i mask_lut1 = _mm_setr_epi8(BASE64_MASK_LUT);
+  const __m128i bitpos_lut1 = _mm_setr_epi8(BASE64_BITPOS_LUT);
+  const __m128i pack1 = _mm_setr_epi8(BASE64_PACK_SHUFFLE);
+  const __m256i shift_lut = _mm256_inserti128_si256(_mm256_castsi128_si256(shift_lut1), shift_lut1, 1);
+  const __m256i mask_lut = _mm256_inserti128_si256(_mm256_castsi128_si256(mask_lut1), mask_lut1, 1);
+  const __m256i bitpos_lut = _mm256_inserti128_si256(_mm256_castsi128_si256(bitpos_lut1), bitpos_lut1, 1);
+  const __m256i pack = _mm256_inserti128_si256(_mm256_castsi128_si256(pack1), pack1, 1);
+  const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+  for (; i + 32 <= len && o + 32 <= out_end; i += 32, o += 24) {
+    const __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0f));
+    const __m256i lo = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+    const __m256i m = _mm256_shuffle_epi8(mask_lut, lo);
+    const __m256i bit = _mm256_shuffle_epi8(bitpos_lut, hi);
+    const __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(m, bit), _mm256_setzero_si256());
+    if (_mm256_movemask_epi8(invalid))
+      break;
+    const __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x2f));
+    const __m256i shift = _mm256_or_si256(_mm256_andnot_si256(slash, _mm256_shuffle_epi8(shift_lut, hi)),
+                                          _mm256_and_si256(slash, _mm256_set1_epi8(16)));
+    const __m256i values = _mm256_add_epi8(v, shift);
+    const __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    const __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    const __m256i out = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(packed, pack), gather);
+    _mm256_storeu_si256((__m256i*)o, out);
   }
+  base64_decode_ssse3(in, len, i, o, out_end);
+}
 
-  if (i) {
-    for (j = i; j <4; j++)
-      char_array_4[j] = 0;
+#endif
 
-    for (j = 0; j <4; j++)
-      char_array_4[j] = base64_chars.find(char_array_4[j]);
+size_t base64_decoded_size(const char *in, size_t len) {
+  size_t pad = 0;
+  while (pad < 2 && len > pad && in[len - pad - 1] == '=')
+    pad++;
+  len -= pad;
+  size_t rem = len % 4;
+  return (len / 4) * 3 + (rem ? rem - 1 : 0);
+}
+
+size_t base64_encode(const unsigned char *in, size_t len, char *out) {
+  size_t i = 0;
+  char *o = out;
+
+#ifdef BASE64_X86_DISPATCH
+  if (len >= 16) {
+    if (base64_has_avx2())
+      base64_encode_avx2(in, len, i, o);
+    else if (base64_has_ssse3())
+      base64_encode_ssse3(in, len, i, o);
+  }
+#endif
 
-    char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-    char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-    char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+  for (; i + 3 <= len; i += 3, o += 4) {
+    unsigned int v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+    o[0] = base64_chars[(v >> 18) & 0x3f];
+    o[1] = base64_chars[(v >> 12) & 0x3f];
+    o[2] = base64_chars[(v >> 6) & 0x3f];
+    o[3] = base64_chars[v & 0x3f];
+  }
 
-    for (j = 0; (j < i - 1); j++) ret += char_array_3[j];
+  if (i < len) {
+    unsigned int v = in[i] << 16;
+    if (i + 1 < len)
+      v |= in[i + 1] << 8;
+    o[0] = base64_chars[(v >> 18) & 0x3f];
+    o[1] = base64_chars[(v >> 12) & 0x3f];
+    o[2] = (i + 1 < len) ? base64_chars[(v >> 6) & 0x3f] : '=';
+    o[3] = '=';
+    o += 4;
   }
 
+  return o - out;
+}
+
+size_t base64_decode(const char *in, size_t len, unsigned char *out) {
+  const unsigned char *d = base64_table.values;
+  unsigned char *o = out;
+  size_t i = 0;
+
+#ifdef BASE64_X86_DISPATCH
+  const unsigned char *out_end = out + base64_decoded_size(in, len);
+  if (len >= 16) {
+    if (base64_has_avx2())
+      base64_decode_avx2(in, len, i, o, out_end);
+    else if (base64_has_ssse3())
+      base64_decode_ssse3(in, len, i, o, out_end);
+  }
+#endif
+
+  for (; i + 4 <= len; i += 4, o += 3) {
+    unsigned char a = d[(unsigned char)in[i]];
+    unsigned char b = d[(unsigned char)in[i + 1]];
+    unsigned char c = d[(unsigned char)in[i + 2]];
+    unsigned char e = d[(unsigned char)in[i + 3]];
+    if ((a | b | c | e) & 0xc0)
+      break;
+    o[0] = (a << 2) | (b >> 4);
+    o[1] = (b << 4) | (c >> 2);
+    o[2] = (c << 6) | e;
+  }
+
+  // up to three trailing characters before the end, padding or an invalid character
+  unsigned char tail[4] = {0, 0, 0, 0};
+  size_t n = 0;
+  for (; i < len && n < 4 && d[(unsigned char)in[i]] != base64_invalid; i++, n++)
+    tail[n] = d[(unsigned char)in[i]];
+  if (n > 1)
+    *o++ = (tail[0] << 2) | (tail[1] >> 4);
+  if (n > 2)
+    *o++ = (tail[1] << 4) | (tail[2] >> 2);
+
+  return o - out;
+}
+
+std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
+  std::string ret(base64_encoded_size(in_len), '\0');
+  if (in_len)
+    base64_encode(bytes_to_encode, in_len, &ret[0]);
   return ret;
-}
\ No newline at end of file
+}
+
+std::string base64_decode(std::string const& encoded_string) {
+  std::string ret(base64_decoded_size(encoded_string.data(), encoded_string.size()), '\0');
+  if (!ret.empty())
+    ret.resize(base64_decode(encoded_string.data(), encoded_string.size(), (unsigned char*)&ret[0]));
+  return ret;
+}
@@ -25,7 +25,38 @@
 
 */
 
+/*
+
+   Altered for heartbeat: the original byte at a time codec was replaced by a
+   table driven scalar codec with SSSE3 and AVX2 paths selected at runtime,
+   and functions for computing exact output sizes so callers can encode and
+   decode straight into preallocated buffers.
+
+*/
+
+#pragma once
+
 #include <string>
+#include <cstddef>
+
+// returns the exact number of characters base64_encode produces for len bytes
+inline size_t base64_encoded_size(size_t len)
+{
+	return ((len + 2) / 3) * 4;
+}
+
+// returns the number of bytes base64_decode produces for len characters of
+// well formed input, taking into account trailing '=' padding in in
+size_t base64_decoded_size(const char *in, size_t len);
+
+// encodes len bytes from in into out, which must have room for
+// base64_encoded_size(len) characters.  returns the number of characters written
+size_t base64_encode(const unsigned char *in, size_t len, char *out);
+
+// decodes up to len characters from in into out, which must have room for
+// base64_decoded_size(in,len) bytes.  decoding stops at the first '=' or
+// character outside the base64 alphabet.  returns the number of bytes written
+size_t base64_decode(const char *in, size_t len, unsigned char *out);
 
 std::string base64_encode(unsigned char const* , unsigned int len);
-std::string base64_decode(std::string const& s);
\ No newline at end of file
+std::string base64_decode(std::string const& s);
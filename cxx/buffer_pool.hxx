@@ -0,0 +1,163 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+// a per thread cache of byte buffers in power of two size classes.  a buffer
+// released on a thread is kept for the next allocation of its class on that
+// thread, so the prf, state and chunk buffers set up by every call of the
+// scheme are reused rather than taken from malloc again, and threads proving
+// at once do not contend in the allocator
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+
+class buffer_pool
+{
+public:
+	// gets a buffer of at least sz bytes
+	static unsigned char *allocate(size_t sz)
+	{
+		size_t c = size_class(sz);
+		header *h = 0;
+		if (c < classes && alive())
+		{
+			cache &k = local();
+			if (k.count[c] > 0)
+			{
+				h = k.free[c][--k.count[c]];
+			}
+		}
+		if (!h)
+		{
+			h = static_cast<header*>(std::malloc(sizeof(header) + (c < classes ? min_size << c : sz)));
+			if (!h)
+			{
+				throw std::bad_alloc();
+			}
+			h->size_class = c;
+		}
+		h->size = sz;
+		return reinterpret_cast<unsigned char*>(h + 1);
+	}
+	
+	// returns a buffer from allocate() to the cache of this thread.  buffers
+	// are wiped first since they hold keys
+	static void release(unsigned char *p)
+	{
+		if (!p)
+		{
+			return;
+		}
+		header *h = reinterpret_cast<header*>(p) - 1;
+		memset(p,0,h->size);
+		size_t c = h->size_class;
+		if (c < classes && alive())
+		{
+			cache &k = local();
+			if (k.count[c] < depth)
+			{
+				k.free[c][k.count[c]++] = h;
+				return;
+			}
+		}
+		std::free(h);
+	}
+	
+private:
+	struct header
+	{
+		size_t size;
+		size_t size_class;
+	};
+	
+	// classes are 16 bytes to 64 KiB, each holding up to depth buffers
+	static const size_t min_size = 16;
+	static const size_t classes = 13;
+	static const unsigned int depth = 16;
+	
+	struct cache
+	{
+		header *free[classes][depth];
+		unsigned int count[classes];
+		
+		cache()
+		{
+			memset(count,0,sizeof(count));
+			alive() = true;
+		}
+		
+		~cache()
+		{
+			alive() = false;
+			for (size_t c=0;c<classes;c++)
+			{
+				while (count[c] > 0)
+				{
+					std::free(free[c][--count[c]]);
+				}
+			}
+		}
+	};
+	
+	static size_t size_class(size_t sz)
+	{
+		size_t c = 0;
+		while (c < classes && (min_size << c) < sz)
+		{
+			c++;
+		}
+		return c;
+	}
+	
+	static cache &local()
+	{
+		static thread_local cache k;
+		return k;
+	}
+	
+	// whether the cache of this thread may be used.  buffers released while
+	// the thread exits, after its cache is gone, are freed directly
+	static bool &alive()
+	{
+		static thread_local bool a = true;
+		return a;
+	}
+};
+
+struct pooled_delete
+{
+	void operator()(unsigned char *p) const
+	{
+		buffer_pool::release(p);
+	}
+};
+
+typedef std::unique_ptr<unsigned char,pooled_delete> pooled_buffer;
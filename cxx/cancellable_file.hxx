@@ -0,0 +1,75 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+//wraps a seekable file so that reading stops once a flag is raised
+
+#pragma once
+
+#include "seekable_file.hxx"
+#include <atomic>
+#include <stdexcept>
+
+class cancellable_file final : public seekable_file
+{
+public:
+	cancellable_file(seekable_file &f, const std::atomic<bool> &cancelled) : _f(f), _cancelled(cancelled) 
+	{}
+	
+	// throws once cancelled.  the schemes read or skip a chunk at a time, so
+	// this is checked between chunks
+	virtual size_t read(unsigned char *buffer,size_t sz)
+	{
+		check_cancelled();
+		return _f.read(buffer,sz);
+	}
+	
+	virtual size_t skip_zeros(size_t sz)
+	{
+		check_cancelled();
+		return _f.skip_zeros(sz);
+	}
+	
+	virtual size_t seek(size_t i)
+	{
+		return _f.seek(i);
+	}
+	
+	virtual size_t bytes_remaining()
+	{
+		return _f.bytes_remaining();
+	}
+private:
+	void check_cancelled() const
+	{
+		if (_cancelled.load(std::memory_order_relaxed))
+		{
+			throw std::runtime_error("Operation cancelled.");
+		}
+	}
+	
+	seekable_file &_f;
+	const std::atomic<bool> &_cancelled;
+};
@@ -0,0 +1,235 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+//implements a seekable file read from a file descriptor
+
+#pragma once
+
+#include "seekable_file.hxx"
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+class fd_file final : public seekable_file
+{
+public:
+	// reads from a duplicate of fd starting at pos, so the caller is free to
+	// close fd.  on posix systems the offset of fd is left untouched
+	fd_file(int fd, size_t pos = 0) : _pos(pos), _find_holes(false), _extent(0), _data(0), _hole(0)
+	{
+#ifdef _WIN32
+		_fd = _dup(fd);
+#else
+		// a duplicate shares its offset with fd, which hole queries move, so
+		// holes are only looked for through a description of our own
+		_fd = reopen(fd);
+		_find_holes = _fd >= 0;
+		if (_fd < 0)
+		{
+			_fd = dup(fd);
+		}
+#endif
+		if (_fd < 0)
+		{
+			throw std::runtime_error("Unable to duplicate file descriptor.");
+		}
+	}
+	
+	// reads from the file at path through a descriptor of its own
+	explicit fd_file(const std::string &path) : _pos(0), _find_holes(false), _extent(0), _data(0), _hole(0)
+	{
+#ifdef _WIN32
+		_fd = _open(path.c_str(),_O_RDONLY | _O_BINARY);
+#else
+		_fd = open(path.c_str(),O_RDONLY | O_CLOEXEC);
+		struct stat st;
+		_find_holes = _fd >= 0 && fstat(_fd,&st) == 0 && S_ISREG(st.st_mode);
+#endif
+		if (_fd < 0)
+		{
+			throw std::runtime_error("Unable to open file: " + path);
+		}
+	}
+	
+	virtual ~fd_file()
+	{
+#ifdef _WIN32
+		_close(_fd);
+#else
+		close(_fd);
+#endif
+	}
+	
+	virtual size_t read(unsigned char *buffer,size_t sz)
+	{
+		size_t total = 0;
+		
+		// a short read means end of file to our callers, so keep reading
+		// until sz bytes or the end of the file
+		while (total < sz)
+		{
+#ifdef _WIN32
+			if (_lseeki64(_fd,_pos,SEEK_SET) < 0)
+			{
+				throw std::runtime_error("Unable to seek in file.");
+			}
+			int r = _read(_fd,buffer+total,(unsigned int)(sz-total));
+#else
+			ssize_t r = pread(_fd,buffer+total,sz-total,_pos);
+			if (r < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (r < 0)
+			{
+				throw std::runtime_error("Unable to read from file.");
+			}
+			if (r == 0)
+			{
+				break;
+			}
+			total += r;
+			_pos += r;
+		}
+		
+		return total;
+	}
+	
+	virtual size_t skip_zeros(size_t sz)
+	{
+#if !defined(_WIN32) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+		if (!_find_holes)
+		{
+			return 0;
+		}
+		
+		// the hole, from _extent to _data, and the data, from _data to _hole,
+		// found by the last query are kept, so that a dense file is queried
+		// once and a sparse file once per extent
+		if (_pos < _extent || _pos >= _hole)
+		{
+			// the queries move the offset of our own description, which
+			// reads do not use
+			off_t end = lseek(_fd,0,SEEK_END);
+			off_t data = lseek(_fd,_pos,SEEK_DATA);
+			int error = data < 0 ? errno : 0;
+			// no data past _pos, the rest of the file is a hole
+			off_t hole = data < 0 ? end : lseek(_fd,data,SEEK_HOLE);
+			
+			if (end < 0 || hole < 0 || (data < 0 && error != ENXIO))
+			{
+				// holes can not be found on this file system
+				_find_holes = false;
+				return 0;
+			}
+			
+			_extent = _pos;
+			_data = data < 0 ? end : data;
+			_hole = hole;
+		}
+		
+		size_t skipped = _pos < _data ? std::min(sz,(size_t)_data - _pos) : 0;
+		_pos += skipped;
+		return skipped;
+#else
+		return 0;
+#endif
+	}
+	
+	virtual size_t seek(size_t i)
+	{
+		_pos = i;
+		return _pos;
+	}
+	
+	virtual size_t bytes_remaining()
+	{
+		struct stat st;
+		if (fstat(_fd,&st) != 0)
+		{
+			throw std::runtime_error("Unable to get file size.");
+		}
+		size_t end = st.st_size;
+		return end > _pos ? end - _pos : 0;
+	}
+private:
+	fd_file(const fd_file &);
+	fd_file &operator=(const fd_file &);
+	
+#ifndef _WIN32
+	// opens the regular file of fd again, with an open file description and
+	// so an offset of its own.  returns -1 if it can not be
+	static int reopen(int fd)
+	{
+#ifdef __linux__
+		struct stat st;
+		if (fstat(fd,&st) != 0 || !S_ISREG(st.st_mode))
+		{
+			return -1;
+		}
+		
+		char path[32];
+		snprintf(path,sizeof(path),"/proc/self/fd/%d",fd);
+		int own = open(path,O_RDONLY | O_CLOEXEC);
+		
+		// the path is a link to the file of fd, but check it is the same file
+		struct stat own_st;
+		if (own >= 0 && (fstat(own,&own_st) != 0 || own_st.st_dev != st.st_dev || own_st.st_ino != st.st_ino))
+		{
+			close(own);
+			own = -1;
+		}
+		return own;
+#else
+		(void)fd;
+		return -1;
+#endif
+	}
+#endif
+	
+	int _fd;
+	size_t _pos;
+	
+	// whether skip_zeros looks for holes, which it only does through a
+	// descriptor with an offset of its own
+	bool _find_holes;
+	
+	// the last extents found by skip_zeros
+	size_t _extent;
+	size_t _data;
+	size_t _hole;
+};
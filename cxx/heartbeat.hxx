@@ -51,8 +51,8 @@ public:
 	// gets the tag and state into t and s for file f
 	virtual void encode(tag &t,state &s, simple_file &f) = 0;
 	
-	// gets a challenge for the beat
-	virtual void gen_challenge(challenge &c, const state &s) = 0;
+	// challenges are generated by each scheme, since the state of some,
+	// such as the merkle scheme, advances with each challenge
 	
 	// gets a proof of storage for the file
 	virtual void prove(proof &p, seekable_file &f, const challenge &c, const tag &t) = 0;
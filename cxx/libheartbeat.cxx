@@ -0,0 +1,800 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+// implements the C interface of libheartbeat over shacham_waters_private
+
+#include "libheartbeat.h"
+#include "shacham_waters_private.hxx"
+#include "fd_file.hxx"
+#include "memory_file.hxx"
+
+#include <cryptopp/filters.h>
+#include <stdexcept>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+struct hb_swizzle { shacham_waters_private value; };
+struct hb_tag { shacham_waters_private_data::tag value; };
+struct hb_state { shacham_waters_private_data::state value; };
+struct hb_challenge { shacham_waters_private_data::challenge value; };
+struct hb_token { shacham_waters_private_data::token value; };
+struct hb_proof { shacham_waters_private_data::proof value; };
+
+struct hb_file
+{
+	hb_file() : map(0), map_size(0) {}
+	
+	~hb_file()
+	{
+#ifndef _WIN32
+		if (map)
+		{
+			munmap(map,map_size);
+		}
+#endif
+	}
+	
+	std::unique_ptr<seekable_file> file;
+	void *map;
+	size_t map_size;
+};
+
+namespace
+{
+
+thread_local std::string last_error;
+
+// an error with the code to be returned for it
+class hb_exception : public std::runtime_error
+{
+public:
+	hb_exception(int code, const std::string &what) : std::runtime_error(what), _code(code) {}
+	
+	int code() const { return _code; }
+private:
+	int _code;
+};
+
+// runs f, translating any exception into an error code and message
+template <typename F>
+int guarded(F f)
+{
+	try
+	{
+		f();
+		return HB_OK;
+	}
+	catch (const hb_exception &e)
+	{
+		last_error = e.what();
+		return e.code();
+	}
+	catch (const std::exception &e)
+	{
+		last_error = e.what();
+		return HB_ERROR;
+	}
+	catch (...)
+	{
+		last_error = "Unknown error.";
+		return HB_ERROR;
+	}
+}
+
+void require(bool condition, const char *what)
+{
+	if (!condition)
+	{
+		throw hb_exception(HB_INVALID_ARGUMENT,what);
+	}
+}
+
+// reads through the caller's callbacks
+class callback_file : public seekable_file
+{
+public:
+	callback_file(const hb_file_callbacks &callbacks, void *context) : _callbacks(callbacks), _context(context), _pos(0)
+	{}
+	
+	virtual size_t read(unsigned char *buffer,size_t sz)
+	{
+		int64_t n = _callbacks.read(_context,buffer,sz);
+		if (n < 0 || (uint64_t)n > sz)
+		{
+			throw hb_exception(HB_IO_ERROR,"Read callback failed.");
+		}
+		_pos += n;
+		return n;
+	}
+	
+	virtual size_t seek(size_t i)
+	{
+		if (!_callbacks.seek)
+		{
+			throw hb_exception(HB_UNSUPPORTED,"File has no seek callback.");
+		}
+		if (_callbacks.seek(_context,i) != 0)
+		{
+			throw hb_exception(HB_IO_ERROR,"Seek callback failed.");
+		}
+		_pos = i;
+		return _pos;
+	}
+	
+	virtual size_t bytes_remaining()
+	{
+		uint64_t size;
+		if (!_callbacks.size)
+		{
+			throw hb_exception(HB_UNSUPPORTED,"File has no size callback.");
+		}
+		if (_callbacks.size(_context,&size) != 0)
+		{
+			throw hb_exception(HB_IO_ERROR,"Size callback failed.");
+		}
+		return size > _pos ? size - _pos : 0;
+	}
+private:
+	hb_file_callbacks _callbacks;
+	void *_context;
+	uint64_t _pos;
+};
+
+// gives the checkpoints of an encode to the caller's callback
+class callback_checkpoint_sink : public shacham_waters_private::checkpoint_sink
+{
+public:
+	callback_checkpoint_sink(hb_checkpoint_fn fn, void *context) : _fn(fn), _context(context)
+	{}
+	
+	virtual void checkpoint(const shacham_waters_private::tag &segment, const shacham_waters_private::state &s)
+	{
+		hb_tag t;
+		t.value = segment;
+		hb_state st;
+		st.value = s;
+		if (_fn(_context,&t,&st) != 0)
+		{
+			throw hb_exception(HB_IO_ERROR,"Checkpoint callback failed.");
+		}
+	}
+private:
+	hb_checkpoint_fn _fn;
+	void *_context;
+};
+
+template <typename T>
+int serialize_object(const T *obj, unsigned char **out, size_t *size)
+{
+	return guarded([&]()
+	{
+		require(obj && out && size,"Object, output and size must not be null.");
+		
+		std::string bin;
+		CryptoPP::StringSink sink(bin);
+		obj->value.serialize(sink);
+		
+		std::unique_ptr<unsigned char[]> buffer(new unsigned char[bin.size() + 1]);
+		memcpy(buffer.get(),bin.data(),bin.size());
+		*size = bin.size();
+		*out = buffer.release();
+	});
+}
+
+template <typename T>
+int deserialize_object(const unsigned char *data, size_t size, T **out)
+{
+	return guarded([&]()
+	{
+		require(data && out,"Data and output must not be null.");
+		
+		std::unique_ptr<T> obj(new T());
+		CryptoPP::StringSource ss(data,size,true);
+		obj->value.deserialize(ss);
+		*out = obj.release();
+	});
+}
+
+// the scheme methods do not modify the scheme but are not marked const
+shacham_waters_private &scheme(const hb_swizzle *beat)
+{
+	return const_cast<shacham_waters_private&>(beat->value);
+}
+
+// calls op with the file as its concrete type, when it is one of ours, so
+// that the scheme reads it with direct calls instead of virtual ones
+template <typename Op>
+void with_file(hb_file *file, Op op)
+{
+	if (memory_file *m = dynamic_cast<memory_file*>(file->file.get()))
+	{
+		op(*m);
+	}
+	else if (fd_file *f = dynamic_cast<fd_file*>(file->file.get()))
+	{
+		op(*f);
+	}
+	else
+	{
+		op(*file->file);
+	}
+}
+
+struct encode_op
+{
+	shacham_waters_private &beat;
+	hb_tag &t;
+	hb_state &s;
+	
+	template <typename File>
+	void operator()(File &f) const { beat.encode(t.value,s.value,f); }
+};
+
+struct prove_op
+{
+	shacham_waters_private &beat;
+	hb_proof &p;
+	const hb_challenge &c;
+	const hb_tag &t;
+	
+	template <typename File>
+	void operator()(File &f) const { beat.prove(p.value,f,c.value,t.value); }
+};
+
+}
+
+int hb_api_version(void)
+{
+	return HB_API_VERSION;
+}
+
+const char *hb_last_error(void)
+{
+	return last_error.c_str();
+}
+
+int hb_swizzle_new(double check_fraction, unsigned int sectors, unsigned int prime_size_bytes, hb_swizzle **out)
+{
+	return guarded([&]()
+	{
+		require(out,"Output must not be null.");
+		require(check_fraction > 0 && check_fraction <= 1,"Check fraction must be in (0,1].");
+		require(sectors > 0 && prime_size_bytes > 0,"Sectors and prime size must be positive.");
+		
+		std::unique_ptr<hb_swizzle> beat(new hb_swizzle());
+		beat->value.init(check_fraction,sectors,prime_size_bytes);
+		*out = beat.release();
+	});
+}
+
+int hb_swizzle_new_with_parameters(const char *parameters, double check_fraction, unsigned int sectors, hb_swizzle **out)
+{
+	return guarded([&]()
+	{
+		require(parameters && out,"Parameters and output must not be null.");
+		require(check_fraction > 0 && check_fraction <= 1,"Check fraction must be in (0,1].");
+		
+		const shacham_waters_private::parameter_set *params = shacham_waters_private::find_parameter_set(parameters);
+		require(params,"Unknown parameter set.");
+		
+		std::unique_ptr<hb_swizzle> beat(new hb_swizzle());
+		beat->value.init(*params,check_fraction,sectors);
+		*out = beat.release();
+	});
+}
+
+int hb_swizzle_get_public(const hb_swizzle *beat, hb_swizzle **out)
+{
+	return guarded([&]()
+	{
+		require(beat && out,"Scheme and output must not be null.");
+		
+		std::unique_ptr<hb_swizzle> pub(new hb_swizzle());
+		beat->value.get_public(pub->value);
+		*out = pub.release();
+	});
+}
+
+int hb_swizzle_rotate_alpha(hb_swizzle *beat)
+{
+	return guarded([&]()
+	{
+		require(beat,"Scheme must not be null.");
+		
+		beat->value.rotate_alpha();
+	});
+}
+
+int hb_swizzle_alpha_epoch(const hb_swizzle *beat, uint32_t *epoch)
+{
+	return guarded([&]()
+	{
+		require(beat && epoch,"Scheme and output must not be null.");
+		
+		*epoch = beat->value.alpha_epoch();
+	});
+}
+
+void hb_swizzle_free(hb_swizzle *beat)
+{
+	delete beat;
+}
+
+int hb_file_from_fd(int fd, uint64_t offset, hb_file **out)
+{
+	return guarded([&]()
+	{
+		require(fd >= 0 && out,"File descriptor must be valid and output must not be null.");
+		
+		std::unique_ptr<hb_file> file(new hb_file());
+		file->file.reset(new fd_file(fd,offset));
+		*out = file.release();
+	});
+}
+
+int hb_file_map(const char *path, hb_file **out)
+{
+	return guarded([&]()
+	{
+		require(path && out,"Path and output must not be null.");
+		
+#ifdef _WIN32
+		throw hb_exception(HB_UNSUPPORTED,"Mapping files is not supported on this platform.");
+#else
+		int fd = open(path,O_RDONLY);
+		if (fd < 0)
+		{
+			throw hb_exception(HB_IO_ERROR,std::string("Unable to open file: ") + path);
+		}
+		
+		struct stat st;
+		if (fstat(fd,&st) != 0)
+		{
+			close(fd);
+			throw hb_exception(HB_IO_ERROR,std::string("Unable to get size of file: ") + path);
+		}
+		
+		std::unique_ptr<hb_file> file(new hb_file());
+		file->map_size = st.st_size;
+		
+		// empty files cannot be mapped
+		if (file->map_size > 0)
+		{
+			void *map = mmap(0,file->map_size,PROT_READ,MAP_SHARED,fd,0);
+			if (map == MAP_FAILED)
+			{
+				close(fd);
+				throw hb_exception(HB_IO_ERROR,std::string("Unable to map file: ") + path);
+			}
+			file->map = map;
+			// chunks are read in order when encoding
+			madvise(map,file->map_size,MADV_SEQUENTIAL);
+		}
+		close(fd);
+		
+		file->file.reset(new memory_file((const unsigned char*)file->map,file->map_size));
+		*out = file.release();
+#endif
+	});
+}
+
+int hb_file_from_memory(const void *data, size_t size, hb_file **out)
+{
+	return guarded([&]()
+	{
+		require((data || size == 0) && out,"Data and output must not be null.");
+		
+		std::unique_ptr<hb_file> file(new hb_file());
+		file->file.reset(new memory_file((const unsigned char*)data,size));
+		*out = file.release();
+	});
+}
+
+int hb_file_from_callbacks(const hb_file_callbacks *callbacks, void *context, hb_file **out)
+{
+	return guarded([&]()
+	{
+		require(callbacks && callbacks->read && out,"Callbacks, the read callback and output must not be null.");
+		
+		std::unique_ptr<hb_file> file(new hb_file());
+		file->file.reset(new callback_file(*callbacks,context));
+		*out = file.release();
+	});
+}
+
+void hb_file_free(hb_file *file)
+{
+	delete file;
+}
+
+int hb_encode(const hb_swizzle *beat, hb_file *file, hb_tag **tag, hb_state **state)
+{
+	return guarded([&]()
+	{
+		require(beat && file && tag && state,"Arguments must not be null.");
+		require(!beat->value.is_public(),"Encoding requires the private scheme.");
+		
+		std::unique_ptr<hb_tag> t(new hb_tag());
+		std::unique_ptr<hb_state> s(new hb_state());
+		encode_op op = { scheme(beat), *t, *s };
+		with_file(file,op);
+		*tag = t.release();
+		*state = s.release();
+	});
+}
+
+int hb_cache_key(const hb_swizzle *beat, hb_file *file, unsigned char key[HB_CACHE_KEY_SIZE])
+{
+	static_assert(HB_CACHE_KEY_SIZE == shacham_waters_private::cache_key_size,"Cache key size mismatch.");
+	
+	return guarded([&]()
+	{
+		require(beat && file && key,"Arguments must not be null.");
+		require(!beat->value.is_public(),"Encoding requires the private scheme.");
+		
+		scheme(beat).cache_key(key,*file->file);
+	});
+}
+
+int hb_gen_state(const hb_swizzle *beat, uint64_t size, hb_state **out)
+{
+	return guarded([&]()
+	{
+		require(beat && out,"Arguments must not be null.");
+		require(!beat->value.is_public(),"Encoding requires the private scheme.");
+		
+		std::unique_ptr<hb_state> s(new hb_state());
+		scheme(beat).gen_state(s->value,(size_t)size);
+		*out = s.release();
+	});
+}
+
+int hb_encode_range(const hb_swizzle *beat, hb_file *file, const hb_state *state, uint32_t first, uint32_t count, hb_tag **out)
+{
+	return guarded([&]()
+	{
+		require(beat && file && state && out,"Arguments must not be null.");
+		
+		std::unique_ptr<hb_tag> t(new hb_tag());
+		scheme(beat).encode_range(t->value,state->value,*file->file,first,count);
+		*out = t.release();
+	});
+}
+
+int hb_merge_tags(const hb_tag *const *segments, size_t count, hb_tag **out)
+{
+	return guarded([&]()
+	{
+		require((segments || count == 0) && out,"Arguments must not be null.");
+		
+		std::vector<const shacham_waters_private::tag*> s(count);
+		for (size_t i=0;i<count;i++)
+		{
+			require(segments[i],"Arguments must not be null.");
+			s[i] = &segments[i]->value;
+		}
+		
+		std::unique_ptr<hb_tag> t(new hb_tag());
+		shacham_waters_private::merge_tags(t->value,s);
+		*out = t.release();
+	});
+}
+
+int hb_encode_checkpointed(const hb_swizzle *beat, hb_file *file, uint32_t interval, hb_checkpoint_fn checkpoint, void *context, hb_tag **tag, hb_state **state)
+{
+	return guarded([&]()
+	{
+		require(beat && file && checkpoint && tag && state,"Arguments must not be null.");
+		require(!beat->value.is_public(),"Encoding requires the private scheme.");
+		
+		callback_checkpoint_sink sink(checkpoint,context);
+		std::unique_ptr<hb_tag> t(new hb_tag());
+		std::unique_ptr<hb_state> s(new hb_state());
+		scheme(beat).encode_checkpointed(t->value,s->value,*file->file,sink,interval);
+		*tag = t.release();
+		*state = s.release();
+	});
+}
+
+int hb_resume_encode(const hb_swizzle *beat, hb_file *file, hb_tag *tag, hb_state *state, uint32_t interval, hb_checkpoint_fn checkpoint, void *context)
+{
+	return guarded([&]()
+	{
+		require(beat && file && tag && state,"Arguments must not be null.");
+		
+		size_t offset = scheme(beat).resume_offset(tag->value);
+		file->file->seek(0);
+		if (file->file->bytes_remaining() < offset)
+		{
+			throw hb_exception(HB_IO_ERROR,"File is shorter than the checkpoint.");
+		}
+		file->file->seek(offset);
+		
+		std::unique_ptr<callback_checkpoint_sink> sink;
+		if (checkpoint)
+		{
+			sink.reset(new callback_checkpoint_sink(checkpoint,context));
+		}
+		scheme(beat).resume_encode(tag->value,state->value,*file->file,sink.get(),interval);
+	});
+}
+
+int hb_encode_append(const hb_swizzle *beat, hb_file *file, hb_tag *tag, hb_state *state)
+{
+	return guarded([&]()
+	{
+		require(beat && file && tag && state,"Arguments must not be null.");
+		
+		size_t offset = scheme(beat).append_offset(tag->value);
+		file->file->seek(0);
+		if (file->file->bytes_remaining() < offset)
+		{
+			throw hb_exception(HB_IO_ERROR,"File is shorter than when it was encoded.");
+		}
+		file->file->seek(offset);
+		
+		scheme(beat).encode_append(tag->value,state->value,*file->file);
+	});
+}
+
+int hb_update_chunks(const hb_swizzle *beat, hb_file *file, hb_tag *tag, hb_state *state, const uint32_t *ranges, size_t count)
+{
+	return guarded([&]()
+	{
+		require(beat && file && tag && state && (ranges || count == 0),"Arguments must not be null.");
+		
+		std::vector<std::pair<unsigned int,unsigned int> > r(count);
+		for (size_t i=0;i<count;i++)
+		{
+			r[i] = std::make_pair(ranges[2*i],ranges[2*i+1]);
+		}
+		scheme(beat).update_chunks(tag->value,state->value,*file->file,r);
+	});
+}
+
+int hb_update_serialized_chunks(const hb_swizzle *beat, hb_file *file, unsigned char *data, size_t size, hb_state *state, const uint32_t *ranges, size_t count)
+{
+	return guarded([&]()
+	{
+		require(beat && file && data && state && (ranges || count == 0),"Arguments must not be null.");
+		
+		std::vector<std::pair<unsigned int,unsigned int> > r(count);
+		for (size_t i=0;i<count;i++)
+		{
+			r[i] = std::make_pair(ranges[2*i],ranges[2*i+1]);
+		}
+		scheme(beat).update_serialized_chunks(data,size,state->value,*file->file,r);
+	});
+}
+
+int hb_gen_challenge(const hb_swizzle *beat, const hb_state *state, hb_challenge **out)
+{
+	return hb_gen_challenge_with_flags(beat,state,0,out);
+}
+
+int hb_gen_challenge_with_flags(const hb_swizzle *beat, const hb_state *state, unsigned int flags, hb_challenge **out)
+{
+	return guarded([&]()
+	{
+		require(beat && state && out,"Arguments must not be null.");
+		require((flags & ~HB_CHALLENGE_DISTINCT) == 0,"Unknown challenge flags.");
+		
+		std::unique_ptr<hb_challenge> c(new hb_challenge());
+		scheme(beat).gen_challenge(c->value,state->value,(flags & HB_CHALLENGE_DISTINCT) != 0);
+		*out = c.release();
+	});
+}
+
+int hb_gen_token(const hb_swizzle *beat, const hb_challenge *challenge, const hb_state *state, hb_token **out)
+{
+	return guarded([&]()
+	{
+		require(beat && challenge && state && out,"Arguments must not be null.");
+		
+		std::unique_ptr<hb_token> k(new hb_token());
+		scheme(beat).gen_token(k->value,challenge->value,state->value);
+		*out = k.release();
+	});
+}
+
+int hb_prove(const hb_swizzle *beat, hb_file *file, const hb_challenge *challenge, const hb_tag *tag, hb_proof **out)
+{
+	return guarded([&]()
+	{
+		require(beat && file && challenge && tag && out,"Arguments must not be null.");
+		
+		std::unique_ptr<hb_proof> p(new hb_proof());
+		prove_op op = { scheme(beat), *p, *challenge, *tag };
+		with_file(file,op);
+		*out = p.release();
+	});
+}
+
+int hb_prove_partial(const hb_swizzle *beat, hb_file *file, const hb_challenge *challenge, const hb_tag *tag, uint32_t first, uint32_t last, hb_proof **out)
+{
+	return guarded([&]()
+	{
+		require(beat && file && challenge && tag && out,"Arguments must not be null.");
+		
+		std::unique_ptr<hb_proof> p(new hb_proof());
+		scheme(beat).prove_partial(p->value,*file->file,challenge->value,tag->value,first,last);
+		*out = p.release();
+	});
+}
+
+int hb_combine_proofs(const hb_swizzle *beat, const hb_proof *const *partials, size_t count, hb_proof **out)
+{
+	return guarded([&]()
+	{
+		require(beat && (partials || count == 0) && out,"Arguments must not be null.");
+		
+		std::vector<const shacham_waters_private::proof*> v(count);
+		for (size_t i=0;i<count;i++)
+		{
+			require(partials[i],"Arguments must not be null.");
+			v[i] = &partials[i]->value;
+		}
+		
+		std::unique_ptr<hb_proof> p(new hb_proof());
+		scheme(beat).combine_proofs(p->value,v);
+		*out = p.release();
+	});
+}
+
+int hb_verify(const hb_swizzle *beat, const hb_proof *proof, const hb_challenge *challenge, const hb_state *state, int *valid)
+{
+	return guarded([&]()
+	{
+		require(beat && proof && challenge && state && valid,"Arguments must not be null.");
+		
+		*valid = scheme(beat).verify(proof->value,challenge->value,state->value) ? 1 : 0;
+	});
+}
+
+int hb_verify_with_token(const hb_swizzle *beat, const hb_proof *proof, const hb_challenge *challenge, const hb_token *token, const hb_state *state, int *valid)
+{
+	return guarded([&]()
+	{
+		require(beat && proof && challenge && token && state && valid,"Arguments must not be null.");
+		
+		*valid = scheme(beat).verify_token(proof->value,challenge->value,token->value,state->value) ? 1 : 0;
+	});
+}
+
+int hb_verify_batch(const hb_swizzle *beat, size_t count, const hb_proof *const *proofs, const hb_challenge *const *challenges, const hb_state *const *states, const hb_token *const *tokens, int *valid)
+{
+	return guarded([&]()
+	{
+		require(beat && (count == 0 || (proofs && challenges && states && valid)),"Arguments must not be null.");
+		
+		std::vector<const shacham_waters_private_data::proof*> p(count);
+		std::vector<const shacham_waters_private_data::challenge*> c(count);
+		std::vector<const shacham_waters_private_data::state*> s(count);
+		std::vector<const shacham_waters_private_data::token*> k;
+		
+		for (size_t i=0;i<count;i++)
+		{
+			require(proofs[i] && challenges[i] && states[i],"Proofs, challenges and states must not be null.");
+			p[i] = &proofs[i]->value;
+			c[i] = &challenges[i]->value;
+			s[i] = &states[i]->value;
+		}
+		if (tokens)
+		{
+			k.resize(count);
+			for (size_t i=0;i<count;i++)
+			{
+				k[i] = tokens[i] ? &tokens[i]->value : 0;
+			}
+		}
+		
+		std::vector<unsigned char> results;
+		scheme(beat).verify_batch(results,p,c,s,k);
+		
+		for (size_t i=0;i<count;i++)
+		{
+			valid[i] = results[i] ? 1 : 0;
+		}
+	});
+}
+
+int hb_prove_aggregate(const hb_swizzle *beat, size_t count, hb_file *const *files, const hb_challenge *const *challenges, const hb_tag *const *tags, hb_proof **out)
+{
+	return guarded([&]()
+	{
+		require(beat && files && challenges && tags && out,"Arguments must not be null.");
+		
+		std::vector<seekable_file*> f(count);
+		std::vector<const shacham_waters_private_data::challenge*> c(count);
+		std::vector<const shacham_waters_private_data::tag*> t(count);
+		
+		for (size_t i=0;i<count;i++)
+		{
+			require(files[i] && challenges[i] && tags[i],"Files, challenges and tags must not be null.");
+			f[i] = files[i]->file.get();
+			c[i] = &challenges[i]->value;
+			t[i] = &tags[i]->value;
+		}
+		
+		std::unique_ptr<hb_proof> p(new hb_proof());
+		scheme(beat).prove_aggregate(p->value,f,c,t);
+		*out = p.release();
+	});
+}
+
+int hb_verify_aggregate(const hb_swizzle *beat, const hb_proof *proof, size_t count, const hb_challenge *const *challenges, const hb_state *const *states, int *valid)
+{
+	return guarded([&]()
+	{
+		require(beat && proof && challenges && states && valid,"Arguments must not be null.");
+		
+		std::vector<const shacham_waters_private_data::challenge*> c(count);
+		std::vector<const shacham_waters_private_data::state*> s(count);
+		
+		for (size_t i=0;i<count;i++)
+		{
+			require(challenges[i] && states[i],"Challenges and states must not be null.");
+			c[i] = &challenges[i]->value;
+			s[i] = &states[i]->value;
+		}
+		
+		*valid = scheme(beat).verify_aggregate(proof->value,c,s) ? 1 : 0;
+	});
+}
+
+void hb_buffer_free(unsigned char *buffer)
+{
+	delete[] buffer;
+}
+
+int hb_swizzle_serialize(const hb_swizzle *beat, unsigned char **out, size_t *size) { return serialize_object(beat,out,size); }
+int hb_swizzle_deserialize(const unsigned char *data, size_t size, hb_swizzle **out) { return deserialize_object(data,size,out); }
+
+int hb_tag_serialize(const hb_tag *tag, unsigned char **out, size_t *size) { return serialize_object(tag,out,size); }
+int hb_tag_deserialize(const unsigned char *data, size_t size, hb_tag **out) { return deserialize_object(data,size,out); }
+void hb_tag_free(hb_tag *tag) { delete tag; }
+
+int hb_state_serialize(const hb_state *state, unsigned char **out, size_t *size) { return serialize_object(state,out,size); }
+int hb_state_deserialize(const unsigned char *data, size_t size, hb_state **out) { return deserialize_object(data,size,out); }
+void hb_state_free(hb_state *state) { delete state; }
+
+int hb_challenge_serialize(const hb_challenge *challenge, unsigned char **out, size_t *size) { return serialize_object(challenge,out,size); }
+int hb_challenge_deserialize(const unsigned char *data, size_t size, hb_challenge **out) { return deserialize_object(data,size,out); }
+void hb_challenge_free(hb_challenge *challenge) { delete challenge; }
+
+int hb_token_serialize(const hb_token *token, unsigned char **out, size_t *size) { return serialize_object(token,out,size); }
+int hb_token_deserialize(const unsigned char *data, size_t size, hb_token **out) { return deserialize_object(data,size,out); }
+void hb_token_free(hb_token *token) { delete token; }
+
+int hb_proof_serialize(const hb_proof *proof, unsigned char **out, size_t *size) { return serialize_object(proof,out,size); }
+int hb_proof_deserialize(const unsigned char *data, size_t size, hb_proof **out) { return deserialize_object(data,size,out); }
+void hb_proof_free(hb_proof *proof) { delete proof; }
@@ -0,0 +1,288 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/*
+
+Stable C interface to the heartbeat, built as libheartbeat.
+
+All functions returning int return HB_OK on success or a negative error code,
+in which case hb_last_error() describes the failure.  Objects returned through
+out pointers are owned by the caller and released with the matching _free
+function.  hb_swizzle_rotate_alpha, hb_encode_append, hb_update_chunks,
+hb_update_serialized_chunks and hb_resume_encode modify the objects passed to
+them in place, which must not be used by any other thread meanwhile.  Other
+functions only read their arguments, which may then be shared between threads.
+A file must only be used by one thread at a time.
+
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(HB_BUILDING_LIBRARY)
+#define HB_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define HB_API __declspec(dllimport)
+#elif defined(__GNUC__)
+#define HB_API __attribute__((visibility("default")))
+#else
+#define HB_API
+#endif
+
+/* incremented whenever the interface changes incompatibly */
+#define HB_API_VERSION 1
+
+#define HB_OK 0
+#define HB_ERROR -1
+#define HB_INVALID_ARGUMENT -2
+#define HB_IO_ERROR -3
+#define HB_UNSUPPORTED -4
+
+typedef struct hb_swizzle hb_swizzle;
+typedef struct hb_tag hb_tag;
+typedef struct hb_state hb_state;
+typedef struct hb_challenge hb_challenge;
+typedef struct hb_token hb_token;
+typedef struct hb_proof hb_proof;
+typedef struct hb_file hb_file;
+
+/* returns HB_API_VERSION of the library */
+HB_API int hb_api_version(void);
+
+/* returns a description of the last error on the calling thread */
+HB_API const char *hb_last_error(void);
+
+/* generates a new private scheme with fresh keys.  check_fraction is the
+   fraction of the file checked by each challenge, sectors the number of
+   sectors per chunk and prime_size_bytes the size of the prime modulus.  the
+   standard prime of that size is used if there is one, otherwise a prime is
+   generated, which is slow */
+HB_API int hb_swizzle_new(double check_fraction, unsigned int sectors, unsigned int prime_size_bytes, hb_swizzle **out);
+
+/* generates a new private scheme with fresh keys for the standard parameter
+   set named parameters, one of "modp1024", "modp1536", "modp2048", or the
+   faster special form primes "p25519" and "p521".
+   sectors of 0 uses the sector count of the parameter set */
+HB_API int hb_swizzle_new_with_parameters(const char *parameters, double check_fraction, unsigned int sectors, hb_swizzle **out);
+
+/* gets the public version of the scheme, stripped of the keys, for sending to
+   the storage server */
+HB_API int hb_swizzle_get_public(const hb_swizzle *beat, hb_swizzle **out);
+
+/* moves the scheme to its next alpha epoch, so that files encoded from now on
+   get secret coefficients unrelated to those of earlier files.  the scheme
+   must be serialized again to keep the epoch */
+HB_API int hb_swizzle_rotate_alpha(hb_swizzle *beat);
+
+/* gets the alpha epoch of the scheme into epoch */
+HB_API int hb_swizzle_alpha_epoch(const hb_swizzle *beat, uint32_t *epoch);
+
+HB_API void hb_swizzle_free(hb_swizzle *beat);
+
+/* files.  encoding only reads sequentially, while proving, encoding a range,
+   appending, resuming and updating also seek */
+
+/* reads from a duplicate of fd starting at offset, leaving the offset of fd
+   unchanged */
+HB_API int hb_file_from_fd(int fd, uint64_t offset, hb_file **out);
+
+/* maps the file at path into memory for reading */
+HB_API int hb_file_map(const char *path, hb_file **out);
+
+/* reads from size bytes at data, which must outlive the file */
+HB_API int hb_file_from_memory(const void *data, size_t size, hb_file **out);
+
+typedef struct hb_file_callbacks
+{
+	/* reads up to size bytes into buffer, returning the number of bytes read,
+	   which is less than size only at the end of the file, or -1 on error */
+	int64_t (*read)(void *context, unsigned char *buffer, size_t size);
+	/* seeks to offset from the start of the file, returning 0 on success.
+	   may be NULL if the file is only passed to hb_encode,
+	   hb_encode_checkpointed or hb_cache_key, but is needed to prove,
+	   append, resume or update */
+	int (*seek)(void *context, uint64_t offset);
+	/* stores the total size of the file in size, returning 0 on success.
+	   may be NULL if the file is only passed to hb_encode,
+	   hb_encode_checkpointed or hb_cache_key, but is needed to prove,
+	   append, resume or update */
+	int (*size)(void *context, uint64_t *size);
+} hb_file_callbacks;
+
+/* reads through callbacks, which are passed context */
+HB_API int hb_file_from_callbacks(const hb_file_callbacks *callbacks, void *context, hb_file **out);
+
+HB_API void hb_file_free(hb_file *file);
+
+/* the scheme */
+
+/* gets the tag, for the storage server, and the encrypted state, for the
+   client, of file */
+HB_API int hb_encode(const hb_swizzle *beat, hb_file *file, hb_tag **tag, hb_state **state);
+
+/* the size of the keys from hb_cache_key */
+#define HB_CACHE_KEY_SIZE 32
+
+/* gets into key the key under which the tag and state of file can be cached,
+   so that identical content is encoded once.  the key is a mac, under the
+   keys of beat, of its parameters and the contents of file, which is read
+   to its end */
+HB_API int hb_cache_key(const hb_swizzle *beat, hb_file *file, unsigned char key[HB_CACHE_KEY_SIZE]);
+
+/* gets a state, with new keys, for a file of size bytes which is tagged in
+   parts with hb_encode_range */
+HB_API int hb_gen_state(const hb_swizzle *beat, uint64_t size, hb_state **out);
+
+/* gets the tag segment of count chunks of file from chunk first, for the
+   file of state from hb_gen_state.  the segments of all of the chunks,
+   merged in order, are the tag hb_encode would give with the keys of state */
+HB_API int hb_encode_range(const hb_swizzle *beat, hb_file *file, const hb_state *state, uint32_t first, uint32_t count, hb_tag **out);
+
+/* concatenates count tag segments, in chunk order, into one tag */
+HB_API int hb_merge_tags(const hb_tag *const *segments, size_t count, hb_tag **out);
+
+/* receives a checkpoint of hb_encode_checkpointed: segment holds the tag of
+   the chunks tagged since the last checkpoint, and state the encrypted state
+   of all of the chunks tagged so far.  both are only valid during the call.
+   returns 0 on success, otherwise the encode stops */
+typedef int (*hb_checkpoint_fn)(void *context, const hb_tag *segment, const hb_state *state);
+
+/* like hb_encode, but calls checkpoint after every interval chunks, so an
+   interrupted encode can be continued with hb_resume_encode */
+HB_API int hb_encode_checkpointed(const hb_swizzle *beat, hb_file *file, uint32_t interval, hb_checkpoint_fn checkpoint, void *context, hb_tag **tag, hb_state **state);
+
+/* continues, in place, an encode from its last checkpoint, where tag is the
+   segments of the checkpoints merged with hb_merge_tags and state is the
+   state of the last checkpoint.  only the chunks after the checkpoint are
+   read.  checkpoint may be NULL, otherwise further checkpoints are given to
+   it */
+HB_API int hb_resume_encode(const hb_swizzle *beat, hb_file *file, hb_tag *tag, hb_state *state, uint32_t interval, hb_checkpoint_fn checkpoint, void *context);
+
+/* updates tag and state, in place, for file after data has been appended to
+   it.  only the last chunk of the file as encoded and the appended data are
+   read */
+HB_API int hb_encode_append(const hb_swizzle *beat, hb_file *file, hb_tag *tag, hb_state *state);
+
+/* updates tag and state, in place, for file after some of its chunks were
+   rewritten without changing its size.  ranges holds count pairs of the first
+   chunk and one past the last chunk rewritten, and only those chunks are
+   read.  the rewritten chunks are tagged under a new version of the prf of
+   the state, so the updated state must replace the old one */
+HB_API int hb_update_chunks(const hb_swizzle *beat, hb_file *file, hb_tag *tag, hb_state *state, const uint32_t *ranges, size_t count);
+
+/* like hb_update_chunks, but patches the size bytes at data holding a tag
+   serialized by hb_tag_serialize, such as a memory mapped tag file */
+HB_API int hb_update_serialized_chunks(const hb_swizzle *beat, hb_file *file, unsigned char *data, size_t size, hb_state *state, const uint32_t *ranges, size_t count);
+
+/* gets a challenge for the file described by state */
+HB_API int hb_gen_challenge(const hb_swizzle *beat, const hb_state *state, hb_challenge **out);
+
+/* flags for hb_gen_challenge_with_flags */
+
+/* checks different chunks, selected by a keyed permutation, instead of
+   independently drawn chunks which may repeat */
+#define HB_CHALLENGE_DISTINCT 0x01
+
+/* gets a challenge for the file described by state, with flags a combination
+   of the HB_CHALLENGE_ flags */
+HB_API int hb_gen_challenge_with_flags(const hb_swizzle *beat, const hb_state *state, unsigned int flags, hb_challenge **out);
+
+/* gets the verification token of challenge, the part of verification which
+   does not depend on the proof, so it can be computed ahead of time.  the
+   token is kept by the client */
+HB_API int hb_gen_token(const hb_swizzle *beat, const hb_challenge *challenge, const hb_state *state, hb_token **out);
+
+/* gets a proof of storage of file for challenge */
+HB_API int hb_prove(const hb_swizzle *beat, hb_file *file, const hb_challenge *challenge, const hb_tag *tag, hb_proof **out);
+
+/* gets the part of a proof of storage for the challenged chunks from first
+   up to last, for a shard file holding the file from chunk first on */
+HB_API int hb_prove_partial(const hb_swizzle *beat, hb_file *file, const hb_challenge *challenge, const hb_tag *tag, uint32_t first, uint32_t last, hb_proof **out);
+
+/* adds count partial proofs, for chunk ranges which do not overlap, into the
+   proof of the file */
+HB_API int hb_combine_proofs(const hb_swizzle *beat, const hb_proof *const *partials, size_t count, hb_proof **out);
+
+/* sets valid to 1 if proof is a valid response to challenge, otherwise 0 */
+HB_API int hb_verify(const hb_swizzle *beat, const hb_proof *proof, const hb_challenge *challenge, const hb_state *state, int *valid);
+
+/* like hb_verify, with the token of challenge, which leaves only the work
+   that depends on the proof.  valid is 0 if token is not that of challenge */
+HB_API int hb_verify_with_token(const hb_swizzle *beat, const hb_proof *proof, const hb_challenge *challenge, const hb_token *token, const hb_state *state, int *valid);
+
+/* verifies count proofs together by checking a random linear combination of
+   them, bisecting to find the invalid ones if it fails.  valid[i] is set to 1
+   if proofs[i] is valid, otherwise 0.  each distinct state pointer is
+   decrypted once.  tokens may be NULL, as may any of its elements */
+HB_API int hb_verify_batch(const hb_swizzle *beat, size_t count, const hb_proof *const *proofs, const hb_challenge *const *challenges, const hb_state *const *states, const hb_token *const *tokens, int *valid);
+
+/* gets a single proof of storage of count files, each with its own challenge
+   and tag, the size of the proof of one file */
+HB_API int hb_prove_aggregate(const hb_swizzle *beat, size_t count, hb_file *const *files, const hb_challenge *const *challenges, const hb_tag *const *tags, hb_proof **out);
+
+/* sets valid to 1 if proof is a valid aggregated proof of the files with
+   challenges and states, in the order they were proved, otherwise 0.  the
+   files must have been encoded with the keys of beat */
+HB_API int hb_verify_aggregate(const hb_swizzle *beat, const hb_proof *proof, size_t count, const hb_challenge *const *challenges, const hb_state *const *states, int *valid);
+
+/* serialization.  the serialized form is the same as that of the python
+   objects' __getstate__().  buffers returned by _serialize functions are
+   released with hb_buffer_free */
+
+HB_API void hb_buffer_free(unsigned char *buffer);
+
+HB_API int hb_swizzle_serialize(const hb_swizzle *beat, unsigned char **out, size_t *size);
+HB_API int hb_swizzle_deserialize(const unsigned char *data, size_t size, hb_swizzle **out);
+
+HB_API int hb_tag_serialize(const hb_tag *tag, unsigned char **out, size_t *size);
+HB_API int hb_tag_deserialize(const unsigned char *data, size_t size, hb_tag **out);
+HB_API void hb_tag_free(hb_tag *tag);
+
+HB_API int hb_state_serialize(const hb_state *state, unsigned char **out, size_t *size);
+HB_API int hb_state_deserialize(const unsigned char *data, size_t size, hb_state **out);
+HB_API void hb_state_free(hb_state *state);
+
+HB_API int hb_challenge_serialize(const hb_challenge *challenge, unsigned char **out, size_t *size);
+HB_API int hb_challenge_deserialize(const unsigned char *data, size_t size, hb_challenge **out);
+HB_API void hb_challenge_free(hb_challenge *challenge);
+
+HB_API int hb_token_serialize(const hb_token *token, unsigned char **out, size_t *size);
+HB_API int hb_token_deserialize(const unsigned char *data, size_t size, hb_token **out);
+HB_API void hb_token_free(hb_token *token);
+
+HB_API int hb_proof_serialize(const hb_proof *proof, unsigned char **out, size_t *size);
+HB_API int hb_proof_deserialize(const unsigned char *data, size_t size, hb_proof **out);
+HB_API void hb_proof_free(hb_proof *proof);
+
+#ifdef __cplusplus
+}
+#endif
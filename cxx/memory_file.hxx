@@ -0,0 +1,71 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+//implements a seekable file over a block of memory, which is not copied
+
+#pragma once
+
+#include "seekable_file.hxx"
+#include <cstring>
+
+class memory_file final : public seekable_file
+{
+public:
+	memory_file(const unsigned char *data, size_t sz) : _data(data), _sz(sz), _pos(0)
+	{}
+	
+	virtual size_t read(unsigned char *buffer,size_t sz)
+	{
+		size_t n = bytes_remaining();
+		if (n == 0)
+		{
+			return 0;
+		}
+		if (sz < n)
+		{
+			n = sz;
+		}
+		memcpy(buffer,_data + _pos,n);
+		_pos += n;
+		return n;
+	}
+	
+	// like a file, seeking past the end succeeds and reads nothing
+	virtual size_t seek(size_t i)
+	{
+		_pos = i;
+		return _pos;
+	}
+	
+	virtual size_t bytes_remaining()
+	{
+		return _pos < _sz ? _sz - _pos : 0;
+	}
+private:
+	const unsigned char *_data;
+	size_t _sz;
+	size_t _pos;
+};
@@ -0,0 +1,792 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+#include "merkle.hxx"
+#include "endian_swap.h"
+#include "buffer_pool.hxx"
+#include "sha256_batch.hxx"
+
+#include <cryptopp/hmac.h>
+#include <cryptopp/aes.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/misc.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const size_t merkle_buffer_size = 65536;
+
+static void put_word32(CryptoPP::BufferedTransformation &bt, unsigned int x)
+{
+	unsigned int n = htonl(x);
+	bt.PutWord32(n);
+}
+
+static unsigned int get_word32(CryptoPP::BufferedTransformation &bt)
+{
+	unsigned int n;
+	if (bt.GetWord32(n) != sizeof(unsigned int))
+	{
+		throw std::runtime_error("Unable to read merkle data.");
+	}
+	return ntohl(n);
+}
+
+static void put_word64(CryptoPP::BufferedTransformation &bt, uint64_t x)
+{
+	put_word32(bt,(unsigned int)(x >> 32));
+	put_word32(bt,(unsigned int)x);
+}
+
+static uint64_t get_word64(CryptoPP::BufferedTransformation &bt)
+{
+	uint64_t high = get_word32(bt);
+	return (high << 32) | get_word32(bt);
+}
+
+static void put_double(CryptoPP::BufferedTransformation &bt, double x)
+{
+	uint64_t u;
+	memcpy(&u,&x,sizeof(u));
+	put_word64(bt,u);
+}
+
+static double get_double(CryptoPP::BufferedTransformation &bt)
+{
+	uint64_t u = get_word64(bt);
+	double x;
+	memcpy(&x,&u,sizeof(x));
+	return x;
+}
+
+static void put_blob(CryptoPP::BufferedTransformation &bt, const std::string &s)
+{
+	put_word32(bt,s.size());
+	bt.Put((const byte*)s.data(),s.size());
+}
+
+static std::string get_blob(CryptoPP::BufferedTransformation &bt)
+{
+	unsigned int sz = get_word32(bt);
+	if (bt.MaxRetrievable() < sz)
+	{
+		throw std::runtime_error("Merkle data is truncated.");
+	}
+	std::string s(sz,'\0');
+	if (sz > 0)
+	{
+		bt.Get((byte*)&s[0],sz);
+	}
+	return s;
+}
+
+// reads a count of entries, each of which takes at least four bytes
+static unsigned int get_count(CryptoPP::BufferedTransformation &bt)
+{
+	unsigned int count = get_word32(bt);
+	if (count > bt.MaxRetrievable()/4)
+	{
+		throw std::runtime_error("Merkle data is truncated.");
+	}
+	return count;
+}
+
+static std::string sha256(const std::string &a, const std::string &b = std::string())
+{
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	CryptoPP::SHA256 sha;
+	sha.Update((const byte*)a.data(),a.size());
+	sha.Update((const byte*)b.data(),b.size());
+	sha.Final(digest);
+	return std::string((const char*)digest,sizeof(digest));
+}
+
+// the sha256 digests of independent messages, hashed side by side
+static void sha256_all(std::vector<std::string> &digests, const std::vector<std::string> &messages)
+{
+	size_t n = messages.size();
+	std::vector<const unsigned char*> pointers(n);
+	std::vector<size_t> lengths(n);
+	for (size_t i=0;i<n;i++)
+	{
+		pointers[i] = (const unsigned char*)messages[i].data();
+		lengths[i] = messages[i].size();
+	}
+	std::vector<unsigned char> out(n*sha256_digest_size);
+	sha256_batch(pointers.data(),lengths.data(),n,out.data());
+	
+	digests.resize(n);
+	for (size_t i=0;i<n;i++)
+	{
+		digests[i].assign((const char*)&out[i*sha256_digest_size],sha256_digest_size);
+	}
+}
+
+static std::string random_bytes(size_t sz)
+{
+	CryptoPP::AutoSeededRandomPool rng;
+	std::string s(sz,'\0');
+	rng.GenerateBlock((byte*)&s[0],sz);
+	return s;
+}
+
+std::string merkle_data::leaf::hash() const
+{
+	return sha256(_blob,std::to_string(_index));
+}
+
+void merkle_data::leaf::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	put_word32(bt,_index);
+	put_blob(bt,_blob);
+}
+
+void merkle_data::leaf::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	_index = get_word32(bt);
+	_blob = get_blob(bt);
+}
+
+void merkle_data::branch::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	put_word32(bt,_rows.size());
+	for (size_t i=0;i<_rows.size();i++)
+	{
+		put_blob(bt,_rows[i].first);
+		put_blob(bt,_rows[i].second);
+	}
+}
+
+void merkle_data::branch::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	unsigned int count = get_count(bt);
+	_rows.resize(count);
+	for (unsigned int i=0;i<count;i++)
+	{
+		_rows[i].first = get_blob(bt);
+		_rows[i].second = get_blob(bt);
+	}
+}
+
+void merkle_data::tree::build(const std::vector<std::string> &leaf_hashes)
+{
+	_order = get_order(leaf_hashes.size());
+	size_t n = (size_t)1 << _order;
+	_nodes.assign(2*n,std::string());
+	
+	std::copy(leaf_hashes.begin(),leaf_hashes.end(),_nodes.begin() + (n - 1));
+	
+	// hash each level from the one below, all the nodes of a level in one
+	// batch.  the padding nodes are empty, so a parent of two padding nodes
+	// is the hash of nothing
+	std::vector<std::string> children;
+	std::vector<std::string> parents;
+	for (unsigned int i=1;i<=_order;i++)
+	{
+		size_t p = (size_t)1 << (_order - i);
+		children.resize(p);
+		for (size_t j=0;j<p;j++)
+		{
+			size_t k = p + j - 1;
+			children[j] = _nodes[2*k + 1] + _nodes[2*k + 2];
+		}
+		sha256_all(parents,children);
+		std::copy(parents.begin(),parents.end(),_nodes.begin() + (p - 1));
+	}
+}
+
+const std::string &merkle_data::tree::root() const
+{
+	if (_nodes.empty())
+	{
+		throw std::runtime_error("Merkle tree is empty.");
+	}
+	return _nodes[0];
+}
+
+void merkle_data::tree::get_branch(branch &b, unsigned int i) const
+{
+	size_t n = (size_t)1 << _order;
+	if (i >= n || _nodes.size() < 2*n - 1)
+	{
+		throw std::runtime_error("Leaf is outside of the merkle tree.");
+	}
+	
+	size_t j = i + n - 1;
+	b.rows().resize(_order);
+	for (unsigned int k=0;k<_order;k++)
+	{
+		// left nodes have odd ids
+		if (j % 2 != 0)
+		{
+			b.rows()[k] = branch::row(_nodes[j],_nodes[j + 1]);
+		}
+		else
+		{
+			b.rows()[k] = branch::row(_nodes[j - 1],_nodes[j]);
+		}
+		j = (j + 1)/2 - 1;
+	}
+}
+
+unsigned int merkle_data::tree::get_order(size_t n)
+{
+	if (n == 0)
+	{
+		throw std::runtime_error("A merkle tree needs at least one leaf.");
+	}
+	return (unsigned int)std::ceil(std::log((double)n)/std::log(2.0));
+}
+
+bool merkle_data::tree::verify_branch(const leaf &l, const branch &b, const std::string &root)
+{
+	std::string h = l.hash();
+	for (size_t i=0;i<b.rows().size();i++)
+	{
+		const branch::row &r = b.rows()[i];
+		if (r.first != h && r.second != h)
+		{
+			return false;
+		}
+		h = sha256(r.first,r.second);
+	}
+	return h == root;
+}
+
+void merkle_data::tree::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	put_word32(bt,_order);
+	put_word32(bt,_nodes.size());
+	for (size_t i=0;i<_nodes.size();i++)
+	{
+		put_blob(bt,_nodes[i]);
+	}
+}
+
+void merkle_data::tree::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	_order = get_word32(bt);
+	unsigned int count = get_count(bt);
+	_nodes.resize(count);
+	for (unsigned int i=0;i<count;i++)
+	{
+		_nodes[i] = get_blob(bt);
+	}
+	check_order();
+}
+
+void merkle_data::tree::check_order() const
+{
+	// the order is bounded before it is shifted by
+	if (_nodes.empty() ? _order != 0 : (_order >= 8*sizeof(size_t) - 1 || _nodes.size() != (size_t)2 << _order))
+	{
+		throw std::runtime_error("Merkle tree order does not match its nodes.");
+	}
+}
+
+void merkle_data::tag::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	_tree.serialize(bt);
+	put_word64(bt,_chunksz);
+	put_word64(bt,_filesz);
+}
+
+void merkle_data::tag::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	_tree.deserialize(bt);
+	_chunksz = get_word64(bt);
+	_filesz = get_word64(bt);
+}
+
+std::string merkle_data::state::get_hmac(const std::string &key) const
+{
+	CryptoPP::HMAC<CryptoPP::SHA256> hmac((const byte*)key.data(),key.size());
+	
+	std::string index = std::to_string(_index);
+	std::string n = std::to_string(_n);
+	std::string timestamp = float_text(_timestamp);
+	
+	hmac.Update((const byte*)index.data(),index.size());
+	hmac.Update((const byte*)_seed.data(),_seed.size());
+	hmac.Update((const byte*)n.data(),n.size());
+	hmac.Update((const byte*)_root.data(),_root.size());
+	hmac.Update((const byte*)timestamp.data(),timestamp.size());
+	
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	hmac.Final(digest);
+	return std::string((const char*)digest,sizeof(digest));
+}
+
+void merkle_data::state::check_sig(const std::string &key) const
+{
+	std::string h = get_hmac(key);
+	if (h.size() != _hmac.size() || !CryptoPP::VerifyBufsEqual((const byte*)h.data(),(const byte*)_hmac.data(),h.size()))
+	{
+		throw std::runtime_error("Signature invalid on state.");
+	}
+}
+
+bool merkle_data::state::operator==(const state &other) const
+{
+	return _index == other._index &&
+		_seed == other._seed &&
+		_n == other._n &&
+		_root == other._root &&
+		_hmac == other._hmac &&
+		_timestamp == other._timestamp;
+}
+
+void merkle_data::state::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	put_word32(bt,_index);
+	put_blob(bt,_seed);
+	put_word32(bt,_n);
+	put_blob(bt,_root);
+	put_blob(bt,_hmac);
+	put_double(bt,_timestamp);
+}
+
+void merkle_data::state::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	_index = get_word32(bt);
+	_seed = get_blob(bt);
+	_n = get_word32(bt);
+	_root = get_blob(bt);
+	_hmac = get_blob(bt);
+	_timestamp = get_double(bt);
+}
+
+void merkle_data::challenge::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	put_blob(bt,_seed);
+	put_word32(bt,_index);
+}
+
+void merkle_data::challenge::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	_seed = get_blob(bt);
+	_index = get_word32(bt);
+}
+
+void merkle_data::proof::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	_leaf.serialize(bt);
+	_branch.serialize(bt);
+}
+
+void merkle_data::proof::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	_leaf.deserialize(bt);
+	_branch.deserialize(bt);
+}
+
+std::string merkle_data::float_text(double x)
+{
+	if (x != x)
+	{
+		return "nan";
+	}
+	if (std::isinf(x))
+	{
+		return x < 0 ? "-inf" : "inf";
+	}
+	
+	// the fewest significant digits that read back as x
+	char buf[32];
+	int digits;
+	for (digits=1;digits<17;digits++)
+	{
+		snprintf(buf,sizeof(buf),"%.*e",digits - 1,x);
+		if (strtod(buf,0) == x)
+		{
+			break;
+		}
+	}
+	snprintf(buf,sizeof(buf),"%.*e",digits - 1,x);
+	
+	// split -d.ddde-xx into its sign, digits and exponent
+	const char *e = strchr(buf,'e');
+	int exponent = atoi(e + 1);
+	std::string mantissa;
+	for (const char *c=buf;c<e;c++)
+	{
+		if (*c >= '0' && *c <= '9')
+		{
+			mantissa += *c;
+		}
+	}
+	while (mantissa.size() > 1 && mantissa[mantissa.size() - 1] == '0')
+	{
+		mantissa.erase(mantissa.size() - 1);
+	}
+	
+	// python writes exponents from -4 to 15 in positional notation
+	std::string text = buf[0] == '-' ? "-" : "";
+	if (exponent >= -4 && exponent < 16)
+	{
+		if (exponent < 0)
+		{
+			text += "0." + std::string(-exponent - 1,'0') + mantissa;
+		}
+		else if (mantissa.size() <= (size_t)exponent + 1)
+		{
+			text += mantissa + std::string(exponent + 1 - mantissa.size(),'0') + ".0";
+		}
+		else
+		{
+			text += mantissa.substr(0,exponent + 1) + "." + mantissa.substr(exponent + 1);
+		}
+	}
+	else
+	{
+		text += mantissa.substr(0,1);
+		if (mantissa.size() > 1)
+		{
+			text += "." + mantissa.substr(1);
+		}
+		snprintf(buf,sizeof(buf),"e%c%02d",exponent < 0 ? '-' : '+',std::abs(exponent));
+		text += buf;
+	}
+	return text;
+}
+
+void merkle::gen()
+{
+	_key = random_bytes(merkle_data::key_size);
+}
+
+void merkle::get_public(merkle &h) const
+{
+	h._key.clear();
+	h._check_fraction = _check_fraction;
+	h._has_check_fraction = _has_check_fraction;
+}
+
+void merkle::encode(tag &t, state &s, simple_file &f)
+{
+	encode(t,s,f,merkle_data::default_challenge_count);
+}
+
+void merkle::encode(tag &t, state &s, simple_file &f, unsigned int n, const std::string &seed, size_t chunksz, size_t filesz)
+{
+	seekable_file *sf = dynamic_cast<seekable_file*>(&f);
+	if (sf)
+	{
+		sf->seek(0);
+		if (filesz == unspecified)
+		{
+			filesz = sf->bytes_remaining();
+		}
+	}
+	else if (filesz == unspecified)
+	{
+		throw std::runtime_error("The file size is needed to encode a file that cannot seek.");
+	}
+	if (chunksz == unspecified)
+	{
+		if (_has_check_fraction)
+		{
+			if (_check_fraction < 0)
+			{
+				throw std::runtime_error("Check fraction must not be negative.");
+			}
+			chunksz = (size_t)(_check_fraction*filesz);
+		}
+		else
+		{
+			chunksz = merkle_data::default_chunk_size;
+		}
+	}
+	
+	s = state();
+	s.set_seed(seed.empty() ? random_bytes(merkle_data::key_size) : seed);
+	s.set_n(n);
+	
+	// leaf i is the chunk hash under the i+1th seed after the root seed
+	std::vector<std::string> seeds(n);
+	std::string next = s.seed();
+	for (unsigned int i=0;i<n;i++)
+	{
+		next = next_seed(_key,next);
+		seeds[i] = next;
+	}
+	
+	// the hash of leaf i is sha256(blob + str(i)), as leaf::hash has it
+	std::vector<std::string> leaves;
+	chunk_hashes(leaves,f,seeds,filesz,chunksz);
+	for (unsigned int i=0;i<n;i++)
+	{
+		leaves[i] += std::to_string(i);
+	}
+	sha256_all(leaves,leaves);
+	
+	t = tag();
+	t.tree().build(leaves);
+	t.set_chunksz(chunksz);
+	t.set_filesz(filesz);
+	
+	s.set_root(t.tree().root());
+	s.set_timestamp(std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count());
+	s.sign(_key);
+}
+
+void merkle::gen_challenge(challenge &c, state &s)
+{
+	s.check_sig(_key);
+	if (s.index() >= s.n())
+	{
+		throw std::runtime_error("Out of challenges.");
+	}
+	s.set_seed(next_seed(_key,s.seed()));
+	c = challenge(s.seed(),s.index());
+	s.set_index(s.index() + 1);
+	s.sign(_key);
+}
+
+void merkle::prove(proof &p, seekable_file &f, const challenge &c, const tag &t)
+{
+	p.leaf() = merkle_data::leaf(c.index(),chunk_hash(f,c.seed(),t.filesz(),t.chunksz()));
+	t.tree().get_branch(p.branch(),c.index());
+}
+
+bool merkle::verify(const proof &p, const challenge &c, const state &s)
+{
+	s.check_sig(_key);
+	if (p.leaf().index() != c.index())
+	{
+		return false;
+	}
+	return merkle_data::tree::verify_branch(p.leaf(),p.branch(),s.root());
+}
+
+std::string merkle::next_seed(const std::string &key, const std::string &seed)
+{
+	CryptoPP::HMAC<CryptoPP::SHA256> hmac((const byte*)key.data(),key.size());
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	hmac.CalculateDigest(digest,(const byte*)seed.data(),seed.size());
+	return std::string((const char*)digest,sizeof(digest));
+}
+
+std::string merkle::chunk_hash(seekable_file &f, const std::string &seed, size_t filesz, size_t chunksz)
+{
+	if (filesz < chunksz)
+	{
+		chunksz = filesz;
+	}
+	
+	uint64_t i = keyed_prf(seed,filesz - chunksz + 1);
+	if (f.seek(i) != i)
+	{
+		throw std::runtime_error("Unable to seek to chunk.");
+	}
+	
+	CryptoPP::HMAC<CryptoPP::SHA256> hmac((const byte*)seed.data(),seed.size());
+	size_t buffer_sz = std::min(chunksz,merkle_buffer_size);
+	pooled_buffer buffer(buffer_pool::allocate(buffer_sz));
+	while (chunksz > 0)
+	{
+		size_t n = f.read(buffer.get(),std::min(chunksz,buffer_sz));
+		if (n == 0)
+		{
+			throw std::runtime_error("File is shorter than when it was encoded.");
+		}
+		hmac.Update(buffer.get(),n);
+		chunksz -= n;
+	}
+	
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	hmac.Final(digest);
+	return std::string((const char*)digest,sizeof(digest));
+}
+
+void merkle::chunk_hashes(std::vector<std::string> &hashes, simple_file &f, const std::vector<std::string> &seeds, size_t filesz, size_t chunksz)
+{
+	typedef CryptoPP::HMAC<CryptoPP::SHA256> hmac_type;
+	
+	if (filesz < chunksz)
+	{
+		chunksz = filesz;
+	}
+	
+	size_t n = seeds.size();
+	std::vector<uint64_t> offsets(n);
+	std::vector<std::unique_ptr<hmac_type> > hmacs(n);
+	std::vector<size_t> order(n);
+	for (size_t i=0;i<n;i++)
+	{
+		offsets[i] = keyed_prf(seeds[i],filesz - chunksz + 1);
+		hmacs[i].reset(new hmac_type((const byte*)seeds[i].data(),seeds[i].size()));
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(),order.end(),[&](size_t a, size_t b) { return offsets[a] < offsets[b]; });
+	
+	seekable_file *sf = dynamic_cast<seekable_file*>(&f);
+	size_t buffer_sz = std::max<size_t>(std::min(chunksz,merkle_buffer_size),1);
+	pooled_buffer buffer(buffer_pool::allocate(buffer_sz));
+	
+	// the chunks of order[lo] to order[hi-1] cover the block being read.
+	// they all have the same size, so they leave in the order they come
+	uint64_t pos = 0;
+	size_t lo = 0;
+	size_t hi = 0;
+	if (sf && n > 0 && sf->seek(0) != 0)
+	{
+		throw std::runtime_error("Unable to seek to chunk.");
+	}
+	while (chunksz > 0 && lo < n)
+	{
+		if (lo == hi && pos < offsets[order[hi]])
+		{
+			// nothing covers the gap before the next chunk
+			uint64_t start = offsets[order[hi]];
+			if (sf)
+			{
+				if (sf->seek(start) != start)
+				{
+					throw std::runtime_error("Unable to seek to chunk.");
+				}
+				pos = start;
+			}
+			while (pos < start)
+			{
+				size_t m = f.read(buffer.get(),std::min<uint64_t>(start - pos,buffer_sz));
+				if (m == 0)
+				{
+					throw std::runtime_error("File is shorter than when it was encoded.");
+				}
+				pos += m;
+			}
+		}
+		
+		uint64_t end = std::min<uint64_t>(pos + buffer_sz,offsets[order[n-1]] + chunksz);
+		size_t m = 0;
+		while (pos + m < end)
+		{
+			size_t r = f.read(buffer.get() + m,end - pos - m);
+			if (r == 0)
+			{
+				throw std::runtime_error("File is shorter than when it was encoded.");
+			}
+			m += r;
+		}
+		
+		while (hi < n && offsets[order[hi]] < end)
+		{
+			hi++;
+		}
+		for (size_t k=lo;k<hi;k++)
+		{
+			uint64_t from = std::max<uint64_t>(offsets[order[k]],pos);
+			uint64_t to = std::min<uint64_t>(offsets[order[k]] + chunksz,end);
+			hmacs[order[k]]->Update(buffer.get() + (from - pos),to - from);
+		}
+		
+		pos = end;
+		while (lo < hi && offsets[order[lo]] + chunksz <= pos)
+		{
+			lo++;
+		}
+	}
+	
+	hashes.resize(n);
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	for (size_t i=0;i<n;i++)
+	{
+		hmacs[i]->Final(digest);
+		hashes[i].assign((const char*)digest,sizeof(digest));
+	}
+}
+
+uint64_t merkle::keyed_prf(const std::string &key, uint64_t range, unsigned int x)
+{
+	if (range == 0)
+	{
+		throw std::runtime_error("Range of keyed prf must not be empty.");
+	}
+	
+	unsigned int bits = 0;
+	for (uint64_t r=range;r;r >>= 1)
+	{
+		bits++;
+	}
+	size_t sz = (bits + 7)/8;
+	uint64_t mask = bits < 64 ? ((uint64_t)1 << bits) - 1 : ~(uint64_t)0;
+	
+	// the hash of the text of x, cut to the size of the range
+	std::string text = std::to_string(x);
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	CryptoPP::SHA256().CalculateDigest(digest,(const byte*)text.data(),text.size());
+	
+	// it is encrypted with aes in 8 bit cfb mode until it falls in the
+	// range, continuing the cipher stream each time
+	byte iv[CryptoPP::AES::BLOCKSIZE] = {0};
+	CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption aes((const byte*)key.data(),key.size(),iv,1);
+	byte out[sizeof(uint64_t)];
+	while (true)
+	{
+		aes.ProcessData(out,digest,sz);
+		uint64_t num = 0;
+		for (size_t i=0;i<sz;i++)
+		{
+			num = (num << 8) | out[i];
+		}
+		num &= mask;
+		if (num < range)
+		{
+			return num;
+		}
+	}
+}
+
+void merkle::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	put_blob(bt,_key);
+	bt.Put(_has_check_fraction ? 1 : 0);
+	put_double(bt,_check_fraction);
+}
+
+void merkle::serialize_canonical(CryptoPP::BufferedTransformation &bt) const
+{
+	put_blob(bt,_key);
+}
+
+void merkle::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	_key = get_blob(bt);
+	byte flag;
+	if (bt.Get(flag) != 1)
+	{
+		throw std::runtime_error("Unable to read merkle data.");
+	}
+	_has_check_fraction = flag != 0;
+	_check_fraction = get_double(bt);
+}
@@ -0,0 +1,337 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+/*
+
+C++ implementation of the merkle tree heartbeat of heartbeat/Merkle.  a file
+is tagged with a merkle tree whose leaves are seeded hmacs of n chunks of the
+file, each chunk at a position picked by its seed.  each challenge reveals
+one seed, and is proven by the hmac of its chunk and the branch of its leaf.
+objects are interchangeable with the python scheme through their todict form
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+#include "heartbeat.hxx"
+#include "seekable_file.hxx"
+#include "serializable.hxx"
+
+#include <cryptopp/sha.h>
+
+class merkle_data
+{
+public:
+	static const unsigned int key_size = 32;
+	static const size_t default_chunk_size = 8192;
+	static const unsigned int default_challenge_count = 256;
+	
+	// a leaf of the tree, the seeded hmac of a chunk of the file
+	class leaf : public serializable
+	{
+	public:
+		leaf() : _index(0) {}
+		leaf(unsigned int index, const std::string &blob) : _index(index), _blob(blob) {}
+		
+		unsigned int index() const { return _index; }
+		const std::string &blob() const { return _blob; }
+		
+		// the hash of the leaf in the tree, sha256(blob + str(index))
+		std::string hash() const;
+		
+		bool operator==(const leaf &other) const { return _index == other._index && _blob == other._blob; }
+		bool operator!=(const leaf &other) const { return !(*this == other); }
+		
+		void serialize(CryptoPP::BufferedTransformation &bt) const;
+		void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+	private:
+		unsigned int _index;
+		std::string _blob;
+	};
+	
+	// the pairs of nodes from a leaf up to, but not including, the root
+	class branch : public serializable
+	{
+	public:
+		typedef std::pair<std::string,std::string> row;
+		
+		std::vector<row> &rows() { return _rows; }
+		const std::vector<row> &rows() const { return _rows; }
+		
+		bool operator==(const branch &other) const { return _rows == other._rows; }
+		bool operator!=(const branch &other) const { return !(*this == other); }
+		
+		void serialize(CryptoPP::BufferedTransformation &bt) const;
+		void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+	private:
+		std::vector<row> _rows;
+	};
+	
+	// a merkle tree stored as an array, with the children of node i at 2i+1
+	// and 2i+2 and the leaves at the bottom level, padded with empty nodes.
+	// the leaves themselves are not kept
+	class tree : public serializable
+	{
+	public:
+		tree() : _order(0) {}
+		
+		// builds the tree over the given leaf hashes
+		void build(const std::vector<std::string> &leaf_hashes);
+		
+		const std::vector<std::string> &nodes() const { return _nodes; }
+		std::vector<std::string> &nodes() { return _nodes; }
+		
+		unsigned int order() const { return _order; }
+		void set_order(unsigned int order) { _order = order; }
+		
+		// throws if the tree is neither empty nor 2^(order+1) nodes, as from
+		// a corrupt serialization
+		void check_order() const;
+		
+		const std::string &root() const;
+		
+		// gets the branch of leaf i into b
+		void get_branch(branch &b, unsigned int i) const;
+		
+		// the number of levels above the leaves of a tree with n leaves.  this
+		// is computed in floating point, as the python scheme does, so that
+		// trees agree even where the logarithm rounds up
+		static unsigned int get_order(size_t n);
+		
+		// whether branch b leads from leaf l to root
+		static bool verify_branch(const leaf &l, const branch &b, const std::string &root);
+		
+		bool operator==(const tree &other) const { return _order == other._order && _nodes == other._nodes; }
+		bool operator!=(const tree &other) const { return !(*this == other); }
+		
+		void serialize(CryptoPP::BufferedTransformation &bt) const;
+		void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+	private:
+		std::vector<std::string> _nodes;
+		unsigned int _order;
+	};
+	
+	class tag : public serializable
+	{
+	public:
+		tag() : _chunksz(default_chunk_size), _filesz(0) {}
+		
+		merkle_data::tree &tree() { return _tree; }
+		const merkle_data::tree &tree() const { return _tree; }
+		
+		size_t chunksz() const { return _chunksz; }
+		void set_chunksz(size_t sz) { _chunksz = sz; }
+		
+		size_t filesz() const { return _filesz; }
+		void set_filesz(size_t sz) { _filesz = sz; }
+		
+		bool operator==(const tag &other) const { return _tree == other._tree && _chunksz == other._chunksz && _filesz == other._filesz; }
+		bool operator!=(const tag &other) const { return !(*this == other); }
+		
+		void serialize(CryptoPP::BufferedTransformation &bt) const;
+		void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+	private:
+		merkle_data::tree _tree;
+		size_t _chunksz;
+		size_t _filesz;
+	};
+	
+	// the state is kept by the server and signed by the client.  it advances
+	// with every challenge issued, and holds the seed of the last one
+	class state : public serializable
+	{
+	public:
+		state() : _index(0), _n(0), _timestamp(0) {}
+		
+		unsigned int index() const { return _index; }
+		void set_index(unsigned int index) { _index = index; }
+		
+		const std::string &seed() const { return _seed; }
+		void set_seed(const std::string &seed) { _seed = seed; }
+		
+		unsigned int n() const { return _n; }
+		void set_n(unsigned int n) { _n = n; }
+		
+		const std::string &root() const { return _root; }
+		void set_root(const std::string &root) { _root = root; }
+		
+		const std::string &hmac() const { return _hmac; }
+		void set_hmac(const std::string &hmac) { _hmac = hmac; }
+		
+		double timestamp() const { return _timestamp; }
+		void set_timestamp(double timestamp) { _timestamp = timestamp; }
+		
+		// the hmac of the state under key.  numbers are hashed in their
+		// python text form, so that python states can be checked
+		std::string get_hmac(const std::string &key) const;
+		
+		void sign(const std::string &key) { _hmac = get_hmac(key); }
+		
+		// throws if the state was not signed with key
+		void check_sig(const std::string &key) const;
+		
+		bool operator==(const state &other) const;
+		bool operator!=(const state &other) const { return !(*this == other); }
+		
+		void serialize(CryptoPP::BufferedTransformation &bt) const;
+		void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+	private:
+		unsigned int _index;
+		std::string _seed;
+		unsigned int _n;
+		std::string _root;
+		std::string _hmac;
+		double _timestamp;
+	};
+	
+	class challenge : public serializable
+	{
+	public:
+		challenge() : _index(0) {}
+		challenge(const std::string &seed, unsigned int index) : _seed(seed), _index(index) {}
+		
+		const std::string &seed() const { return _seed; }
+		unsigned int index() const { return _index; }
+		
+		bool operator==(const challenge &other) const { return _seed == other._seed && _index == other._index; }
+		bool operator!=(const challenge &other) const { return !(*this == other); }
+		
+		void serialize(CryptoPP::BufferedTransformation &bt) const;
+		void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+	private:
+		std::string _seed;
+		unsigned int _index;
+	};
+	
+	class proof : public serializable
+	{
+	public:
+		merkle_data::leaf &leaf() { return _leaf; }
+		const merkle_data::leaf &leaf() const { return _leaf; }
+		
+		merkle_data::branch &branch() { return _branch; }
+		const merkle_data::branch &branch() const { return _branch; }
+		
+		bool operator==(const proof &other) const { return _leaf == other._leaf && _branch == other._branch; }
+		bool operator!=(const proof &other) const { return !(*this == other); }
+		
+		void serialize(CryptoPP::BufferedTransformation &bt) const;
+		void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+	private:
+		merkle_data::leaf _leaf;
+		merkle_data::branch _branch;
+	};
+	
+	// python's str() of a float, the shortest text that reads back as x
+	static std::string float_text(double x);
+};
+
+class merkle : public heartbeat<merkle_data,merkle>, public serializable
+{
+public:
+	// an unspecified chunk or file size for encode
+	static const size_t unspecified = (size_t)-1;
+	
+	merkle() : _check_fraction(0), _has_check_fraction(false) {}
+	
+	// generates a new key
+	void gen();
+	
+	const std::string &key() const { return _key; }
+	void set_key(const std::string &key) { _key = key; }
+	
+	// the fraction of the file each challenge checks.  without one, chunks
+	// are merkle_data::default_chunk_size bytes
+	bool has_check_fraction() const { return _has_check_fraction; }
+	double check_fraction() const { return _check_fraction; }
+	void set_check_fraction(double check_fraction) { _check_fraction = check_fraction; _has_check_fraction = true; }
+	void clear_check_fraction() { _has_check_fraction = false; }
+	
+	// gets the public version of this object, without the key, into h
+	void get_public(merkle &h) const;
+	
+	// encodes f for default_challenge_count challenges
+	void encode(tag &t, state &s, simple_file &f);
+	
+	// encodes f for n challenges.  an empty seed is replaced with a random
+	// one, and unspecified sizes are taken from the file and check fraction.
+	// seekable files are read from the start, and others from where they are,
+	// which need the file size
+	void encode(tag &t, state &s, simple_file &f, unsigned int n, const std::string &seed = std::string(), size_t chunksz = unspecified, size_t filesz = unspecified);
+	
+	// gets the next challenge of s, which advances and is signed again
+	void gen_challenge(challenge &c, state &s);
+	
+	void prove(proof &p, seekable_file &f, const challenge &c, const tag &t);
+	
+	bool verify(const proof &p, const challenge &c, const state &s);
+	
+	// the seed following seed, its hmac under key
+	static std::string next_seed(const std::string &key, const std::string &seed);
+	
+	// the hmac under seed of the chunk of f picked by seed.  the chunk is
+	// chunksz bytes, or the whole file if that is smaller
+	static std::string chunk_hash(seekable_file &f, const std::string &seed, size_t filesz, size_t chunksz);
+	
+	// the chunk hashes of f under each of seeds, in one pass over the file.
+	// the chunks are sorted by offset and f is read once from the first of
+	// them, each block going to every hmac whose chunk covers it.  seekable
+	// files are read from the start and seek over the gaps between chunks,
+	// others are read from where they are
+	static void chunk_hashes(std::vector<std::string> &hashes, simple_file &f, const std::vector<std::string> &seeds, size_t filesz, size_t chunksz);
+	
+	// the keyed prf of the python scheme, which picks a number in [0,range)
+	// from key and x
+	static uint64_t keyed_prf(const std::string &key, uint64_t range, unsigned int x = 0);
+	
+	bool operator==(const merkle &other) const { return _key == other._key; }
+	bool operator!=(const merkle &other) const { return !(*this == other); }
+	
+	void serialize(CryptoPP::BufferedTransformation &bt) const;
+	void deserialize(CryptoPP::BufferedTransformation &bt);
+	
+	// the key alone, which is what operator== compares
+	void serialize_canonical(CryptoPP::BufferedTransformation &bt) const;
+	
+private:
+	std::string _key;
+	double _check_fraction;
+	bool _has_check_fraction;
+};
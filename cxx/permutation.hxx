@@ -0,0 +1,132 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+// a keyed pseudo random permutation of [0,n), used to select distinct chunks
+// for a challenge.  it is a balanced feistel network on the smallest even
+// number of bits covering n, with sha-256 of the key, round and half block as
+// the round function.  values outside [0,n) are encrypted again until they
+// fall inside it
+
+#pragma once
+
+#include <cryptopp/sha.h>
+#include <cstring>
+#include <stdexcept>
+#include "buffer_pool.hxx"
+
+class keyed_permutation
+{
+public:
+	keyed_permutation() : _n(0), _half_bits(0), _half_mask(0), _key_sz(0) {}
+	
+	void set_key(const unsigned char *key,unsigned int key_length)
+	{
+		_key_sz = key_length;
+		_key = pooled_buffer(buffer_pool::allocate(_key_sz));
+		memcpy(_key.get(),key,_key_sz);
+	}
+	
+	void set_limit(unsigned int n)
+	{
+		_n = n;
+		
+		unsigned int bits = 2;
+		while (bits < 32 && ((unsigned long long)1 << bits) < n)
+		{
+			bits++;
+		}
+		_half_bits = (bits + 1) / 2;
+		_half_mask = ((unsigned long long)1 << _half_bits) - 1;
+	}
+	
+	unsigned int get_limit() const { return _n; }
+	
+	// returns the image of i, which must be less than the limit
+	unsigned int evaluate(unsigned int i) const
+	{
+		if (i >= _n)
+		{
+			throw std::runtime_error("Permutation input out of range.");
+		}
+		
+		// the domain is less than 4n, so this ends after a few iterations on
+		// average, and always ends because the permutation has finite cycles
+		unsigned long long x = i;
+		do
+		{
+			x = encrypt(x);
+		} while (x >= _n);
+		
+		return (unsigned int)x;
+	}
+	
+private:
+	mutable CryptoPP::SHA256 _sha;
+	
+	unsigned int _n;
+	unsigned int _half_bits;
+	unsigned long long _half_mask;
+	
+	pooled_buffer _key;
+	unsigned int _key_sz;
+	
+	static const unsigned int rounds = 4;
+	
+	unsigned long long encrypt(unsigned long long x) const
+	{
+		unsigned long long l = x >> _half_bits;
+		unsigned long long r = x & _half_mask;
+		
+		for (unsigned int i=0;i<rounds;i++)
+		{
+			unsigned long long t = l ^ (f(i,r) & _half_mask);
+			l = r;
+			r = t;
+		}
+		
+		return (l << _half_bits) | r;
+	}
+	
+	unsigned long long f(unsigned int round,unsigned long long r) const
+	{
+		byte block[5];
+		block[0] = (byte)round;
+		for (int i=0;i<4;i++)
+		{
+			block[1+i] = (byte)(r >> (8*i));
+		}
+		
+		byte digest[CryptoPP::SHA256::DIGESTSIZE];
+		_sha.Update(_key.get(),_key_sz);
+		_sha.Update(block,sizeof(block));
+		_sha.Final(digest);
+		
+		return (unsigned long long)digest[0] 
+			| ((unsigned long long)digest[1] << 8) 
+			| ((unsigned long long)digest[2] << 16) 
+			| ((unsigned long long)digest[3] << 24);
+	}
+};
@@ -34,7 +34,7 @@ THE SOFTWARE.
 #include <cryptopp/hex.h>
 #include <iostream>
 #include "clz.h"
-#include "pointer.hxx"
+#include "buffer_pool.hxx"
 
 class prf
 {
@@ -60,7 +60,7 @@ public:
 	void init()
 	{
 		_iv_sz = _aes.DefaultIVLength();
-		_iv = smart_buffer(new unsigned char[_iv_sz]);
+		_iv = pooled_buffer(buffer_pool::allocate(_iv_sz));
 		memset(_iv.get(),0,_iv_sz);
 		_buffer_sz = 0;
 		_key_sz = 0;
@@ -74,7 +74,7 @@ public:
 		if (p._buffer.get()!=0)
 		{
 			_buffer_sz = p._buffer_sz;
-			_buffer = smart_buffer(new unsigned char[_buffer_sz]);
+			_buffer = pooled_buffer(buffer_pool::allocate(_buffer_sz));
 			memcpy(_buffer.get(),p._buffer.get(),_buffer_sz);
 		}
 			
@@ -88,7 +88,7 @@ public:
 	void set_key(const unsigned char *key,unsigned int key_length)
 	{
 		_key_sz = key_length;
-		_key = smart_buffer(new unsigned char[_key_sz]);
+		_key = pooled_buffer(buffer_pool::allocate(_key_sz));
 		memcpy(_key.get(),key,_key_sz);
 		
 		_aes.SetKeyWithIV(_key.get(),_key_sz,_iv.get(),_iv_sz);
@@ -113,7 +113,7 @@ public:
 		unsigned int digest_sz = _sha.DigestSize();
 		
 		_buffer_sz = _limit_sz > digest_sz ? _limit_sz : digest_sz;
-		_buffer = smart_buffer(new unsigned char[_buffer_sz]);
+		_buffer = pooled_buffer(buffer_pool::allocate(_buffer_sz));
 	}
 	
 	const CryptoPP::Integer& get_limit() const
@@ -154,13 +154,13 @@ private:
 	CryptoPP::Integer _limit;
 	unsigned int _limit_sz;
 	
-	smart_buffer _buffer;
+	pooled_buffer _buffer;
 	unsigned int _buffer_sz;
 	
-	smart_buffer _iv;
+	pooled_buffer _iv;
 	unsigned int _iv_sz;
 
-	smart_buffer _key;
+	pooled_buffer _key;
 	unsigned int _key_sz;
 	
 	byte _msb_mask;
@@ -34,6 +34,14 @@ public:
 	virtual void serialize(CryptoPP::BufferedTransformation &bt) const = 0;
 	virtual void deserialize(CryptoPP::BufferedTransformation &bt) = 0;
 	
+	// writes the fields operator== compares, so that objects which compare
+	// equal write the same bytes.  hashes are taken of this.  by default it
+	// is the serialization
+	virtual void serialize_canonical(CryptoPP::BufferedTransformation &bt) const
+	{
+		serialize(bt);
+	}
+	
 	virtual void serializep(CryptoPP::BufferedTransformation *bt) const
 	{
 		serialize(*bt);
@@ -0,0 +1,308 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+#include "sha256_batch.hxx"
+
+#include <cryptopp/sha.h>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA256_X86_DISPATCH
+#endif
+
+static const size_t sha256_block_size = 64;
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+	0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+	0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+	0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+	0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+	0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+	0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+static const uint32_t sha256_h0[8] = {
+	0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+};
+
+// the number of blocks of a message of len bytes once padded
+static inline size_t sha256_blocks(size_t len)
+{
+	return (len + 8)/sha256_block_size + 1;
+}
+
+// block b of the padded message m of len bytes.  whole blocks of the message
+// are returned in place, others are padded into tmp
+static inline const unsigned char *sha256_padded_block(const unsigned char *m, size_t len, size_t b, unsigned char *tmp)
+{
+	size_t off = b*sha256_block_size;
+	if (off + sha256_block_size <= len)
+	{
+		return m + off;
+	}
+	
+	size_t n = off < len ? len - off : 0;
+	if (n > 0)
+	{
+		memcpy(tmp,m + off,n);
+	}
+	memset(tmp + n,0,sha256_block_size - n);
+	if (off <= len)
+	{
+		tmp[n] = 0x80;
+	}
+	if (b == sha256_blocks(len) - 1)
+	{
+		uint64_t bits = (uint64_t)len*8;
+		for (int i=0;i<8;i++)
+		{
+			tmp[sha256_block_size - 1 - i] = (unsigned char)(bits >> (8*i));
+		}
+	}
+	return tmp;
+}
+
+static inline void sha256_one(const unsigned char *m, size_t len, unsigned char *digest)
+{
+	// crypto++ uses the sha extensions where the processor has them
+	CryptoPP::SHA256().CalculateDigest(digest,m,len);
+}
+
+#ifdef SHA256_X86_DISPATCH
+
+// L messages side by side, lane j of each vector holding the words of
+// message j.  this is written with the vector extensions of the compiler and
+// inlined into functions built for each instruction set below
+typedef uint32_t sha256_lanes4 __attribute__((vector_size(16)));
+typedef uint32_t sha256_lanes8 __attribute__((vector_size(32)));
+typedef uint32_t sha256_lanes16 __attribute__((vector_size(64)));
+
+#define sha256_rotr(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// hashes L messages, which are sorted by length so lanes waste few blocks.
+// lanes beyond count are idle
+template <typename V, size_t L>
+static inline __attribute__((always_inline)) void sha256_lanes(const unsigned char *const *messages, const size_t *lengths, size_t count, unsigned char *const *digests)
+{
+	V s[8];
+	for (int i=0;i<8;i++)
+	{
+		s[i] = V{} + sha256_h0[i];
+	}
+	
+	size_t blocks[L];
+	size_t max_blocks = 0;
+	for (size_t j=0;j<L;j++)
+	{
+		blocks[j] = j < count ? sha256_blocks(lengths[j]) : 0;
+		max_blocks = std::max(max_blocks,blocks[j]);
+	}
+	
+	unsigned char tmp[L][sha256_block_size];
+	uint32_t words[16][L] __attribute__((aligned(64)));
+	for (size_t b=0;b<max_blocks;b++)
+	{
+		// gather word t of every lane's block into vector t
+		for (size_t j=0;j<L;j++)
+		{
+			if (b >= blocks[j])
+			{
+				for (int t=0;t<16;t++)
+				{
+					words[t][j] = 0;
+				}
+				continue;
+			}
+			const unsigned char *p = sha256_padded_block(messages[j],lengths[j],b,tmp[j]);
+			for (int t=0;t<16;t++)
+			{
+				words[t][j] = ((uint32_t)p[4*t] << 24) | ((uint32_t)p[4*t + 1] << 16) | ((uint32_t)p[4*t + 2] << 8) | p[4*t + 3];
+			}
+		}
+		V w[16];
+		memcpy(w,words,sizeof(w));
+		
+		V a = s[0], bb = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+		for (int t=0;t<64;t++)
+		{
+			if (t >= 16)
+			{
+				V w2 = w[(t - 2) & 15];
+				V w15 = w[(t - 15) & 15];
+				w[t & 15] += (sha256_rotr(w2,17) ^ sha256_rotr(w2,19) ^ (w2 >> 10)) + w[(t - 7) & 15] + (sha256_rotr(w15,7) ^ sha256_rotr(w15,18) ^ (w15 >> 3));
+			}
+			V t1 = h + (sha256_rotr(e,6) ^ sha256_rotr(e,11) ^ sha256_rotr(e,25)) + ((e & f) ^ (~e & g)) + sha256_k[t] + w[t & 15];
+			V t2 = (sha256_rotr(a,2) ^ sha256_rotr(a,13) ^ sha256_rotr(a,22)) + ((a & bb) ^ (a & c) ^ (bb & c));
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = bb;
+			bb = a;
+			a = t1 + t2;
+		}
+		s[0] += a;
+		s[1] += bb;
+		s[2] += c;
+		s[3] += d;
+		s[4] += e;
+		s[5] += f;
+		s[6] += g;
+		s[7] += h;
+		
+		// lanes whose last block this was are done
+		for (size_t j=0;j<L;j++)
+		{
+			if (b + 1 != blocks[j])
+			{
+				continue;
+			}
+			for (int i=0;i<8;i++)
+			{
+				uint32_t x = s[i][j];
+				digests[j][4*i] = (unsigned char)(x >> 24);
+				digests[j][4*i + 1] = (unsigned char)(x >> 16);
+				digests[j][4*i + 2] = (unsigned char)(x >> 8);
+				digests[j][4*i + 3] = (unsigned char)x;
+			}
+		}
+	}
+}
+
+__attribute__((target("sse2")))
+static void sha256_lanes_sse2(const unsigned char *const *messages, const size_t *lengths, size_t count, unsigned char *const *digests)
+{
+	sha256_lanes<sha256_lanes4,4>(messages,lengths,count,digests);
+}
+
+__attribute__((target("avx2")))
+static void sha256_lanes_avx2(const unsigned char *const *messages, const size_t *lengths, size_t count, unsigned char *const *digests)
+{
+	sha256_lanes<sha256_lanes8,8>(messages,lengths,count,digests);
+}
+
+__attribute__((target("avx512f")))
+static void sha256_lanes_avx512(const unsigned char *const *messages, const size_t *lengths, size_t count, unsigned char *const *digests)
+{
+	sha256_lanes<sha256_lanes16,16>(messages,lengths,count,digests);
+}
+
+typedef void (*sha256_lanes_function)(const unsigned char *const *, const size_t *, size_t, unsigned char *const *);
+
+struct sha256_kernel
+{
+	sha256_lanes_function function;
+	size_t lanes;
+};
+
+static sha256_kernel sha256_select_kernel()
+{
+	sha256_kernel k = {0,1};
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		k.function = sha256_lanes_avx512;
+		k.lanes = 16;
+	}
+	else if (__builtin_cpu_supports("avx2"))
+	{
+		k.function = sha256_lanes_avx2;
+		k.lanes = 8;
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		k.function = sha256_lanes_sse2;
+		k.lanes = 4;
+	}
+	return k;
+}
+
+static const sha256_kernel &sha256_get_kernel()
+{
+	static const sha256_kernel k = sha256_select_kernel();
+	return k;
+}
+
+#endif
+
+size_t sha256_batch_lanes()
+{
+#ifdef SHA256_X86_DISPATCH
+	return sha256_get_kernel().lanes;
+#else
+	return 1;
+#endif
+}
+
+void sha256_batch(const unsigned char *const *messages, const size_t *lengths, size_t count, unsigned char *digests)
+{
+	size_t i = 0;
+	
+#ifdef SHA256_X86_DISPATCH
+	const sha256_kernel &k = sha256_get_kernel();
+	if (k.function && count > 1)
+	{
+		// messages of similar length share lanes, so few blocks are wasted
+		std::vector<size_t> order(count);
+		for (size_t j=0;j<count;j++)
+		{
+			order[j] = j;
+		}
+		std::stable_sort(order.begin(),order.end(),[&](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+		
+		const unsigned char *lane_messages[16];
+		size_t lane_lengths[16];
+		unsigned char *lane_digests[16];
+		for (;i + 1 < count;i += k.lanes)
+		{
+			size_t n = std::min(k.lanes,count - i);
+			for (size_t j=0;j<n;j++)
+			{
+				lane_messages[j] = messages[order[i + j]];
+				lane_lengths[j] = lengths[order[i + j]];
+				lane_digests[j] = digests + sha256_digest_size*order[i + j];
+			}
+			k.function(lane_messages,lane_lengths,n,lane_digests);
+		}
+		if (i < count)
+		{
+			sha256_one(messages[order[i]],lengths[order[i]],digests + sha256_digest_size*order[i]);
+		}
+		return;
+	}
+#endif
+	
+	for (;i<count;i++)
+	{
+		sha256_one(messages[i],lengths[i],digests + sha256_digest_size*i);
+	}
+}
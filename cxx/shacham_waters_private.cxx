@@ -34,6 +34,16 @@ THE SOFTWARE.
 #include <cryptopp/osrng.h>
 #include <cryptopp/hmac.h>
 #include <cryptopp/hex.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+
+// reads a word written by serialize, which puts it in network order and
+// then writes it big endian
+static unsigned int serialized_word32(const unsigned char *p)
+{
+	return ntohl(((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3]);
+}
 
 void shacham_waters_private_data::tag::serialize(CryptoPP::BufferedTransformation &bt) const
 {
@@ -43,7 +53,7 @@ void shacham_waters_private_data::tag::serialize(CryptoPP::BufferedTransformatio
 	
 	for (unsigned int i=0;i<_sigma.size();i++)
 	{
-		unsigned int sigma_sz = _sigma[i].MinEncodedSize();
+		unsigned int sigma_sz = std::max((unsigned int)_sigma[i].MinEncodedSize(),_entry_size);
 		n = htonl(sigma_sz);
 	
 		bt.PutWord32(n);
@@ -53,6 +63,13 @@ void shacham_waters_private_data::tag::serialize(CryptoPP::BufferedTransformatio
 	}
 }
 
+void shacham_waters_private_data::tag::serialize_canonical(CryptoPP::BufferedTransformation &bt) const
+{
+	tag t;
+	t._sigma = _sigma;
+	t.serialize(bt);
+}
+
 void shacham_waters_private_data::tag::deserialize(CryptoPP::BufferedTransformation &bt)
 {
 	unsigned int n;
@@ -66,6 +83,7 @@ void shacham_waters_private_data::tag::deserialize(CryptoPP::BufferedTransformat
 	
 	_sigma.clear();
 	//_sigma.resize(n);
+	_entry_size = 0;
 	unsigned int count = n;
 	for (unsigned int i=0;i<count;i++)
 	{
@@ -76,6 +94,16 @@ void shacham_waters_private_data::tag::deserialize(CryptoPP::BufferedTransformat
 		
 		n = ntohl(n);
 		
+		// the entries are fixed size if they all have the size of the first
+		if (i == 0)
+		{
+			_entry_size = n;
+		}
+		else if (n != _entry_size)
+		{
+			_entry_size = 0;
+		}
+		
 		//std::cout << "Decoding sigma_" << i << " in " << n << " bytes." << std::endl;
 		// check size
 		//_sigma[i].Decode(bt,n);
@@ -93,10 +121,12 @@ void shacham_waters_private_data::state::copy(const state &s)
 	_n = s._n;
 	_alpha = s._alpha;
 	_f = s._f;
+	_alpha_epoch = s._alpha_epoch;
+	_f_runs = s._f_runs;
 	if (s._raw.get())
 	{
 		_raw_sz = s._raw_sz;
-		_raw = smart_buffer(new unsigned char[_raw_sz]);
+		_raw = pooled_buffer(buffer_pool::allocate(_raw_sz));
 		memcpy(_raw.get(),s._raw.get(),_raw_sz);
 	}
 	_encrypted_and_signed = s._encrypted_and_signed;
@@ -108,14 +138,14 @@ shacham_waters_private_data::state& shacham_waters_private_data::state::operator
 	return *this;
 }
 
-inline CryptoPP::Integer shacham_waters_private_data::state::f(unsigned int i) const
-{
-	return _f.evaluate(i);
-}
-
-inline CryptoPP::Integer shacham_waters_private_data::state::alpha(unsigned int i) const
+bool shacham_waters_private_data::state::operator==(const shacham_waters_private_data::state &other) const
 {
-	return _alpha.evaluate(i);
+	if (!_encrypted_and_signed || !other._encrypted_and_signed)
+	{
+		throw std::runtime_error("in shacham_waters_private_data::state::operator==, states must be encrypted prior to comparison.");
+	}
+	
+	return _raw_sz == other._raw_sz && memcmp(_raw.get(),other._raw.get(),_raw_sz) == 0;
 }
 
 void shacham_waters_private_data::state::serialize(CryptoPP::BufferedTransformation &bt) const
@@ -152,7 +182,7 @@ void shacham_waters_private_data::state::deserialize(CryptoPP::BufferedTransform
 	}
 	//std::cout << "Read raw size: " << _raw_sz << std::endl;
 	
-	_raw = smart_buffer(new unsigned char[_raw_sz]);
+	_raw = pooled_buffer(buffer_pool::allocate(_raw_sz));
 	
 	// get the raw data
 	if (bt.Get(_raw.get(),_raw_sz) != _raw_sz)
@@ -173,7 +203,7 @@ void shacham_waters_private_data::state::encrypt_and_sign(byte k_enc[shacham_wat
 	CryptoPP::AutoSeededRandomPool rng;
 	// generate an IV
 	unsigned int iv_sz = e.DefaultIVLength();
-	smart_buffer iv(new unsigned char[iv_sz]);
+	pooled_buffer iv(buffer_pool::allocate(iv_sz));
 	
 	if (convergent_encryption)
 	{
@@ -187,7 +217,7 @@ void shacham_waters_private_data::state::encrypt_and_sign(byte k_enc[shacham_wat
 	e.SetKeyWithIV(k_enc,shacham_waters_private_data::key_size,iv.get(),iv_sz);
 	
 	// raw format:
-	// [signed_size,signed_data([n,iv_size,iv,encrypted_size,encrypted_data([f_key_size,f_key,alpha_key_size,alpha_key])]),mac_size,mac]
+	// [signed_size,signed_data([n,iv_size,iv,encrypted_size,encrypted_data([f_key_size,f_key,alpha_key_size,alpha_key,alpha_epoch,run_count,runs])]),mac_size,mac]
 	
 	// raw size:
 	// signed_size : 4 bytes
@@ -199,6 +229,9 @@ void shacham_waters_private_data::state::encrypt_and_sign(byte k_enc[shacham_wat
 	// f_key : key_size bytes
 	// alpha_key_size : 4 bytes
 	// alpha_key : alpha_size bytes
+	// alpha_epoch : 4 bytes
+	// run_count : 4 bytes
+	// runs : 12 bytes each, the first chunk and the version of f
 	// mac_size : 4 bytes
 	// mac : mac_size bytes
 	
@@ -227,6 +260,21 @@ void shacham_waters_private_data::state::encrypt_and_sign(byte k_enc[shacham_wat
 		ef.Put(_alpha.get_key(),_alpha.get_key_size());
 	}
 	
+	n = htonl(_alpha_epoch);
+	ef.PutWord32(n);
+	
+	n = htonl(_f_runs.size());
+	ef.PutWord32(n);
+	for (std::vector<f_run>::const_iterator r = _f_runs.begin();r != _f_runs.end();++r)
+	{
+		n = htonl(r->first);
+		ef.PutWord32(n);
+		n = htonl((unsigned int)(r->version >> 32));
+		ef.PutWord32(n);
+		n = htonl((unsigned int)r->version);
+		ef.PutWord32(n);
+	}
+	
 	ef.MessageEnd();
 	// finished encrypting
 	
@@ -298,7 +346,7 @@ void shacham_waters_private_data::state::encrypt_and_sign(byte k_enc[shacham_wat
 	
 	// now write raw
 	_raw_sz = raw_data.length();
-	_raw = smart_buffer(new unsigned char[_raw_sz]);
+	_raw = pooled_buffer(buffer_pool::allocate(_raw_sz));
 	
 	memcpy(_raw.get(),raw_data.c_str(),_raw_sz);
 	
@@ -315,35 +363,35 @@ bool shacham_waters_private_data::state::check_sig_and_decrypt(byte k_enc[shacha
 	
 	CryptoPP::CFB_Mode< CryptoPP::AES >::Decryption d;
 	CryptoPP::HMAC< CryptoPP::SHA256 > hmac(k_mac,shacham_waters_private_data::key_size);
-
-	CryptoPP::StringSource raw_source(_raw.get(),_raw_sz,true);
-	
-	std::string sig_data;
-	std::string mac_data;
-	std::string enc_data;
 	
-	unsigned int n;
+	// the raw data is read where it lies rather than copied out through
+	// filters and strings
+	const unsigned char *raw = _raw.get();
+	size_t pos = 0;
 	
 	// get signed data size
-	if (raw_source.GetWord32(n) != sizeof(unsigned int))
+	if (_raw_sz - pos < sizeof(unsigned int))
 	{
 		throw std::runtime_error("Unable to get signed data size.");
 	}
-	unsigned int sig_data_size = ntohl(n);
+	unsigned int sig_data_size = serialized_word32(raw + pos);
+	pos += sizeof(unsigned int);
 	
 	// get signed data
-	CryptoPP::StringSink sig_sink(sig_data);
-	if (raw_source.TransferTo(sig_sink,(CryptoPP::lword)sig_data_size) != sig_data_size)
+	if (_raw_sz - pos < sig_data_size)
 	{
 		throw std::runtime_error("Incorrect size transferred.");
 	}
+	const unsigned char *sig_data = raw + pos;
+	pos += sig_data_size;
 	
 	// get mac size
-	if (raw_source.GetWord32(n) != sizeof(unsigned int))
+	if (_raw_sz - pos < sizeof(unsigned int))
 	{
 		throw std::runtime_error("Unable to get mac size.");
 	}
-	unsigned int mac_size = ntohl(n);
+	unsigned int mac_size = serialized_word32(raw + pos);
+	pos += sizeof(unsigned int);
 	
 	if (mac_size != hmac.DigestSize())
 	{
@@ -352,91 +400,219 @@ bool shacham_waters_private_data::state::check_sig_and_decrypt(byte k_enc[shacha
 	}
 	
 	// get mac
-	CryptoPP::StringSink mac_sink(mac_data);
-	if (raw_source.TransferTo(mac_sink,(CryptoPP::lword)mac_size) != mac_size)
+	if (_raw_sz - pos < mac_size)
 	{
 		throw std::runtime_error("Incorrect size transferred.");
 	}
 	
-	/*
-	std::string str0,str1,str2;
-	
-	std::cout << "during decoding: " << std::endl;
-	CryptoPP::StringSource s0(k_mac, shacham_waters_private_data::key_size, true,new CryptoPP::HexEncoder(new CryptoPP::StringSink(str0),true,2,":"));
-	std::cout << "key = " << str0 << std::endl;
-	std::cout << "sig_data.length() = " << sig_data.length() << std::endl;
-	CryptoPP::StringSource s1(sig_data, true,new CryptoPP::HexEncoder(new CryptoPP::StringSink(str1),true,2,":"));
-	std::cout << "sig_data = " << str1 << std::endl;
-	std::cout << "mac_data.length() = " << mac_data.length() << std::endl;
-	CryptoPP::StringSource s2(mac_data, true,new CryptoPP::HexEncoder(new CryptoPP::StringSink(str2),true,2,":"));
-	std::cout << "mac_data = " << str2 << std::endl;
-	*/
-	
 	// check signed data
-	CryptoPP::HashVerificationFilter hf(hmac, NULL, CryptoPP::HashVerificationFilter::PUT_RESULT|CryptoPP::HashVerificationFilter::HASH_AT_END);
-	
-	CryptoPP::StringSource(sig_data+mac_data, true,
-		new CryptoPP::Redirector(hf));
-	
-	if (!hf.GetLastResult())
+	if (!hmac.VerifyDigest(raw + pos,sig_data,sig_data_size))
 	{
 		// authentication failed
 		return false;
 	}
 	
-	
-	// parse signed data
-	CryptoPP::StringSource sig_source(sig_data,true);
+	// parse signed data.  sizes in it are authenticated, but are still
+	// checked against the data they describe
+	pos = 0;
+	auto take = [](const unsigned char *data, size_t sz, size_t &pos, size_t n)
+	{
+		if (sz - pos < n)
+		{
+			throw std::runtime_error("Signed state data is malformed.");
+		}
+		pos += n;
+		return data + pos - n;
+	};
 	
 	// get n
-	sig_source.GetWord32(n);
-	_n = ntohl(n);
-	
-	// get iv size
-	sig_source.GetWord32(n);
-	unsigned int iv_sz = ntohl(n);
-	smart_buffer iv(new unsigned char[iv_sz]);
+	_n = serialized_word32(take(sig_data,sig_data_size,pos,sizeof(unsigned int)));
 	
 	// get iv
-	sig_source.Get(iv.get(),iv_sz);
+	unsigned int iv_sz = serialized_word32(take(sig_data,sig_data_size,pos,sizeof(unsigned int)));
+	const unsigned char *iv = take(sig_data,sig_data_size,pos,iv_sz);
 	
 	// set up decryption
-	d.SetKeyWithIV(k_enc,shacham_waters_private_data::key_size,iv.get(),iv_sz);
+	d.SetKeyWithIV(k_enc,shacham_waters_private_data::key_size,iv,iv_sz);
 	
-	// get encrypted data size
-	sig_source.GetWord32(n);
-	unsigned int enc_sz = ntohl(n);
+	// get encrypted data and decrypt it
+	unsigned int enc_sz = serialized_word32(take(sig_data,sig_data_size,pos,sizeof(unsigned int)));
+	const unsigned char *enc_data = take(sig_data,sig_data_size,pos,enc_sz);
 	
-	CryptoPP::StreamTransformationFilter df(d);
+	pooled_buffer plain(buffer_pool::allocate(enc_sz));
+	d.ProcessData(plain.get(),enc_data,enc_sz);
+	pos = 0;
 	
-	sig_source.TransferTo(df,(CryptoPP::lword)enc_sz);
+	// get f key
+	unsigned int n = serialized_word32(take(plain.get(),enc_sz,pos,sizeof(unsigned int)));
+	const unsigned char *key = take(plain.get(),enc_sz,pos,n);
 	
-	// get f_key size
-	df.GetWord32(n);
-	n = ntohl(n);
-	smart_buffer key(new unsigned char[n]);
+	if (n > 0)
+	{
+		set_f_key(key,n);
+	}
 	
-	df.Get(key.get(),n);
+	// get alpha key
+	n = serialized_word32(take(plain.get(),enc_sz,pos,sizeof(unsigned int)));
+	key = take(plain.get(),enc_sz,pos,n);
 	
 	if (n > 0)
 	{
-		set_f_key(key.get(),n);
+		set_alpha_key(key,n);
 	}
 	
-	df.GetWord32(n);
-	n = ntohl(n);
-	key = smart_buffer(new unsigned char[n]);
-	
-	df.Get(key.get(),n);
+	// states sealed before alpha epochs end here
+	_alpha_epoch = pos < enc_sz ? serialized_word32(take(plain.get(),enc_sz,pos,sizeof(unsigned int))) : 0;
 	
-	if (n > 0)
+	// and those sealed before versions of f have no runs
+	_f_runs.clear();
+	if (pos < enc_sz)
 	{
-		set_alpha_key(key.get(),n);
+		unsigned int runs = serialized_word32(take(plain.get(),enc_sz,pos,sizeof(unsigned int)));
+		if (runs > max_f_runs)
+		{
+			throw std::runtime_error("Signed state data is malformed.");
+		}
+		_f_runs.resize(runs);
+		for (unsigned int k=0;k<runs;k++)
+		{
+			f_run &r = _f_runs[k];
+			r.first = serialized_word32(take(plain.get(),enc_sz,pos,sizeof(unsigned int)));
+			r.version = (uint64_t)serialized_word32(take(plain.get(),enc_sz,pos,sizeof(unsigned int))) << 32;
+			r.version |= serialized_word32(take(plain.get(),enc_sz,pos,sizeof(unsigned int)));
+			if (k > 0 && r.first <= _f_runs[k-1].first)
+			{
+				throw std::runtime_error("Signed state data is malformed.");
+			}
+			derive_f_run(r);
+		}
 	}
 	
 	return true;
 }
 
+CryptoPP::Integer shacham_waters_private_data::state::f(unsigned int i) const
+{
+	// the last run starting at or before chunk i
+	std::vector<f_run>::const_iterator r = std::upper_bound(_f_runs.begin(),_f_runs.end(),i,
+		[](unsigned int i, const f_run &r){ return i < r.first; });
+	if (r == _f_runs.begin() || (r-1)->version == 0)
+	{
+		return _f.evaluate(i);
+	}
+	return (r-1)->f.evaluate(i);
+}
+
+void shacham_waters_private_data::state::set_f_limit(CryptoPP::Integer limit)
+{
+	_f.set_limit(limit);
+	for (std::vector<f_run>::iterator r = _f_runs.begin();r != _f_runs.end();++r)
+	{
+		r->f.set_limit(limit);
+	}
+}
+
+void shacham_waters_private_data::state::set_f_key(const unsigned char* key,unsigned int key_length)
+{
+	_f.set_key(key,key_length);
+	for (std::vector<f_run>::iterator r = _f_runs.begin();r != _f_runs.end();++r)
+	{
+		derive_f_run(*r);
+	}
+}
+
+void shacham_waters_private_data::state::derive_f_run(f_run &r) const
+{
+	if (r.version == 0 || _f.get_key_size() == 0)
+	{
+		return;
+	}
+	
+	static const char version_label[] = "heartbeat f version";
+	byte version[8];
+	for (unsigned int k=0;k<sizeof(version);k++)
+	{
+		version[k] = (byte)(r.version >> (56 - 8*k));
+	}
+	
+	byte key[CryptoPP::SHA256::DIGESTSIZE];
+	CryptoPP::HMAC<CryptoPP::SHA256> hmac(_f.get_key(),_f.get_key_size());
+	hmac.Update((const byte*)version_label,sizeof(version_label)-1);
+	hmac.Update(version,sizeof(version));
+	hmac.Final(key);
+	r.f.set_key(key,sizeof(key));
+	
+	// the limit is set with that of f when the state is decrypted
+	if (!_f.get_limit().IsZero())
+	{
+		r.f.set_limit(_f.get_limit());
+	}
+}
+
+void shacham_waters_private_data::state::retag(unsigned int first, unsigned int last)
+{
+	if (first >= last)
+	{
+		return;
+	}
+	
+	// a random version, rather than a count, is new even for a state the
+	// server has rolled back
+	CryptoPP::AutoSeededRandomPool rng;
+	std::vector<f_run> replacement(1);
+	replacement[0].first = first;
+	replacement[0].version = 0;
+	while (replacement[0].version == 0)
+	{
+		rng.GenerateBlock((byte*)&replacement[0].version,sizeof(replacement[0].version));
+	}
+	derive_f_run(replacement[0]);
+	
+	auto before = [](unsigned int i, const f_run &r){ return i < r.first; };
+	
+	// the chunks from last on keep the version they have
+	if (last != all_chunks)
+	{
+		std::vector<f_run>::iterator r = std::upper_bound(_f_runs.begin(),_f_runs.end(),last,before);
+		f_run rest;
+		rest.version = 0;
+		if (r != _f_runs.begin())
+		{
+			rest = *(r-1);
+		}
+		rest.first = last;
+		replacement.push_back(rest);
+	}
+	
+	std::vector<f_run>::iterator lo = std::lower_bound(_f_runs.begin(),_f_runs.end(),first,
+		[](const f_run &r, unsigned int i){ return r.first < i; });
+	std::vector<f_run>::iterator hi = std::upper_bound(lo,_f_runs.end(),last,before);
+	lo = _f_runs.erase(lo,hi);
+	_f_runs.insert(lo,replacement.begin(),replacement.end());
+	
+	// a run which continues the version before it is merged into that run
+	size_t k = 0;
+	uint64_t previous = 0;
+	for (size_t j=0;j<_f_runs.size();j++)
+	{
+		if (_f_runs[j].version != previous)
+		{
+			previous = _f_runs[j].version;
+			if (k != j)
+			{
+				_f_runs[k] = _f_runs[j];
+			}
+			k++;
+		}
+	}
+	_f_runs.resize(k);
+	
+	if (_f_runs.size() > max_f_runs)
+	{
+		throw std::runtime_error("The file has been rewritten in too many places.  It should be encoded again.");
+	}
+}
+
 void shacham_waters_private_data::state::public_interpretation()
 {
 	if (!_encrypted_and_signed)
@@ -462,20 +638,48 @@ void shacham_waters_private_data::state::public_interpretation()
 inline void shacham_waters_private_data::challenge::set_key(const unsigned char* key,unsigned int key_length)
 {
 	_key_sz = key_length;
-	_key = smart_buffer(new unsigned char[_key_sz]);
+	_key = pooled_buffer(buffer_pool::allocate(_key_sz));
 	memcpy(_key.get(),key,_key_sz);
 }
 
+bool shacham_waters_private_data::challenge::operator==(const shacham_waters_private_data::challenge &other) const
+{
+	if (_l != other._l || _key_sz != other._key_sz || _distinct != other._distinct)
+	{
+		return false;
+	}
+	
+	if (_key_sz > 0 && memcmp(_key.get(),other._key.get(),_key_sz) != 0)
+	{
+		return false;
+	}
+	
+	return _v_max == other._v_max;
+}
+
 void shacham_waters_private_data::challenge::serialize(CryptoPP::BufferedTransformation &bt) const
 {
 	// write l
 	unsigned int n = htonl(_l);
 	bt.PutWord32(n);
 
-	// write key size
-	n = htonl(get_key_size());
+	// flags
+	byte f = 0;
+	if (_distinct)
+	{
+		f |= _flag_distinct;
+	}
+	
+	// write key size, marked when flags follow it
+	n = htonl(f ? get_key_size() | _has_flags : get_key_size());
 	bt.PutWord32(n);
 	
+	// write flags
+	if (f)
+	{
+		bt.Put(f);
+	}
+	
 	// write key
 	bt.Put(get_key(),get_key_size());
 	
@@ -508,11 +712,24 @@ void shacham_waters_private_data::challenge::deserialize(CryptoPP::BufferedTrans
 		throw std::runtime_error("Unable to read key size.");
 	}
 	_key_sz = ntohl(n);
+	
+	// read flags, which only marked challenges have
+	byte f = 0;
+	if (_key_sz & _has_flags)
+	{
+		_key_sz &= ~_has_flags;
+		if (bt.Get(f) != 1)
+		{
+			throw std::runtime_error("Unable to read flags.");
+		}
+	}
+	_distinct = (f & _flag_distinct) != 0;
+	
 	if (_key_sz > shacham_waters_private_data::key_size)
 	{
 		throw std::runtime_error("Invalid key size.");
 	}
-	_key = smart_buffer(new unsigned char[_key_sz]);
+	_key = pooled_buffer(buffer_pool::allocate(_key_sz));
 	
 	// read key
 	if (bt.Get(_key.get(),_key_sz) != _key_sz)
@@ -532,6 +749,57 @@ void shacham_waters_private_data::challenge::deserialize(CryptoPP::BufferedTrans
 	_v_max = safe_integer(bt,n);
 }
 
+void shacham_waters_private_data::challenge::get_digest(byte digest[CryptoPP::SHA256::DIGESTSIZE]) const
+{
+	std::string raw;
+	CryptoPP::StringSink ss(raw);
+	serialize(ss);
+	
+	CryptoPP::SHA256 sha;
+	sha.CalculateDigest(digest,(const byte*)raw.data(),raw.size());
+}
+
+bool shacham_waters_private_data::token::matches(const challenge &c) const
+{
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	c.get_digest(digest);
+	return memcmp(digest,_digest,sizeof(_digest)) == 0;
+}
+
+void shacham_waters_private_data::token::serialize(CryptoPP::BufferedTransformation &bt) const
+{
+	// write digest
+	bt.Put(_digest,sizeof(_digest));
+	
+	// write sum size
+	unsigned int sum_sz = _sum.MinEncodedSize();
+	unsigned int n = htonl(sum_sz);
+	bt.PutWord32(n);
+	
+	// write sum
+	_sum.Encode(bt,sum_sz);
+}
+
+void shacham_waters_private_data::token::deserialize(CryptoPP::BufferedTransformation &bt)
+{
+	// read digest
+	if (bt.Get(_digest,sizeof(_digest)) != sizeof(_digest))
+	{
+		throw std::runtime_error("Unable to read token digest.");
+	}
+	
+	// read sum size
+	unsigned int n;
+	if (bt.GetWord32(n) != sizeof(unsigned int))
+	{
+		throw std::runtime_error("Unable to read sum size.");
+	}
+	n = ntohl(n);
+	
+	// read sum
+	_sum = safe_integer(bt,n);
+}
+
 void shacham_waters_private_data::proof::serialize(CryptoPP::BufferedTransformation &bt) const
 {
 	unsigned int n = htonl(_mu.size());
@@ -593,8 +861,84 @@ void shacham_waters_private::proof::deserialize(CryptoPP::BufferedTransformation
 	_sigma = safe_integer(bt,n);
 }
 
+// the first primes are the safe primes of the MODP groups of RFC 2409 and RFC
+// 3526, whose derivation from the digits of pi rules out a chosen weak
+// modulus.  the rest are special form primes which reduce much faster
+static const shacham_waters_private::parameter_set parameter_sets[] =
+{
+	{ 1, "modp1024", 1024, 10,
+		"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+		"020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+		"4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED"
+		"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE65381FFFFFFFFFFFFFFFF"
+		"h", 0 },
+	{ 2, "modp1536", 1536, 10,
+		"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+		"020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+		"4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED"
+		"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF05"
+		"98DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB"
+		"9ED529077096966D670C354E4ABC9804F1746C08CA237327FFFFFFFFFFFFFFFF"
+		"h", 0 },
+	{ 3, "modp2048", 2048, 10,
+		"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+		"020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+		"4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED"
+		"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF05"
+		"98DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB"
+		"9ED529077096966D670C354E4ABC9804F1746C08CA18217C32905E462E36CE3B"
+		"E39E772C180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF695581718"
+		"3995497CEA956AE515D2261898FA051015728E5A8AACAA68FFFFFFFFFFFFFFFF"
+		"h", 0 },
+	// 2^255 - 19.  sectors are a quarter the size so there are four times as many
+	{ 4, "p25519", 255, 40,
+		"7FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFED"
+		"h", 19 },
+	// 2^521 - 1
+	{ 5, "p521", 521, 20,
+		"1FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF"
+		"FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF"
+		"FFF"
+		"h", 1 }
+};
+
+const shacham_waters_private::parameter_set *shacham_waters_private::find_parameter_set(unsigned int id)
+{
+	for (size_t i=0;i<sizeof(parameter_sets)/sizeof(parameter_sets[0]);i++)
+	{
+		if (parameter_sets[i].id == id)
+		{
+			return &parameter_sets[i];
+		}
+	}
+	return 0;
+}
+
+const shacham_waters_private::parameter_set *shacham_waters_private::find_parameter_set(const std::string &name)
+{
+	for (size_t i=0;i<sizeof(parameter_sets)/sizeof(parameter_sets[0]);i++)
+	{
+		if (name == parameter_sets[i].name)
+		{
+			return &parameter_sets[i];
+		}
+	}
+	return 0;
+}
+
 void shacham_waters_private::init(double check_fraction, unsigned int sectors, unsigned int prime_size_bytes)
 {
+	// generating a prime takes far longer than anything else here, so use a
+	// standard one of the requested size where there is one
+	for (size_t i=0;i<sizeof(parameter_sets)/sizeof(parameter_sets[0]);i++)
+	{
+		if (parameter_sets[i].prime_bits == prime_size_bytes*8)
+		{
+			init(parameter_sets[i],check_fraction,sectors);
+			return;
+		}
+	}
+	
 	_check_fraction = check_fraction;
 
 	//std::cout << "this = 0x" << std::hex << (int)this << std::endl;
@@ -606,12 +950,15 @@ void shacham_waters_private::init(double check_fraction, unsigned int sectors, u
 	//std::cout << "shacham_waters_private_data::key_size = " << std::dec << shacham_waters_private_data::key_size << std::endl;
 	rng.GenerateBlock(_k_enc,shacham_waters_private_data::key_size);
 	rng.GenerateBlock(_k_mac,shacham_waters_private_data::key_size);
+	rng.GenerateBlock(_k_alpha,shacham_waters_private_data::key_size);
+	_alpha_epoch = 0;
 	
 	//std::cout << "generated keys..." << std::endl;
 	
 	_sectors = sectors;
 	
 	_p = CryptoPP::Integer(rng,0,CryptoPP::Integer::Power2(prime_size_bytes*8),CryptoPP::Integer::PRIME);
+	_params = 0;
 	
 	//std::cout << "generated prime..." << std::endl;
 	
@@ -623,8 +970,62 @@ void shacham_waters_private::init(double check_fraction, unsigned int sectors, u
 	//std::cout << "finished initializing..." << std::endl;
 }
 
+void shacham_waters_private::init(const parameter_set &params, double check_fraction, unsigned int sectors)
+{
+	_check_fraction = check_fraction;
+	
+	CryptoPP::AutoSeededRandomPool rng;
+	rng.GenerateBlock(_k_enc,shacham_waters_private_data::key_size);
+	rng.GenerateBlock(_k_mac,shacham_waters_private_data::key_size);
+	rng.GenerateBlock(_k_alpha,shacham_waters_private_data::key_size);
+	_alpha_epoch = 0;
+	
+	_sectors = sectors ? sectors : params.sectors;
+	_params = &params;
+	_p = CryptoPP::Integer(params.prime);
+	_sector_size = _p.BitCount()/8;
+}
+
+void shacham_waters_private::reduce(CryptoPP::Integer &x) const
+{
+	// negative values, e.g. from a token sum larger than the proof's sigma,
+	// take the general path
+	if (!_params || !_params->c || x.IsNegative())
+	{
+		x %= _p;
+		if (x.IsNegative())
+		{
+			x += _p;
+		}
+		return;
+	}
+	
+	// p = 2^k - c, so for x = h*2^k + l, x = h*c + l mod p.  each step shrinks
+	// x by about k bits
+	unsigned int k = _params->prime_bits;
+	while (x.BitCount() > k)
+	{
+		CryptoPP::Integer h = x >> k;
+		x -= h << k;
+		if (_params->c == 1)
+		{
+			x += h;
+		}
+		else
+		{
+			x += h * CryptoPP::Integer((long)_params->c);
+		}
+	}
+	
+	if (x >= _p)
+	{
+		x -= _p;
+	}
+}
+
 void shacham_waters_private::get_public(shacham_waters_private &h) const
 {
+	h._params = _params;
 	h._check_fraction = _check_fraction;
 	h._p = _p;
 	h._sectors = _sectors;
@@ -633,75 +1034,342 @@ void shacham_waters_private::get_public(shacham_waters_private &h) const
 	// null out keys
 	memset(h._k_enc,0,shacham_waters_private_data::key_size);
 	memset(h._k_mac,0,shacham_waters_private_data::key_size);
+	memset(h._k_alpha,0,shacham_waters_private_data::key_size);
+	h._alpha_epoch = 0;
+}
+
+void shacham_waters_private::rotate_alpha()
+{
+	if (_public)
+	{
+		throw std::runtime_error("Alpha rotation requires the private scheme.");
+	}
+	
+	_alpha_epoch++;
 }
 
 void shacham_waters_private::encode(tag &t, state &s, simple_file &f)
 {
-	//std::cout << "Encoding... " << std::endl;
-	CryptoPP::AutoSeededRandomPool rng;
+	encode<simple_file>(t,s,f);
+}
+
+void shacham_waters_private::cache_key(byte key[cache_key_size], simple_file &f) const
+{
+	if (_public)
+	{
+		throw std::runtime_error("Cache keys require the private scheme.");
+	}
+	
+	static const char cache_label[] = "heartbeat tag cache";
+	CryptoPP::HMAC<CryptoPP::SHA256> hmac(_k_mac,shacham_waters_private_data::key_size);
+	hmac.Update((const byte*)cache_label,sizeof(cache_label)-1);
+	
+	// the parameters fix the tag of the content, with the keys
+	byte sectors[4] = { (byte)(_sectors >> 24), (byte)(_sectors >> 16), (byte)(_sectors >> 8), (byte)_sectors };
+	hmac.Update(sectors,sizeof(sectors));
+	std::vector<byte> p(_p.MinEncodedSize());
+	_p.Encode(&p[0],p.size());
+	hmac.Update(&p[0],p.size());
+	
+	// and the alpha epoch, so a rotation is not undone by the cache
+	byte epoch[4] = { (byte)(_alpha_epoch >> 24), (byte)(_alpha_epoch >> 16), (byte)(_alpha_epoch >> 8), (byte)_alpha_epoch };
+	hmac.Update(epoch,sizeof(epoch));
+	
+	size_t chunk_size = _sectors*_sector_size;
+	pooled_buffer buffer(buffer_pool::allocate(chunk_size));
+	size_t bytes_read = chunk_size;
+	while (bytes_read == chunk_size)
+	{
+		bytes_read = f.read(buffer.get(),chunk_size);
+		hmac.Update(buffer.get(),bytes_read);
+	}
 	
-	//integer_block_file_interface ibf(f);
+	hmac.Final(key);
+}
+
+void shacham_waters_private::gen_state(state &s, size_t size)
+{
+	init_state(s);
 	
-	// split file into sector sized chunks
-	//f.redefine_chunks(_sector_size,_sectors);
+	// encode tags a trailing partial, or empty, chunk
+	s.set_n((unsigned int)(size / (_sectors*_sector_size) + 1));
 	
-	//s.set_n(f.get_chunk_count());
+	s.encrypt_and_sign(_k_enc,_k_mac);
+}
+
+void shacham_waters_private::init_state(state &s) const
+{
+	CryptoPP::AutoSeededRandomPool rng;
 	
 	byte k_prf[shacham_waters_private_data::key_size];
 	rng.GenerateBlock(k_prf,shacham_waters_private_data::key_size);
 	s.set_f_key(k_prf,shacham_waters_private_data::key_size);
 	s.set_f_limit(_p);
 	
+	// the alphas are derived from the alpha key and its epoch, so that all
+	// files encoded in the epoch share alphas and their proofs can be
+	// aggregated
+	static const char alpha_label[] = "heartbeat alpha";
+	byte epoch[4] = { (byte)(_alpha_epoch >> 24), (byte)(_alpha_epoch >> 16), (byte)(_alpha_epoch >> 8), (byte)_alpha_epoch };
 	byte k_alpha[shacham_waters_private_data::key_size];
-	rng.GenerateBlock(k_alpha,shacham_waters_private_data::key_size);
+	CryptoPP::HMAC<CryptoPP::SHA256> hmac(_k_alpha,shacham_waters_private_data::key_size);
+	hmac.Update((const byte*)alpha_label,sizeof(alpha_label)-1);
+	hmac.Update(epoch,sizeof(epoch));
+	hmac.Final(k_alpha);
 	s.set_alpha_key(k_alpha,shacham_waters_private_data::key_size);
 	s.set_alpha_limit(_p);
+	s.set_alpha_epoch(_alpha_epoch);
+}
+
+void shacham_waters_private::encode_range(tag &segment, const state &s_enc, seekable_file &f, unsigned int first, unsigned int count)
+{
+	state s;
+	if (!decrypt_state(s,s_enc))
+	{
+		throw std::runtime_error("Signature check or decryption failed in encoding.  State of remote file cannot be verified.");
+	}
+	
+	std::vector<std::pair<unsigned int,unsigned int> > range(1,std::make_pair(first,first + count));
+	if (range[0].second < first)
+	{
+		throw std::runtime_error("Chunk range is outside of the file.");
+	}
 	
+	segment.sigma().clear();
+	segment.set_entry_size(_p.MinEncodedSize());
+	tag_ranges(s,f,range,[&](unsigned int, const CryptoPP::Integer &sigma)
+	{
+		segment.sigma().push_back(sigma);
+	});
+}
+
+void shacham_waters_private::merge_tags(tag &t, const std::vector<const tag*> &segments)
+{
 	t.sigma().clear();
-	//t.sigma().resize(f.get_chunk_count());
+	t.set_entry_size(0);
+	for (size_t k=0;k<segments.size();k++)
+	{
+		t.sigma().insert(t.sigma().end(),segments[k]->sigma().begin(),segments[k]->sigma().end());
+		t.set_entry_size(std::max(t.entry_size(),segments[k]->entry_size()));
+	}
+}
+
+void shacham_waters_private::encode_checkpointed(tag &t, state &s, simple_file &f, checkpoint_sink &sink, unsigned int interval)
+{
+	init_state(s);
 	
-	//std::cout << "Chunks: " << f.get_chunk_count() << std::endl;
-	//std::cout << "Sectors per chunk: " << f.get_sectors_per_chunk() << std::endl;
-	smart_buffer buffer(new unsigned char[_sector_size]);
+	t.sigma().clear();
 	
-	size_t bytes_read = 0;
-	bool done = false;
-	unsigned int chunk_id = 0;
+	encode_chunks(t,s,f,&sink,interval);
 	
-	//for (unsigned int i=0;i<f.get_chunk_count();i++)
-	while (!done)
+	s.encrypt_and_sign(_k_enc,_k_mac);
+}
+
+void shacham_waters_private::resume_encode(tag &t, state &s, simple_file &tail, checkpoint_sink *sink, unsigned int interval)
+{
+	state decrypted;
+	if (!decrypt_state(decrypted,s))
 	{
-		//t.sigma().at(i) = s.f(i);
-		CryptoPP::Integer sigma = s.f(chunk_id);
-		for (unsigned int j=0;j<_sectors;j++)
+		throw std::runtime_error("Signature check or decryption failed in resuming.  State of remote file cannot be verified.");
+	}
+	
+	if (t.sigma().size() != decrypted.get_n())
+	{
+		throw std::runtime_error("Tag does not match state.");
+	}
+	
+	encode_chunks(t,decrypted,tail,sink,interval);
+	
+	decrypted.encrypt_and_sign(_k_enc,_k_mac);
+	s = decrypted;
+}
+
+size_t shacham_waters_private::append_offset(const tag &t) const
+{
+	if (t.sigma().empty())
+	{
+		return 0;
+	}
+	return (t.sigma().size() - 1) * _sectors * _sector_size;
+}
+
+void shacham_waters_private::encode_append(tag &t, state &s, simple_file &tail)
+{
+	state decrypted;
+	if (!decrypt_state(decrypted,s))
+	{
+		throw std::runtime_error("Signature check or decryption failed in appending.  State of remote file cannot be verified.");
+	}
+	
+	if (t.sigma().size() != decrypted.get_n() || t.sigma().empty())
+	{
+		throw std::runtime_error("Tag does not match state.");
+	}
+	
+	// the last chunk is partial, or empty, and is tagged again with the
+	// appended data, under a new version of f
+	t.sigma().pop_back();
+	decrypted.retag(t.sigma().size(),state::all_chunks);
+	
+	encode_chunks(t,decrypted,tail);
+	
+	decrypted.encrypt_and_sign(_k_enc,_k_mac);
+	s = decrypted;
+}
+
+CryptoPP::Integer shacham_waters_private::chunk_sigma(const state &s, const std::vector<CryptoPP::Integer> &alpha, unsigned int i, const unsigned char *chunk, size_t sz) const
+{
+	CryptoPP::Integer sigma = s.f(i);
+	CryptoPP::Integer sector;
+	for (unsigned int j=0;j<_sectors && j*_sector_size < sz;j++)
+	{
+		size_t sector_sz = std::min(_sector_size,sz - j*_sector_size);
+		if (!is_zero(chunk + j*_sector_size,sector_sz))
 		{
-			bytes_read = f.read(buffer.get(),_sector_size);
-			
-			if (bytes_read > 0)
-			{
-				//t.sigma().at(i) += s.alpha(j) * ibf.get_sector(i,j);
-				sigma += s.alpha(j) * CryptoPP::Integer(buffer.get(),bytes_read);
-				//t.sigma().at(i) %= _p;
-				sigma %= _p;
-			}
-			
-			if (bytes_read != _sector_size)
+			sector.Decode(chunk + j*_sector_size,sector_sz);
+			sigma += alpha[j] * sector;
+		}
+	}
+	// each product is below p^2, so the sum is reduced once for the chunk
+	reduce(sigma);
+	return sigma;
+}
+
+template <typename Patch>
+void shacham_waters_private::tag_ranges(const state &s, seekable_file &f, const std::vector<std::pair<unsigned int,unsigned int> > &ranges, Patch patch) const
+{
+	size_t chunk_size = _sectors*_sector_size;
+	unsigned int n = s.get_n();
+	
+	// the file must still have n chunks, the last of them partial or empty
+	f.seek(0);
+	size_t file_size = f.bytes_remaining();
+	if (n == 0 || file_size < (size_t)(n - 1) * chunk_size || file_size >= (size_t)n * chunk_size)
+	{
+		throw std::runtime_error("File size does not match state.");
+	}
+	
+	check_ranges(ranges,n);
+	
+	pooled_buffer buffer(buffer_pool::allocate(chunk_size));
+	
+	std::vector<CryptoPP::Integer> alpha(_sectors);
+	for (unsigned int j=0;j<_sectors;j++)
+	{
+		alpha[j] = s.alpha(j);
+	}
+	
+	for (size_t k=0;k<ranges.size();k++)
+	{
+		for (unsigned int i=ranges[k].first;i<ranges[k].second;i++)
+		{
+			size_t pos = (size_t)i*chunk_size;
+			size_t bytes_read = f.seek(pos) == pos ? read_chunk(f,buffer.get(),chunk_size) : 0;
+			patch(i,chunk_sigma(s,alpha,i,buffer.get(),bytes_read));
+		}
+	}
+}
+
+void shacham_waters_private::update_chunks(tag &t, state &s, seekable_file &f, const std::vector<std::pair<unsigned int,unsigned int> > &ranges)
+{
+	state decrypted;
+	if (!decrypt_state(decrypted,s))
+	{
+		throw std::runtime_error("Signature check or decryption failed in updating.  State of remote file cannot be verified.");
+	}
+	
+	if (t.sigma().size() != decrypted.get_n())
+	{
+		throw std::runtime_error("Tag does not match state.");
+	}
+	
+	check_ranges(ranges,decrypted.get_n());
+	retag_ranges(decrypted,ranges);
+	
+	// the tag is only patched once every chunk has been read
+	std::vector<std::pair<unsigned int,CryptoPP::Integer> > patches;
+	tag_ranges(decrypted,f,ranges,[&](unsigned int i, const CryptoPP::Integer &sigma)
+	{
+		patches.push_back(std::make_pair(i,sigma));
+	});
+	
+	decrypted.encrypt_and_sign(_k_enc,_k_mac);
+	for (size_t k=0;k<patches.size();k++)
+	{
+		t.sigma()[patches[k].first] = patches[k].second;
+	}
+	s = decrypted;
+}
+
+void shacham_waters_private::update_serialized_chunks(unsigned char *t, size_t sz, state &s_enc, seekable_file &f, const std::vector<std::pair<unsigned int,unsigned int> > &ranges)
+{
+	state s;
+	if (!decrypt_state(s,s_enc))
+	{
+		throw std::runtime_error("Signature check or decryption failed in updating.  State of remote file cannot be verified.");
+	}
+	
+	// the entries are all the size of the first, which fixes the size of
+	// the serialized tag, and must have room for any sigma
+	unsigned int entry_size = 0;
+	if (sz >= tag::entry_offset(1,0))
+	{
+		entry_size = serialized_word32(t + 4);
+	}
+	if (entry_size < _p.MinEncodedSize() || sz != tag::entry_offset(s.get_n(),entry_size))
+	{
+		throw std::runtime_error("Tag does not match state or does not have fixed size entries.");
+	}
+	
+	// every entry to be patched must be checked before any is written
+	check_ranges(ranges,s.get_n());
+	for (size_t k=0;k<ranges.size();k++)
+	{
+		for (unsigned int i=ranges[k].first;i<ranges[k].second;i++)
+		{
+			if (serialized_word32(t + tag::entry_offset(i,entry_size)) != entry_size)
 			{
-				done = true;
-				break;
+				throw std::runtime_error("Tag does not have fixed size entries.");
 			}
 		}
-		t.sigma().push_back(sigma);
-		chunk_id++;
-		//std::cout << "sigma_" << i << " = " << t.sigma().at(i) << std::endl;
 	}
 	
-	s.set_n(chunk_id);
+	retag_ranges(s,ranges);
+	
+	std::vector<std::pair<unsigned int,CryptoPP::Integer> > patches;
+	tag_ranges(s,f,ranges,[&](unsigned int i, const CryptoPP::Integer &sigma)
+	{
+		patches.push_back(std::make_pair(i,sigma));
+	});
 	
 	s.encrypt_and_sign(_k_enc,_k_mac);
+	for (size_t k=0;k<patches.size();k++)
+	{
+		patches[k].second.Encode(t + tag::entry_offset(patches[k].first,entry_size) + 4,entry_size);
+	}
+	s_enc = s;
+}
+
+void shacham_waters_private::check_ranges(const std::vector<std::pair<unsigned int,unsigned int> > &ranges, unsigned int n)
+{
+	for (size_t k=0;k<ranges.size();k++)
+	{
+		if (ranges[k].first > ranges[k].second || ranges[k].second > n)
+		{
+			throw std::runtime_error("Chunk range is outside of the file.");
+		}
+	}
 }
 
-void shacham_waters_private::gen_challenge(challenge &c, const state &s_enc)
+void shacham_waters_private::retag_ranges(state &s, const std::vector<std::pair<unsigned int,unsigned int> > &ranges)
+{
+	for (size_t k=0;k<ranges.size();k++)
+	{
+		s.retag(ranges[k].first,ranges[k].second);
+	}
+}
+
+void shacham_waters_private::gen_challenge(challenge &c, const state &s_enc, bool distinct)
 {
 	state s = s_enc;
 	// decrypt and check sig of state
@@ -709,11 +1377,16 @@ void shacham_waters_private::gen_challenge(challenge &c, const state &s_enc)
 	{
 		throw std::runtime_error("Signature check or decryption failed in generating challenge.  State of remote file cannot be verified.");
 	}
+	gen_challenge_decrypted(c,s,distinct);
+}
+
+void shacham_waters_private::gen_challenge_decrypted(challenge &c, const state &s, bool distinct) const
+{
 	unsigned int l = (unsigned int)(_check_fraction * s.get_n());
-	gen_challenge(c,l,_p);
+	gen_challenge(c,l,_p,distinct);
 }
 
-void shacham_waters_private::gen_challenge(challenge &c, unsigned int l, const CryptoPP::Integer &B)
+void shacham_waters_private::gen_challenge(challenge &c, unsigned int l, const CryptoPP::Integer &B, bool distinct)
 {
 	//std::cout << "Generating challenge..." << std::endl;
 	
@@ -726,113 +1399,468 @@ void shacham_waters_private::gen_challenge(challenge &c, unsigned int l, const C
 	
 	c.set_key(k,shacham_waters_private_data::key_size);
 	c.set_v_limit(B);
+	c.set_distinct(distinct);
+}
+
+void shacham_waters_private::challenged_chunks(std::vector<std::pair<unsigned int,unsigned int> > &chunks, const challenge &c, unsigned int n, bool sorted)
+{
+	bool check_all = c.get_l() >= n;
+	unsigned int l = check_all ? n : c.get_l();
+	
+	chunks.clear();
+	chunks.reserve(l);
+	
+	if (check_all)
+	{
+		for (unsigned int i=0;i<l;i++)
+		{
+			chunks.push_back(std::make_pair(i,i));
+		}
+	}
+	else if (c.distinct())
+	{
+		keyed_permutation pi;
+		pi.set_key(c.get_key(),c.get_key_size());
+		pi.set_limit(n);
+		
+		for (unsigned int i=0;i<l;i++)
+		{
+			chunks.push_back(std::make_pair(pi.evaluate(i),i));
+		}
+	}
+	else
+	{
+		// serializer cannot get indexer limits, so we manually set here
+		prf indexer;
+		indexer.set_key(c.get_key(),c.get_key_size());
+		indexer.set_limit(n);
+		
+		for (unsigned int i=0;i<l;i++)
+		{
+			chunks.push_back(std::make_pair((unsigned int)indexer.evaluate(i).ConvertToLong(),i));
+		}
+	}
+	
+	if (sorted && !check_all)
+	{
+		std::sort(chunks.begin(),chunks.end());
+	}
 }
 
 void shacham_waters_private::prove(proof &p, seekable_file &f, const challenge &c, const tag &t)
 {
-	//std::cout << "Proving existence..." << std::endl;
-	//integer_block_file_interface ibf(f);
+	prove_partial(p,f,c,t,0,t.sigma().size());
+}
+
+void shacham_waters_private::combine_proofs(proof &p, const std::vector<const proof*> &partials) const
+{
+	p.mu().assign(_sectors,CryptoPP::Integer::Zero());
+	p.sigma() = CryptoPP::Integer::Zero();
 	
-	//f.redefine_chunks(_sector_size,_sectors);
+	for (size_t i=0;i<partials.size();i++)
+	{
+		if (partials[i]->mu().size() != _sectors)
+		{
+			throw std::runtime_error("Proof has the wrong number of sectors.");
+		}
+		
+		for (unsigned int j=0;j<_sectors;j++)
+		{
+			p.mu()[j] += partials[i]->mu()[j];
+			reduce(p.mu()[j]);
+		}
+		p.sigma() += partials[i]->sigma();
+		reduce(p.sigma());
+	}
+}
+
+bool shacham_waters_private::verify(const proof &p, const challenge &c, const state &s_enc)
+{
+	//std::cout << "Verifying proof..." << std::endl;
+	state s;
 	
-	unsigned int chunk_size = _sectors*_sector_size;
-	smart_buffer buffer(new unsigned char[_sector_size]);
+	if (!decrypt_state(s,s_enc))
+	{
+		//std::cout << "Signature check or decryption failed." << std::endl;
+		return false;
+	}
 	
-	// serializer cannot get indexer limits, so we manually set here
-	prf indexer;
-	indexer.set_key(c.get_key(),c.get_key_size());
-	indexer.set_limit(t.sigma().size());
+	return verify_decrypted(p,c,s);
+}
+
+bool shacham_waters_private::decrypt_state(state &s, const state &s_enc)
+{
+	s = s_enc;
 	
-	prf v;
-	v.set_key(c.get_key(),c.get_key_size());
-	v.set_limit(c.get_v_limit());
+	// decrypt and check sig of state
+	if (s.encrypted() && !s.check_sig_and_decrypt(_k_enc,_k_mac))
+	{
+		return false;
+	}
 	
+	// serializer will not get manual limits, ensure they are set here
+	s.set_f_limit(_p);
+	s.set_alpha_limit(_p);
 	
-	p.mu().clear();
-	p.mu().resize(_sectors);
+	return true;
+}
+
+bool shacham_waters_private::verify_decrypted(const proof &p, const challenge &c, const state &s)
+{
+	if (p.mu().size() != _sectors)
+	{
+		return false;
+	}
 	
-	bool check_all = c.get_l() >= t.sigma().size();
-	unsigned int n = check_all ? t.sigma().size() : c.get_l();
-	//std::cout << "Sectors: " << _sectors << std::endl;
-	for (unsigned int j=0;j<_sectors;j++)
+	return verify_sectors(p,s,challenge_sum(c,s));
+}
+
+void shacham_waters_private::gen_token(token &k, const challenge &c, const state &s_enc)
+{
+	state s;
+	if (!decrypt_state(s,s_enc))
+	{
+		throw std::runtime_error("Signature check or decryption failed in generating token.  State of remote file cannot be verified.");
+	}
+	
+	gen_token_decrypted(k,c,s);
+}
+
+void shacham_waters_private::gen_token_decrypted(token &k, const challenge &c, const state &s) const
+{
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	c.get_digest(digest);
+	
+	k.set_digest(digest);
+	k.sum() = challenge_sum(c,s);
+}
+
+bool shacham_waters_private::verify_token(const proof &p, const challenge &c, const token &k, const state &s_enc)
+{
+	state s;
+	
+	if (!decrypt_state(s,s_enc))
 	{
-		//p.mu().at(j) = CryptoPP::Integer(); // this is called implicitly
-		for (unsigned int i=0;i<n;i++)
+		return false;
+	}
+	
+	return verify_token_decrypted(p,c,k,s);
+}
+
+bool shacham_waters_private::verify_token_decrypted(const proof &p, const challenge &c, const token &k, const state &s)
+{
+	if (p.mu().size() != _sectors || !k.matches(c))
+	{
+		return false;
+	}
+	
+	return verify_sectors(p,s,k.sum());
+}
+
+void shacham_waters_private::verify_batch(std::vector<unsigned char> &valid, const std::vector<const proof*> &proofs, const std::vector<const challenge*> &challenges, const std::vector<const state*> &states, const std::vector<const token*> &tokens)
+{
+	size_t n = proofs.size();
+	if (challenges.size() != n || states.size() != n || (!tokens.empty() && tokens.size() != n))
+	{
+		throw std::runtime_error("Batch verification needs a challenge and state for each proof.");
+	}
+	
+	valid.assign(n,0);
+	
+	// decrypt each distinct state once
+	std::map<const state*,size_t> state_index;
+	std::vector<state> decrypted;
+	std::vector<unsigned char> decrypted_valid;
+	
+	std::vector<batch_item> items;
+	std::vector<size_t> item_index;
+	
+	// items point into decrypted, so it must not reallocate
+	decrypted.reserve(n);
+	
+	for (size_t i=0;i<n;i++)
+	{
+		std::map<const state*,size_t>::iterator it = state_index.find(states[i]);
+		if (it == state_index.end())
+		{
+			it = state_index.insert(std::make_pair(states[i],decrypted.size())).first;
+			decrypted.push_back(state());
+			decrypted_valid.push_back(decrypt_state(decrypted.back(),*states[i]));
+		}
+		
+		const token *k = tokens.empty() ? 0 : tokens[i];
+		if (!decrypted_valid[it->second] || (k && !k->matches(*challenges[i])))
+		{
+			continue;
+		}
+		
+		batch_item item;
+		item.p = proofs[i];
+		item.s = &decrypted[it->second];
+		item.sum = k ? k->sum() : challenge_sum(*challenges[i],*item.s);
+		
+		items.push_back(item);
+		item_index.push_back(i);
+	}
+	
+	std::vector<unsigned char> items_valid;
+	verify_combined(items_valid,items);
+	
+	for (size_t j=0;j<items.size();j++)
+	{
+		valid[item_index[j]] = items_valid[j];
+	}
+}
+
+void shacham_waters_private::verify_combined(std::vector<unsigned char> &valid, const std::vector<batch_item> &items) const
+{
+	valid.assign(items.size(),0);
+	
+	// the alphas of each distinct state
+	std::map<const state*,size_t> state_index;
+	std::vector<std::vector<CryptoPP::Integer> > alphas;
+	
+	// for each item sigma - sum, the part which must equal alpha . mu,
+	// weighted by a random coefficient r, and the state of the item
+	std::vector<CryptoPP::Integer> residual;
+	std::vector<CryptoPP::Integer> r;
+	std::vector<size_t> item_state;
+	std::vector<size_t> candidates;
+	
+	CryptoPP::AutoSeededRandomPool rng;
+	byte random[16];
+	
+	for (size_t i=0;i<items.size();i++)
+	{
+		if (items[i].p->mu().size() != _sectors || items[i].p->sigma() >= _p)
+		{
+			residual.push_back(CryptoPP::Integer::Zero());
+			r.push_back(CryptoPP::Integer::Zero());
+			item_state.push_back(0);
+			continue;
+		}
+		
+		std::map<const state*,size_t>::iterator it = state_index.find(items[i].s);
+		if (it == state_index.end())
+		{
+			it = state_index.insert(std::make_pair(items[i].s,alphas.size())).first;
+			alphas.push_back(std::vector<CryptoPP::Integer>(_sectors));
+			for (unsigned int j=0;j<_sectors;j++)
+			{
+				alphas.back()[j] = items[i].s->alpha(j);
+			}
+		}
+		
+		// the proof can not depend on coefficients drawn after it is made,
+		// so a combination of invalid items passes with negligible chance
+		rng.GenerateBlock(random,sizeof(random));
+		
+		residual.push_back(items[i].p->sigma() + _p - items[i].sum);
+		reduce(residual.back());
+		r.push_back(CryptoPP::Integer(random,sizeof(random)));
+		item_state.push_back(it->second);
+		candidates.push_back(i);
+	}
+	
+	// checks the combination of items[candidates[begin..end)], bisecting on
+	// failure
+	std::vector<std::vector<CryptoPP::Integer> > mu(alphas.size());
+	std::function<void(size_t,size_t)> check = [&](size_t begin,size_t end)
+	{
+		CryptoPP::Integer lhs;
+		std::vector<size_t> used;
+		
+		for (size_t k=begin;k<end;k++)
 		{
-			unsigned int index = check_all ? i : indexer.evaluate(i).ConvertToLong();
-			size_t pos = index*chunk_size + j*_sector_size;
-			if (f.seek(pos) == pos)
+			size_t i = candidates[k];
+			lhs += r[i] * residual[i];
+			
+			std::vector<CryptoPP::Integer> &m = mu[item_state[i]];
+			if (m.empty())
 			{
-				size_t bytes_read = f.read(buffer.get(),_sector_size);
-				p.mu().at(j) += v.evaluate(i) * CryptoPP::Integer(buffer.get(),bytes_read);
-				p.mu().at(j) %= _p;
+				m.resize(_sectors);
+				used.push_back(item_state[i]);
 			}
-			else
+			for (unsigned int j=0;j<_sectors;j++)
 			{
-				break;
+				m[j] += r[i] * items[i].p->mu()[j];
 			}
 		}
-		//std::cout << "mu_" << j << " = " << p.mu().at(j) << std::endl;
+		reduce(lhs);
+		
+		CryptoPP::Integer rhs;
+		for (size_t u=0;u<used.size();u++)
+		{
+			std::vector<CryptoPP::Integer> &m = mu[used[u]];
+			for (unsigned int j=0;j<_sectors;j++)
+			{
+				reduce(m[j]);
+				rhs += alphas[used[u]][j] * m[j];
+				reduce(rhs);
+			}
+			m.clear();
+		}
+		
+		if (lhs == rhs)
+		{
+			for (size_t k=begin;k<end;k++)
+			{
+				valid[candidates[k]] = 1;
+			}
+		}
+		else if (end - begin > 1)
+		{
+			size_t middle = begin + (end - begin) / 2;
+			check(begin,middle);
+			check(middle,end);
+		}
+	};
+	
+	if (!candidates.empty())
+	{
+		check(0,candidates.size());
+	}
+}
+
+void shacham_waters_private::aggregate_weights(std::vector<CryptoPP::Integer> &w, const std::vector<const challenge*> &challenges) const
+{
+	// the weights are keyed by all of the challenges, so no proof can be
+	// made before every challenge is known
+	CryptoPP::SHA256 sha;
+	byte digest[CryptoPP::SHA256::DIGESTSIZE];
+	for (size_t i=0;i<challenges.size();i++)
+	{
+		challenges[i]->get_digest(digest);
+		sha.Update(digest,sizeof(digest));
 	}
+	sha.Final(digest);
+	
+	prf weight;
+	weight.set_key(digest,sizeof(digest));
+	weight.set_limit(_p);
 	
-	//p.sigma() = CryptoPP::Integer();
-	//std::cout << "Calculating sigma... t.sigma().size() = " << t.sigma().size() << std::endl;
-	for (unsigned int i=0;i<n;i++)
+	w.resize(challenges.size());
+	for (size_t i=0;i<challenges.size();i++)
+	{
+		w[i] = weight.evaluate(i);
+	}
+}
+
+void shacham_waters_private::aggregate(proof &p, const std::vector<const proof*> &proofs, const std::vector<const challenge*> &challenges) const
+{
+	if (proofs.size() != challenges.size())
 	{
-		//std::cout << "sigma += v_" << i << " * sigma_" << indexer.evaluate(i) << std::endl;
-		int index = check_all ? i : indexer.evaluate(i).ConvertToLong();
-		p.sigma() += v.evaluate(i) * t.sigma().at(index);
-		p.sigma() %= _p;
+		throw std::runtime_error("An aggregated proof needs a challenge for each proof.");
 	}
 	
-	//std::cout << "sigma = " << p.sigma() << std::endl;
+	std::vector<CryptoPP::Integer> w;
+	aggregate_weights(w,challenges);
+	
+	p.mu().assign(_sectors,CryptoPP::Integer::Zero());
+	p.sigma() = CryptoPP::Integer::Zero();
+	
+	for (size_t i=0;i<proofs.size();i++)
+	{
+		if (proofs[i]->mu().size() != _sectors)
+		{
+			throw std::runtime_error("Proof has the wrong number of sectors.");
+		}
+		
+		for (unsigned int j=0;j<_sectors;j++)
+		{
+			p.mu()[j] += w[i] * proofs[i]->mu()[j];
+			reduce(p.mu()[j]);
+		}
+		p.sigma() += w[i] * proofs[i]->sigma();
+		reduce(p.sigma());
+	}
 }
 
-bool shacham_waters_private::verify(const proof &p, const challenge &c, const state &s_enc)
+void shacham_waters_private::prove_aggregate(proof &p, const std::vector<seekable_file*> &files, const std::vector<const challenge*> &challenges, const std::vector<const tag*> &tags)
 {
-	//std::cout << "Verifying proof..." << std::endl;
-	CryptoPP::Integer rhs;
+	if (files.size() != challenges.size() || files.size() != tags.size())
+	{
+		throw std::runtime_error("An aggregated proof needs a challenge and tag for each file.");
+	}
 	
-	state s = s_enc;
+	std::vector<proof> proofs(files.size());
+	std::vector<const proof*> pointers(files.size());
+	for (size_t i=0;i<files.size();i++)
+	{
+		prove(proofs[i],*files[i],*challenges[i],*tags[i]);
+		pointers[i] = &proofs[i];
+	}
 	
-	// decrypt and check sig of state
-	if (s.encrypted() && !s.check_sig_and_decrypt(_k_enc,_k_mac))
+	aggregate(p,pointers,challenges);
+}
+
+bool shacham_waters_private::verify_aggregate(const proof &p, const std::vector<const challenge*> &challenges, const std::vector<const state*> &states)
+{
+	if (challenges.size() != states.size())
 	{
-		//std::cout << "Signature check or decryption failed." << std::endl;
-		return false;
+		throw std::runtime_error("An aggregated proof needs a state for each challenge.");
 	}
 	
-	if (p.mu().size() != _sectors)
+	if (states.empty() || p.mu().size() != _sectors || p.sigma() >= _p)
 	{
 		return false;
 	}
 	
-	// serializer will not get manual limits, ensure they are set here
-	prf indexer;
-	indexer.set_key(c.get_key(),c.get_key_size());
-	indexer.set_limit(s.get_n());
+	std::vector<CryptoPP::Integer> w;
+	aggregate_weights(w,challenges);
+	
+	// decrypt each distinct state once
+	std::map<const state*,size_t> state_index;
+	std::vector<state> decrypted;
+	decrypted.reserve(states.size());
+	
+	CryptoPP::Integer rhs;
+	for (size_t i=0;i<states.size();i++)
+	{
+		std::map<const state*,size_t>::iterator it = state_index.find(states[i]);
+		if (it == state_index.end())
+		{
+			it = state_index.insert(std::make_pair(states[i],decrypted.size())).first;
+			decrypted.push_back(state());
+			if (!decrypt_state(decrypted.back(),*states[i]) || !decrypted.back().shares_alpha(decrypted.front()))
+			{
+				return false;
+			}
+		}
+		
+		rhs += w[i] * challenge_sum(*challenges[i],decrypted[it->second]);
+		reduce(rhs);
+	}
+	
+	return verify_sectors(p,decrypted.front(),rhs);
+}
+
+CryptoPP::Integer shacham_waters_private::challenge_sum(const challenge &c, const state &s) const
+{
+	CryptoPP::Integer sum;
 	
 	prf v;
 	v.set_key(c.get_key(),c.get_key_size());
 	v.set_limit(c.get_v_limit());
 	
-	s.set_f_limit(_p);
-	s.set_alpha_limit(_p);
-	
-	bool check_all = c.get_l() >= s.get_n();
-	unsigned int n = check_all ? s.get_n() : c.get_l();
+	std::vector<std::pair<unsigned int,unsigned int> > chunks;
+	challenged_chunks(chunks,c,s.get_n(),false);
 	
-	for (unsigned int i=0;i<n;i++)
+	for (size_t k=0;k<chunks.size();k++)
 	{
-		unsigned int index = check_all ? i : indexer.evaluate(i).ConvertToLong();
-		rhs += v.evaluate(i) * s.f(index);
-		rhs %= _p;
+		sum += v.evaluate(chunks[k].second) * s.f(chunks[k].first);
+		reduce(sum);
 	}
 	
+	return sum;
+}
+
+bool shacham_waters_private::verify_sectors(const proof &p, const state &s, CryptoPP::Integer rhs) const
+{
 	for (unsigned int j=0;j<_sectors;j++)
 	{
 		rhs += s.alpha(j) * p.mu().at(j);
-		rhs %= _p;
+		reduce(rhs);
 	}
 	
 	//std::cout << "sigma: " << p.sigma() << std::endl;
@@ -841,12 +1869,36 @@ bool shacham_waters_private::verify(const proof &p, const challenge &c, const st
 	return p.sigma() == rhs;
 }
 
+bool shacham_waters_private::operator==(const shacham_waters_private &other) const
+{
+	if (_public != other._public || _sectors != other._sectors || _sector_size != other._sector_size)
+	{
+		return false;
+	}
+	
+	// keys are only part of the private scheme
+	if (!_public)
+	{
+		if (memcmp(_k_enc,other._k_enc,shacham_waters_private_data::key_size) != 0 ||
+			memcmp(_k_mac,other._k_mac,shacham_waters_private_data::key_size) != 0 ||
+			memcmp(_k_alpha,other._k_alpha,shacham_waters_private_data::key_size) != 0 ||
+			_alpha_epoch != other._alpha_epoch)
+		{
+			return false;
+		}
+	}
+	
+	return _p == other._p;
+}
+
 void shacham_waters_private::serialize(CryptoPP::BufferedTransformation &bt) const
 {
 	unsigned int n;
 	
 	// write flags
 	// 0x01 - public
+	// 0x02 - p is from a parameter set and is written as its id
+	// 0x04 - the alpha key and its epoch follow the other keys
 	
 	byte f = 0x00;
 	
@@ -854,6 +1906,14 @@ void shacham_waters_private::serialize(CryptoPP::BufferedTransformation &bt) con
 	{
 		f |= _flag_public;
 	}
+	else
+	{
+		f |= _flag_alpha_key;
+	}
+	if (_params)
+	{
+		f |= _flag_parameter_set;
+	}
 	
 	bt.Put(f);
 
@@ -873,6 +1933,16 @@ void shacham_waters_private::serialize(CryptoPP::BufferedTransformation &bt) con
 		
 		// write key
 		bt.Put(_k_mac,shacham_waters_private_data::key_size);
+		
+		// write key size
+		bt.PutWord32(n);
+		
+		// write alpha key
+		bt.Put(_k_alpha,shacham_waters_private_data::key_size);
+		
+		// write alpha epoch
+		n = htonl(_alpha_epoch);
+		bt.PutWord32(n);
 	}
 	
 	// write sectors
@@ -883,6 +1953,14 @@ void shacham_waters_private::serialize(CryptoPP::BufferedTransformation &bt) con
 	n = htonl(_sector_size);
 	bt.PutWord32(n);
 	
+	if (_params)
+	{
+		// write parameter set id
+		n = htonl(_params->id);
+		bt.PutWord32(n);
+		return;
+	}
+	
 	// write p size
 	unsigned int p_sz = _p.MinEncodedSize();
 	n = htonl(p_sz);
@@ -893,6 +1971,31 @@ void shacham_waters_private::serialize(CryptoPP::BufferedTransformation &bt) con
 	_p.Encode(bt,p_sz);
 }
 
+void shacham_waters_private::serialize_canonical(CryptoPP::BufferedTransformation &bt) const
+{
+	bt.Put(_public ? _flag_public : 0);
+	
+	unsigned int n;
+	if (!_public)
+	{
+		bt.Put(_k_enc,shacham_waters_private_data::key_size);
+		bt.Put(_k_mac,shacham_waters_private_data::key_size);
+		bt.Put(_k_alpha,shacham_waters_private_data::key_size);
+		n = htonl(_alpha_epoch);
+		bt.PutWord32(n);
+	}
+	
+	n = htonl(_sectors);
+	bt.PutWord32(n);
+	n = htonl(_sector_size);
+	bt.PutWord32(n);
+	
+	unsigned int p_sz = _p.MinEncodedSize();
+	n = htonl(p_sz);
+	bt.PutWord32(n);
+	_p.Encode(bt,p_sz);
+}
+
 void shacham_waters_private::deserialize(CryptoPP::BufferedTransformation &bt)
 {
 	byte f;
@@ -947,6 +2050,44 @@ void shacham_waters_private::deserialize(CryptoPP::BufferedTransformation &bt)
 		{
 			throw std::runtime_error("Key corrupted.");
 		}
+		
+		if (f & _flag_alpha_key)
+		{
+			// read key size
+			if (bt.GetWord32(n) != sizeof(unsigned int))
+			{
+				throw std::runtime_error("Unable to retrieve key size.");
+			}
+			n = ntohl(n);
+			
+			// check key size
+			if (n != shacham_waters_private_data::key_size)
+			{
+				throw std::runtime_error("Incompatible key sizes.");
+			}
+			
+			// get alpha key
+			if (bt.Get(_k_alpha,n) != n)
+			{
+				throw std::runtime_error("Key corrupted.");
+			}
+			
+			// read alpha epoch
+			if (bt.GetWord32(n) != sizeof(unsigned int))
+			{
+				throw std::runtime_error("Unable to retrieve alpha epoch.");
+			}
+			_alpha_epoch = ntohl(n);
+		}
+		else
+		{
+			// schemes serialized before the alpha key derive it from the mac
+			// key
+			static const char alpha_key_label[] = "heartbeat alpha key";
+			CryptoPP::HMAC<CryptoPP::SHA256> hmac(_k_mac,shacham_waters_private_data::key_size);
+			hmac.CalculateDigest(_k_alpha,(const byte*)alpha_key_label,sizeof(alpha_key_label)-1);
+			_alpha_epoch = 0;
+		}
 	}
 	
 	// read sectors
@@ -963,6 +2104,23 @@ void shacham_waters_private::deserialize(CryptoPP::BufferedTransformation &bt)
 	}
 	_sector_size = ntohl(n);
 
+	if (f & _flag_parameter_set)
+	{
+		// read parameter set id
+		if (bt.GetWord32(n) != sizeof(unsigned int))
+		{
+			throw std::runtime_error("Unable to read parameter set.");
+		}
+		_params = find_parameter_set(ntohl(n));
+		if (!_params)
+		{
+			throw std::runtime_error("Unknown parameter set.");
+		}
+		_p = CryptoPP::Integer(_params->prime);
+		return;
+	}
+	_params = 0;
+	
 	// read p size
 	if (bt.GetWord32(n) != sizeof(unsigned int))
 	{
@@ -34,19 +34,27 @@ Shacham, Waters, "Compact Proofs of Retrievability"
 
 #pragma once
 
+#include <cstdint>
 #include <stdexcept>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <algorithm>
 
 #include "heartbeat.hxx"
 #include "seekable_file.hxx"
 #include "prf.hxx"
+#include "permutation.hxx"
 #include "serializable.hxx"
-#include "pointer.hxx"
+#include "buffer_pool.hxx"
 
 // for encryption / decryption of state information
 #include <cryptopp/aes.h>
 #include <cryptopp/osrng.h>
 #include <cryptopp/integer.h>
 #include <cryptopp/nbtheory.h>
+#include <cryptopp/sha.h>
 
 
 
@@ -77,28 +85,54 @@ public:
 	class tag : public serializable 
 	{
 	public:
+		tag() : _entry_size(0) {}
+		
 		std::vector<CryptoPP::Integer> &sigma() { return _sigma; }
 		const std::vector<CryptoPP::Integer> &sigma() const { return _sigma; }
 		
+		// the size each sigma is serialized in, so that a serialized sigma can
+		// be found and patched in place.  zero serializes each sigma in its
+		// minimal size
+		unsigned int entry_size() const { return _entry_size; }
+		void set_entry_size(unsigned int sz) { _entry_size = sz; }
+		
+		// the offset of sigma i in a tag serialized with entries of size sz
+		static size_t entry_offset(unsigned int i, unsigned int sz) { return 4 + (size_t)i * (4 + sz); }
+		
+		bool operator==(const tag &other) const { return _sigma == other._sigma; }
+		bool operator!=(const tag &other) const { return !(*this == other); }
+		
 		virtual void serialize(CryptoPP::BufferedTransformation &bt) const;
 		virtual void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+		// the sigmas in their minimal size, whatever the entry size
+		virtual void serialize_canonical(CryptoPP::BufferedTransformation &bt) const;
 	
 	private:
 		std::vector<CryptoPP::Integer> _sigma;
+		unsigned int _entry_size;
 	};
 	
 	class state : public serializable 
 	{
 	public:
-		static const unsigned int max_raw_size = 2048;
+		static const unsigned int max_raw_size = 16384;
+		
+		// the most ranges of chunks tagged again under new versions of f a
+		// state holds
+		static const unsigned int max_f_runs = 1024;
 	
-		state() : _n(0), _raw_sz(0), _encrypted_and_signed(false)  {}
+		state() : _n(0), _alpha_epoch(0), _raw_sz(0), _encrypted_and_signed(false)  {}
 		
 		state(const state &s);
 		
 		void copy(const state &s);
 		
 		state& operator=(const state &other);
+		
+		// states compare by their encrypted and signed form, so both must be encrypted
+		bool operator==(const state &other) const;
+		bool operator!=(const state &other) const { return !(*this == other); }
 	
 		unsigned int get_n() const { return _n; }
 		void set_n(unsigned int n) { _n = n; }
@@ -111,22 +145,57 @@ public:
 		bool check_sig_and_decrypt(byte k_enc[shacham_waters_private_data::key_size],byte k_mac[shacham_waters_private_data::key_size]);
 		void public_interpretation();
 		
+		// f of chunk i, under the version of f the chunk was last tagged with
 		CryptoPP::Integer f(unsigned int i) const;
-		CryptoPP::Integer alpha(unsigned int i) const;
+		CryptoPP::Integer alpha(unsigned int i) const { return _alpha.evaluate(i); }
 		
-		void set_f_limit(CryptoPP::Integer limit) { _f.set_limit(limit); }
+		void set_f_limit(CryptoPP::Integer limit);
 		void set_alpha_limit(CryptoPP::Integer limit) { _alpha.set_limit(limit); }
 		
-		void set_f_key(unsigned char* key,unsigned int key_length) { _f.set_key(key,key_length); }
-		void set_alpha_key(unsigned char* key,unsigned int key_length) { _alpha.set_key(key,key_length); }
+		void set_f_key(const unsigned char* key,unsigned int key_length);
+		void set_alpha_key(const unsigned char* key,unsigned int key_length) { _alpha.set_key(key,key_length); }
+		
+		// gives the chunks from first up to last, or every chunk from first on
+		// if last is all_chunks, a new random version of f, under which they
+		// are then tagged.  a chunk must be given a new version before it is
+		// tagged again, since two sigmas of a chunk under the same f(i) tell
+		// the server a linear relation of the alphas
+		void retag(unsigned int first, unsigned int last);
+		
+		static const unsigned int all_chunks = ~0u;
+		
+		// the epoch of the alpha key of the scheme the alphas were derived in
+		unsigned int get_alpha_epoch() const { return _alpha_epoch; }
+		void set_alpha_epoch(unsigned int epoch) { _alpha_epoch = epoch; }
+		
+		// true if the decrypted states s and this have the same alphas
+		bool shares_alpha(const state &s) const 
+		{ 
+			return _alpha.get_key_size() == s._alpha.get_key_size() && memcmp(_alpha.get_key(),s._alpha.get_key(),_alpha.get_key_size()) == 0; 
+		}
 		
 	private:
 		unsigned int _n;
 		
 		prf _alpha;
 		prf _f;
+		unsigned int _alpha_epoch;
+		
+		// the chunks from first on, up to the first of the next run, are
+		// tagged under the f keyed with the f key and version.  version 0 is
+		// f itself, as are chunks before the first run
+		struct f_run
+		{
+			unsigned int first;
+			uint64_t version;
+			prf f;
+		};
+		std::vector<f_run> _f_runs;
+		
+		// sets up the prf of run r from the f key and its version
+		void derive_f_run(f_run &r) const;
 		
-		smart_buffer _raw;
+		pooled_buffer _raw;
 		unsigned int _raw_sz;
 		bool _encrypted_and_signed;
 	};
@@ -134,11 +203,16 @@ public:
 	class challenge : public serializable 
 	{
 	public:
-		challenge() :  _l(0), _key_sz(0) {}
+		challenge() :  _l(0), _key_sz(0), _distinct(false) {}
 	
 		unsigned int get_l() const { return _l; }
 		void set_l(unsigned int l) { _l = l; }
 		
+		// a distinct challenge selects l different chunks through a keyed
+		// permutation, instead of l independently drawn chunks
+		bool distinct() const { return _distinct; }
+		void set_distinct(bool distinct) { _distinct = distinct; }
+		
 		void set_v_limit(const CryptoPP::Integer &limit) { _v_max = limit; }
 		const CryptoPP::Integer& get_v_limit() const { return _v_max; }
 		
@@ -146,14 +220,55 @@ public:
 		const unsigned char *get_key() const {return _key.get(); }
 		unsigned int get_key_size() const { return _key_sz; }
 		
+		bool operator==(const challenge &other) const;
+		bool operator!=(const challenge &other) const { return !(*this == other); }
+		
+		// gets a digest of the serialized challenge into digest
+		void get_digest(byte digest[CryptoPP::SHA256::DIGESTSIZE]) const;
+		
 		void serialize(CryptoPP::BufferedTransformation &bt) const;
 		void deserialize(CryptoPP::BufferedTransformation &bt);
 		
 	private:
 		unsigned int _l;
 		CryptoPP::Integer _v_max;
-		smart_buffer _key;
+		pooled_buffer _key;
 		unsigned int _key_sz;
+		bool _distinct;
+		
+		static const byte _flag_distinct = 0x01;
+		
+		// set in the key size of challenges which are followed by a flags
+		// byte.  challenges without flags keep the original format
+		static const unsigned int _has_flags = 0x80000000;
+	};
+	
+	// the part of the verification of a challenge which does not depend on
+	// the proof, the sum over the challenged chunks, computed ahead of time.
+	// it is bound to its challenge by digest and is kept by the client
+	class token : public serializable
+	{
+	public:
+		token() { memset(_digest,0,sizeof(_digest)); }
+		
+		CryptoPP::Integer &sum() { return _sum; }
+		const CryptoPP::Integer &sum() const { return _sum; }
+		
+		const byte *get_digest() const { return _digest; }
+		void set_digest(const byte digest[CryptoPP::SHA256::DIGESTSIZE]) { memcpy(_digest,digest,sizeof(_digest)); }
+		
+		// true if the token was computed for challenge c
+		bool matches(const challenge &c) const;
+		
+		bool operator==(const token &other) const { return _sum == other._sum && memcmp(_digest,other._digest,sizeof(_digest)) == 0; }
+		bool operator!=(const token &other) const { return !(*this == other); }
+		
+		void serialize(CryptoPP::BufferedTransformation &bt) const;
+		void deserialize(CryptoPP::BufferedTransformation &bt);
+		
+	private:
+		byte _digest[CryptoPP::SHA256::DIGESTSIZE];
+		CryptoPP::Integer _sum;
 	};
 	
 	class proof : public serializable
@@ -165,6 +280,9 @@ public:
 		CryptoPP::Integer &sigma() { return _sigma; }
 		const CryptoPP::Integer &sigma() const { return _sigma; }
 		
+		bool operator==(const proof &other) const { return _sigma == other._sigma && _mu == other._mu; }
+		bool operator!=(const proof &other) const { return !(*this == other); }
+		
 		void serialize(CryptoPP::BufferedTransformation &bt) const;
 		void deserialize(CryptoPP::BufferedTransformation &bf);
 		
@@ -180,50 +298,473 @@ public:
 	shacham_waters_private() 
 		: 
 		_public(false), 
+		_alpha_epoch(0),
 		_sectors(0), 
 		_sector_size(0),
-		_check_fraction(1.0)
+		_check_fraction(1.0),
+		_params(0)
 	{}
 	
+	typedef shacham_waters_private_data::token token;
+	
+	// receives the checkpoints of a long encode, from which it can be
+	// resumed with resume_encode
+	class checkpoint_sink
+	{
+	public:
+		virtual ~checkpoint_sink() {}
+		
+		// segment holds the sigmas of the chunks tagged since the last
+		// checkpoint, and s is the sealed state of all of the chunks tagged
+		// so far
+		virtual void checkpoint(const tag &segment, const state &s) = 0;
+	};
+	
+	// a vetted prime and a sector count to go with it.  a scheme initialized
+	// from a parameter set is serialized with the id of the set instead of
+	// the prime
+	struct parameter_set
+	{
+		unsigned int id;
+		const char *name;
+		unsigned int prime_bits;
+		unsigned int sectors;
+		// in hexadecimal
+		const char *prime;
+		// for primes of the special form 2^prime_bits - c with small c, which
+		// are reduced with shifts and adds, otherwise 0
+		unsigned int c;
+	};
+	
+	// returns the parameter set with the given id or name, or null if there
+	// is none
+	static const parameter_set *find_parameter_set(unsigned int id);
+	static const parameter_set *find_parameter_set(const std::string &name);
+	
 	void gen()
 	{
 		init();
 	}
 
+	// uses the parameter set with a prime of prime_size_bytes if there is
+	// one, otherwise generates a new prime
 	void init(double check_fraction = 1.0, unsigned int sectors = 10, unsigned int prime_size_bytes = 128);
 	
+	// generates keys for the prime of params.  sectors of 0 takes the sector
+	// count of params
+	void init(const parameter_set &params, double check_fraction = 1.0, unsigned int sectors = 0);
+	
+	// the parameter set of the scheme, or null if its prime was generated
+	const parameter_set *get_parameter_set() const { return _params; }
+	
 	void get_public(shacham_waters_private &h) const;
 	
+	// true if this is the public version of the scheme, without keys
+	bool is_public() const { return _public; }
+	
+	// the epoch of the alpha key.  files encoded in one epoch share alphas,
+	// so their proofs can be aggregated
+	unsigned int alpha_epoch() const { return _alpha_epoch; }
+	
+	// moves to the next alpha epoch, so files encoded from now on get alphas
+	// unrelated to those of earlier files.  files whose tags may have told
+	// the server a relation of their alphas should be encoded again after
+	// a rotation
+	void rotate_alpha();
+	
 	// gets the tag and state into t and s for file f
 	void encode(tag &t, state &s, simple_file &f);
 	
+	// the same for a file of a concrete type, such as a memory_file or an
+	// fd_file, whose reads are then direct calls.  the virtual overload is
+	// this for a simple_file
+	template <typename File>
+	void encode(tag &t, state &s, File &f);
+	
+	static const unsigned int cache_key_size = CryptoPP::SHA256::DIGESTSIZE;
+	
+	// gets the key under which the tag and state of f encoded with this
+	// scheme can be cached, so that identical content is encoded once.  the
+	// key is a mac, under the keys of the scheme, of its parameters and the
+	// contents of f, which is read to its end
+	void cache_key(byte key[cache_key_size], simple_file &f) const;
+	
+	// gets a state for a file of size bytes, with new keys, for tagging it in
+	// parts with encode_range.  the state is encrypted like that of encode
+	void gen_state(state &s, size_t size);
+	
+	// tags count chunks of f from chunk first, the file of state s from
+	// gen_state.  the segments tagged for all of the chunks, merged in order
+	// with merge_tags, are the tag encode would give with the keys of s, so
+	// the parts of a file can be tagged where they are stored
+	void encode_range(tag &segment, const state &s, seekable_file &f, unsigned int first, unsigned int count);
+	
+	// concatenates tag segments, in chunk order, into t
+	static void merge_tags(tag &t, const std::vector<const tag*> &segments);
+	
+	// encodes f like encode, giving sink a checkpoint after every interval
+	// chunks, so at most interval chunks are tagged again after a crash
+	void encode_checkpointed(tag &t, state &s, simple_file &f, checkpoint_sink &sink, unsigned int interval);
+	
+	// the offset in the file at which an encode checkpointed with tag t,
+	// the segments of its checkpoints merged, is resumed
+	size_t resume_offset(const tag &t) const { return t.sigma().size() * _sectors * _sector_size; }
+	
+	// continues an encode from the checkpoint with tag t, the segments of
+	// the checkpoints merged, and the state s of the last checkpoint.  tail
+	// is the file from resume_offset(t) on.  checkpoints are given to sink,
+	// if not null, as in encode_checkpointed
+	void resume_encode(tag &t, state &s, simple_file &tail, checkpoint_sink *sink = 0, unsigned int interval = 0);
+	
+	// the offset in the file of tag t at which the tail passed to
+	// encode_append starts, the start of its last chunk
+	size_t append_offset(const tag &t) const;
+	
+	// updates the tag and state of a file which has been appended to.  tail
+	// is the file from append_offset(t) on, the last chunk of the file as
+	// encoded followed by the appended data.  the keys of the state are kept,
+	// and the chunks from the last on are tagged under a new version of f
+	void encode_append(tag &t, state &s, simple_file &tail);
+	
+	// updates the tag and state of a file some chunks of which were rewritten
+	// in place, without changing its size.  ranges are pairs of the first
+	// chunk and one past the last chunk rewritten, and only those chunks are
+	// read.  the rewritten chunks are tagged under a new version of f
+	void update_chunks(tag &t, state &s, seekable_file &f, const std::vector<std::pair<unsigned int,unsigned int> > &ranges);
+	
+	// the same, patching the sigmas of a tag serialized with fixed size
+	// entries in the sz bytes at t, such as a memory mapped tag file
+	void update_serialized_chunks(unsigned char *t, size_t sz, state &s, seekable_file &f, const std::vector<std::pair<unsigned int,unsigned int> > &ranges);
+	
 	// gets a challenge for the beat
-	void gen_challenge(challenge &c, const state &s);
+	void gen_challenge(challenge &c, const state &s) { gen_challenge(c,s,false); }
+	
+	// gets a challenge for the beat.  a distinct challenge checks different
+	// chunks, which the prover reads in file order
+	void gen_challenge(challenge &c, const state &s, bool distinct);
+	
+	// gets a challenge for the file of a state prepared by decrypt_state
+	void gen_challenge_decrypted(challenge &c, const state &s, bool distinct = false) const;
 	
 	// generates a challenge for the beat with some specific parameters for this scheme
 	// l is the number of chunks to check for, defaulting to n, and B is the basis for 
 	// the challenge vector, defaulting to p
-	void gen_challenge(challenge &c, unsigned int l, const CryptoPP::Integer &B);
+	static void gen_challenge(challenge &c, unsigned int l, const CryptoPP::Integer &B, bool distinct = false);
+	
+	// gets the verification token of challenge c of the file of state s, so
+	// that verify_token only has the work that depends on the proof left
+	void gen_token(token &k, const challenge &c, const state &s);
+	
+	// gets the verification token of challenge c against a state prepared by
+	// decrypt_state
+	void gen_token_decrypted(token &k, const challenge &c, const state &s) const;
 	
 	// gets a proof of storage for the file
 	void prove(proof &p, seekable_file &f, const challenge &c,const tag &t);
 	
+	// the same for a file of a concrete type, as for encode
+	template <typename File>
+	void prove(proof &p, File &f, const challenge &c, const tag &t) { prove_partial(p,f,c,t,0,t.sigma().size()); }
+	
+	// gets the part of a proof of storage for the challenged chunks from
+	// first up to last, for a shard f holding the file from chunk first on.
+	// combine_proofs adds the parts for the shards of a file into its proof
+	template <typename File>
+	void prove_partial(proof &p, File &f, const challenge &c, const tag &t, unsigned int first, unsigned int last);
+	
+	// adds partial proofs, whose chunk ranges must not overlap, into p
+	void combine_proofs(proof &p, const std::vector<const proof*> &partials) const;
+	
 	// verifies that a proof is correct
 	bool verify(const proof &p,const challenge &c, const state &s);
 	
+	// checks the signature of and decrypts s_enc into s, and sets up its prfs.
+	// a state prepared once can be used to verify any number of proofs with
+	// verify_decrypted.  returns false if the signature check fails
+	bool decrypt_state(state &s, const state &s_enc);
+	
+	// verifies a proof against a state prepared by decrypt_state
+	bool verify_decrypted(const proof &p, const challenge &c, const state &s);
+	
+	// verifies a proof with the token of its challenge.  false if the token
+	// is not that of the challenge
+	bool verify_token(const proof &p, const challenge &c, const token &k, const state &s);
+	
+	// verifies a proof with the token of its challenge against a state
+	// prepared by decrypt_state
+	bool verify_token_decrypted(const proof &p, const challenge &c, const token &k, const state &s);
+	
+	// verifies many proofs together, setting valid[i] for proof i.  each
+	// distinct state object is decrypted once.  tokens may be empty, or hold
+	// a null for items without a token
+	void verify_batch(std::vector<unsigned char> &valid, const std::vector<const proof*> &proofs, const std::vector<const challenge*> &challenges, const std::vector<const state*> &states, const std::vector<const token*> &tokens);
+	
+	// the sum over the challenged chunks of the coefficient times f(index),
+	// which is what the token of the challenge holds.  s must be prepared by
+	// decrypt_state
+	CryptoPP::Integer challenge_sum(const challenge &c, const state &s) const;
+	
+	// an item of a combined verification, with its state prepared by
+	// decrypt_state and its challenge sum
+	struct batch_item
+	{
+		const proof *p;
+		const state *s;
+		CryptoPP::Integer sum;
+	};
+	
+	// verifies items by checking a random linear combination of them, so
+	// items sharing a state object evaluate its alphas and multiply by them
+	// once.  if the combination fails the items are bisected to find the
+	// invalid ones.  sets valid[i] for item i
+	void verify_combined(std::vector<unsigned char> &valid, const std::vector<batch_item> &items) const;
+	
+	// gets the weights with which the proofs of the files challenged by
+	// challenges are folded into an aggregated proof
+	void aggregate_weights(std::vector<CryptoPP::Integer> &w, const std::vector<const challenge*> &challenges) const;
+	
+	// folds proofs, of the files challenged by challenges, into the single
+	// aggregated proof p, the size of a proof of one file
+	void aggregate(proof &p, const std::vector<const proof*> &proofs, const std::vector<const challenge*> &challenges) const;
+	
+	// gets an aggregated proof of storage of files
+	void prove_aggregate(proof &p, const std::vector<seekable_file*> &files, const std::vector<const challenge*> &challenges, const std::vector<const tag*> &tags);
+	
+	// verifies an aggregated proof against the states of its files.  the
+	// files must share alphas, which those encoded with the same keys do
+	bool verify_aggregate(const proof &p, const std::vector<const challenge*> &challenges, const std::vector<const state*> &states);
+	
+	// compares the parameters and, unless public, the keys of the scheme
+	bool operator==(const shacham_waters_private &other) const;
+	bool operator!=(const shacham_waters_private &other) const { return !(*this == other); }
+	
 	void serialize(CryptoPP::BufferedTransformation &bt) const;
 	void deserialize(CryptoPP::BufferedTransformation &bt);
 	
+	// the fields operator== compares, with the prime written out whether or
+	// not it is from a parameter set
+	void serialize_canonical(CryptoPP::BufferedTransformation &bt) const;
+	
 private:
 	bool _public;
 	byte _k_enc[shacham_waters_private_data::key_size];
 	byte _k_mac[shacham_waters_private_data::key_size];
+	// the alphas of the files encoded in an epoch are derived from this key
+	// and the epoch
+	byte _k_alpha[shacham_waters_private_data::key_size];
+	unsigned int _alpha_epoch;
 
 	unsigned int _sectors;
 	size_t _sector_size;
 	double _check_fraction;
 	
+	// reduces x modulo p into [0,p).  special form primes reduce non-negative
+	// x with shifts and adds
+	void reduce(CryptoPP::Integer &x) const;
+	
+	// tags the chunks of f, appending their sigmas to t, numbering them from
+	// the size of t, and sets the chunk count of s.  if sink is not null it
+	// is given a checkpoint after every interval chunks
+	template <typename File>
+	void encode_chunks(tag &t, state &s, File &f, checkpoint_sink *sink = 0, unsigned int interval = 0);
+	
+	// reads a chunk of up to sz bytes from f into buffer, skipping the zeros
+	// f knows of, such as holes in a sparse file, without reading them.
+	// returns the size of the chunk, short only at the end of the file
+	template <typename File>
+	static size_t read_chunk(File &f, unsigned char *buffer, size_t sz)
+	{
+		size_t skipped = f.skip_zeros(sz);
+		memset(buffer,0,skipped);
+		return skipped < sz ? skipped + f.read(buffer + skipped,sz - skipped) : skipped;
+	}
+	
+	// whether the sz bytes at p are all zero.  a zero sector adds nothing to a
+	// sigma or mu, so its multiply is skipped
+	static bool is_zero(const unsigned char *p, size_t sz)
+	{
+		return sz == 0 || (p[0] == 0 && memcmp(p,p + 1,sz - 1) == 0);
+	}
+	
+	// sets new keys for a file in s, which is left decrypted.  the f key is
+	// new, but the alphas are those of every file of the alpha epoch.  since
+	// they are shared, a path which tags a chunk again must never do so
+	// under the same f(i): the difference of the two sigmas is a linear
+	// relation of the alphas, and enough of them give the server the alphas
+	// of all of the files of the epoch
+	void init_state(state &s) const;
+	
+	// gets the sigma of chunk i, the sz bytes at chunk.  sectors past the
+	// end of the chunk are zero
+	CryptoPP::Integer chunk_sigma(const state &s, const std::vector<CryptoPP::Integer> &alpha, unsigned int i, const unsigned char *chunk, size_t sz) const;
+	
+	// throws unless every range is ordered and within the n chunks of a file
+	static void check_ranges(const std::vector<std::pair<unsigned int,unsigned int> > &ranges, unsigned int n);
+	
+	// gives the chunks in ranges of the decrypted state s new versions of f
+	static void retag_ranges(state &s, const std::vector<std::pair<unsigned int,unsigned int> > &ranges);
+	
+	// gets the sigmas of the chunks in ranges of a file f of the chunk count
+	// of s, which is decrypted, calling patch(i,sigma) for each in order
+	template <typename Patch>
+	void tag_ranges(const state &s, seekable_file &f, const std::vector<std::pair<unsigned int,unsigned int> > &ranges, Patch patch) const;
+	
+	// gets the chunks checked by challenge c of a file of n chunks into
+	// chunks, as pairs of the chunk index and the position in the challenge,
+	// which selects the coefficient.  sorted orders them by chunk index
+	static void challenged_chunks(std::vector<std::pair<unsigned int,unsigned int> > &chunks, const challenge &c, unsigned int n, bool sorted);
+	
+	// completes the verification sum with the sectors of proof p and
+	// compares it with sigma
+	bool verify_sectors(const proof &p, const state &s, CryptoPP::Integer rhs) const;
+	
 	CryptoPP::Integer _p;
+	const parameter_set *_params;
 	
 	static const byte _flag_public = 0x01;
+	static const byte _flag_parameter_set = 0x02;
+	static const byte _flag_alpha_key = 0x04;
 };
+
+template <typename File>
+void shacham_waters_private::encode(tag &t, state &s, File &f)
+{
+	//std::cout << "Encoding... " << std::endl;
+	//integer_block_file_interface ibf(f);
+	
+	// split file into sector sized chunks
+	//f.redefine_chunks(_sector_size,_sectors);
+	
+	//s.set_n(f.get_chunk_count());
+	
+	init_state(s);
+	
+	t.sigma().clear();
+	//t.sigma().resize(f.get_chunk_count());
+	
+	encode_chunks(t,s,f);
+	
+	s.encrypt_and_sign(_k_enc,_k_mac);
+}
+
+template <typename File>
+void shacham_waters_private::encode_chunks(tag &t, state &s, File &f, checkpoint_sink *sink, unsigned int interval)
+{
+	//std::cout << "Chunks: " << f.get_chunk_count() << std::endl;
+	//std::cout << "Sectors per chunk: " << f.get_sectors_per_chunk() << std::endl;
+	size_t chunk_size = _sectors*_sector_size;
+	pooled_buffer buffer(buffer_pool::allocate(chunk_size));
+	
+	// the alphas are the same for every chunk
+	std::vector<CryptoPP::Integer> alpha(_sectors);
+	for (unsigned int j=0;j<_sectors;j++)
+	{
+		alpha[j] = s.alpha(j);
+	}
+	
+	// every sigma is serialized in the size of the modulus, so that sigmas
+	// can be patched in place by update_serialized_chunks
+	t.set_entry_size(_p.MinEncodedSize());
+	
+	size_t bytes_read = chunk_size;
+	unsigned int chunk_id = t.sigma().size();
+	unsigned int last_checkpoint = chunk_id;
+	
+	//for (unsigned int i=0;i<f.get_chunk_count();i++)
+	while (bytes_read == chunk_size)
+	{
+		bytes_read = read_chunk(f,buffer.get(),chunk_size);
+		t.sigma().push_back(chunk_sigma(s,alpha,chunk_id,buffer.get(),bytes_read));
+		chunk_id++;
+		//std::cout << "sigma_" << i << " = " << t.sigma().at(i) << std::endl;
+		
+		// only full chunks are checkpointed, the last chunk is partial
+		if (sink && interval && bytes_read == chunk_size && chunk_id - last_checkpoint == interval)
+		{
+			tag segment;
+			segment.set_entry_size(t.entry_size());
+			segment.sigma().assign(t.sigma().begin() + last_checkpoint,t.sigma().end());
+			
+			state sealed(s);
+			sealed.set_n(chunk_id);
+			sealed.encrypt_and_sign(_k_enc,_k_mac);
+			
+			sink->checkpoint(segment,sealed);
+			last_checkpoint = chunk_id;
+		}
+	}
+	
+	s.set_n(chunk_id);
+}
+
+template <typename File>
+void shacham_waters_private::prove_partial(proof &p, File &f, const challenge &c, const tag &t, unsigned int first, unsigned int last)
+{
+	//std::cout << "Proving existence..." << std::endl;
+	//integer_block_file_interface ibf(f);
+	
+	//f.redefine_chunks(_sector_size,_sectors);
+	
+	if (first > last || last > t.sigma().size())
+	{
+		throw std::runtime_error("Chunk range is outside of the file.");
+	}
+	
+	size_t chunk_size = _sectors*_sector_size;
+	pooled_buffer buffer(buffer_pool::allocate(chunk_size));
+	
+	prf v;
+	v.set_key(c.get_key(),c.get_key_size());
+	v.set_limit(c.get_v_limit());
+	
+	p.mu().clear();
+	p.mu().resize(_sectors);
+	p.sigma() = CryptoPP::Integer::Zero();
+	
+	// chunks are read in file order.  the coefficient of a chunk depends on
+	// its position in the challenge, so the order does not change the proof
+	std::vector<std::pair<unsigned int,unsigned int> > chunks;
+	challenged_chunks(chunks,c,t.sigma().size(),true);
+	
+	CryptoPP::Integer sector;
+	size_t bytes_read = 0;
+	size_t start = std::lower_bound(chunks.begin(),chunks.end(),std::make_pair(first,0u)) - chunks.begin();
+	for (size_t k=start;k<chunks.size() && chunks[k].first < last;k++)
+	{
+		unsigned int index = chunks[k].first;
+		unsigned int i = chunks[k].second;
+		CryptoPP::Integer coefficient = v.evaluate(i);
+		
+		// repeats of a chunk drawn more than once are adjacent, and reuse the
+		// chunk already in the buffer
+		if (k == start || index != chunks[k-1].first)
+		{
+			size_t pos = (size_t)(index - first)*chunk_size;
+			bytes_read = f.seek(pos) == pos ? read_chunk(f,buffer.get(),chunk_size) : 0;
+		}
+		
+		// sectors past the end of the file are zero
+		for (unsigned int j=0;j<_sectors && j*_sector_size < bytes_read;j++)
+		{
+			size_t sz = std::min(_sector_size,bytes_read - j*_sector_size);
+			if (!is_zero(buffer.get() + j*_sector_size,sz))
+			{
+				sector.Decode(buffer.get() + j*_sector_size,sz);
+				p.mu().at(j) += coefficient * sector;
+			}
+		}
+		
+		//std::cout << "sigma += v_" << i << " * sigma_" << index << std::endl;
+		p.sigma() += coefficient * t.sigma().at(index);
+	}
+	
+	// the sums grow by a bit for each doubling of the challenged chunks, so
+	// they are reduced once here rather than after every term
+	for (unsigned int j=0;j<_sectors;j++)
+	{
+		reduce(p.mu()[j]);
+	}
+	reduce(p.sigma());
+	
+	//std::cout << "sigma = " << p.sigma() << std::endl;
+}
@@ -34,4 +34,9 @@ class simple_file
 {
 public:
 	virtual size_t read(unsigned char *buffer,size_t sz) = 0;
+	
+	// skips up to sz bytes from the position of the file which are known to
+	// be zero, such as a hole in a sparse file, without reading them.
+	// returns the number of bytes skipped
+	virtual size_t skip_zeros(size_t) { return 0; }
 };
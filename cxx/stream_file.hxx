@@ -28,11 +28,11 @@ THE SOFTWARE.
 
 #pragma once
 
-#include "simple_file.hxx"
+#include "seekable_file.hxx"
 
 #include <iostream>
 
-class stream_file : public simple_file
+class stream_file final : public seekable_file
 {
 public:
 	stream_file(std::istream &in) : _in(in) 
@@ -54,7 +54,7 @@ public:
 	virtual size_t bytes_remaining()
 	{
 		size_t start = _in.tellg();
-		_in.seekg(0,_in::end);
+		_in.seekg(0,std::ios_base::end);
 		size_t end = _in.tellg();
 		_in.seekg(start);
 		return end-start;
@@ -0,0 +1,192 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2014 William T. James
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+// a small fixed size pool of worker threads.  work is queued with submit() or
+// spread over the pool with parallel_for()
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+class thread_pool
+{
+public:
+	// threads = 0 uses one thread per hardware thread
+	thread_pool(unsigned int threads = 0) : _stop(false)
+	{
+		if (threads == 0)
+		{
+			threads = std::max(1u,std::thread::hardware_concurrency());
+		}
+		
+		for (unsigned int i=0;i<threads;i++)
+		{
+			_threads.push_back(std::thread(&thread_pool::worker,this));
+		}
+	}
+	
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_cv.notify_all();
+		
+		for (size_t i=0;i<_threads.size();i++)
+		{
+			_threads[i].join();
+		}
+	}
+	
+	// the pool shared by the whole process.  it is never destroyed so that
+	// workers are not joined during interpreter shutdown
+	static thread_pool &shared()
+	{
+		static thread_pool *pool = new thread_pool();
+		return *pool;
+	}
+	
+	unsigned int size() const
+	{
+		return _threads.size();
+	}
+	
+	// queues task to be run on one of the workers
+	void submit(const std::function<void()> &task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tasks.push_back(task);
+		}
+		_cv.notify_one();
+	}
+	
+	// calls f(i) for each i in [0,n) and returns once all calls have finished.
+	// the calling thread takes part, so this makes progress even when every
+	// worker is busy.  the first exception thrown by f is rethrown here
+	void parallel_for(size_t n, const std::function<void(size_t)> &f)
+	{
+		if (n == 0)
+		{
+			return;
+		}
+		
+		// helpers may only be scheduled after we return, so anything they
+		// touch is kept alive by the shared pointer
+		std::shared_ptr<batch> b(new batch(n,f));
+		
+		size_t helpers = std::min<size_t>(n-1,_threads.size());
+		for (size_t i=0;i<helpers;i++)
+		{
+			submit([b]() { b->run(); });
+		}
+		
+		b->run();
+		
+		std::unique_lock<std::mutex> lock(b->mutex);
+		b->cv.wait(lock,[&b]() { return b->done == b->n; });
+		
+		if (b->error)
+		{
+			std::rethrow_exception(b->error);
+		}
+	}
+	
+private:
+	struct batch
+	{
+		batch(size_t count, const std::function<void(size_t)> &func) : next(0), done(0), n(count), f(func) {}
+		
+		void run()
+		{
+			size_t i;
+			while ((i = next++) < n)
+			{
+				try
+				{
+					f(i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!error)
+					{
+						error = std::current_exception();
+					}
+				}
+				
+				if (++done == n)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					cv.notify_all();
+				}
+			}
+		}
+		
+		std::atomic<size_t> next;
+		std::atomic<size_t> done;
+		size_t n;
+		std::function<void(size_t)> f;
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::exception_ptr error;
+	};
+	
+	void worker()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_cv.wait(lock,[this]() { return _stop || !_tasks.empty(); });
+				if (_stop && _tasks.empty())
+				{
+					return;
+				}
+				task = _tasks.front();
+				_tasks.pop_front();
+			}
+			task();
+		}
+	}
+	
+	std::vector<std::thread> _threads;
+	std::deque<std::function<void()> > _tasks;
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	bool _stop;
+};
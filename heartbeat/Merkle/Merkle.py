@@ -354,11 +354,14 @@ class Merkle(object):
                 chunksz = DEFAULT_CHUNK_SIZE
         mt = MerkleTree()
         state = State(0, seed, n)
-        seed = MerkleHelper.get_next_seed(self.key, state.seed)
+        seeds = []
+        seed = state.seed
         for i in range(0, n):
-            leaf = MerkleHelper.get_chunk_hash(file, seed, filesz, chunksz)
-            mt.add_leaf(leaf)
             seed = MerkleHelper.get_next_seed(self.key, seed)
+            seeds.append(seed)
+        leaves = MerkleHelper.get_chunk_hashes(file, seeds, filesz, chunksz)
+        for leaf in leaves:
+            mt.add_leaf(leaf)
         mt.build()
         state.root = mt.get_root()
         mt.strip_leaves()
@@ -513,3 +516,52 @@ class MerkleHelper(object):
             if (chunksz == 0):
                 break
         return h.digest()
+
+    @staticmethod
+    def get_chunk_hashes(file,
+                         seeds,
+                         filesz=None,
+                         chunksz=DEFAULT_CHUNK_SIZE,
+                         bufsz=DEFAULT_BUFFER_SIZE):
+        """returns the hashes of the chunks of the file picked by each of the
+        seeds, as get_chunk_hash does, in one pass over the file.  the chunks
+        are sorted by position and the file is read once from the first of
+        them, each buffer going to the hmac of every chunk that covers it.
+
+        :param file: a file like object to get the chunk hashes from.  should
+        support `read()`, `seek()` and `tell()`.
+        :param seeds: the seeds to use for calculating the chunk positions and
+        chunk hashes
+        :param chunksz: the size of the chunks to check
+        :param bufsz: an optional buffer size to use for reading the file.
+        """
+        if (filesz is None):
+            file.seek(0, 2)
+            filesz = file.tell()
+        if (filesz < chunksz):
+            chunksz = filesz
+        offsets = [KeyedPRF(seed, filesz - chunksz + 1).eval(0)
+                   for seed in seeds]
+        hashes = [hmac.new(seed, None, hashlib.sha256) for seed in seeds]
+        order = sorted(range(0, len(seeds)), key=lambda i: offsets[i])
+        # the chunks of order[lo:hi] cover the buffer being read.  they all
+        # have the same size, so they leave in the order they come
+        lo = hi = pos = 0
+        while (chunksz > 0 and lo < len(order)):
+            if (lo == hi):
+                pos = offsets[order[hi]]
+                file.seek(pos)
+            end = min(pos + bufsz, offsets[order[-1]] + chunksz)
+            buffer = memoryview(file.read(end - pos))
+            if (len(buffer) != end - pos):
+                raise HeartbeatError("File is shorter than when it was "
+                                     "encoded.")
+            while (hi < len(order) and offsets[order[hi]] < end):
+                hi += 1
+            for i in order[lo:hi]:
+                hashes[i].update(buffer[max(offsets[i] - pos, 0):
+                                        offsets[i] + chunksz - pos])
+            pos = end
+            while (lo < hi and offsets[order[lo]] + chunksz <= pos):
+                lo += 1
+        return [h.digest() for h in hashes]
@@ -24,7 +24,7 @@
 import math
 import hashlib
 
-from ..util import hb_encode, hb_decode
+from ..util import hb_encode, hb_decode, sha256_batch
 
 # numbering scheme:
 # nodes                                   0
@@ -47,10 +47,11 @@ class MerkleLeaf(object):
                 and self.index == other.index
                 and self.blob == other.blob)
 
+    def get_message(self):
+        return self.blob + str(self.index).encode()
+
     def get_hash(self):
-        h = hashlib.sha256(self.blob)
-        h.update(str(self.index).encode())
-        return h.digest()
+        return hashlib.sha256(self.get_message()).digest()
 
     def todict(self):
         return {'index': self.index,
@@ -152,25 +153,17 @@ class MerkleTree(object):
         self.nodes = [b''] * 2 * n
 
         # populate lowest nodes with leaf hashes
-        for j in range(0, n):
-            if (j < len(self.leaves)):
-                self.nodes[j + n - 1] = self.leaves[j].get_hash()
-            else:
-                break
+        self.nodes[n - 1:n - 1 + len(self.leaves)] = sha256_batch(
+            [leaf.get_message() for leaf in self.leaves])
 
-        # now populate the entire tree
+        # now populate the entire tree, hashing each level in one batch.
+        # empty nodes add nothing to the hash of their parent
         for i in range(1, self.order + 1):
             p = 2 ** (self.order - i)
-            for j in range(0, p):
-                k = p + j - 1
-                h = hashlib.sha256()
-                l = self.nodes[MerkleTree.get_left_child(k)]
-                if (len(l) > 0):
-                    h.update(l)
-                r = self.nodes[MerkleTree.get_right_child(k)]
-                if (len(r) > 0):
-                    h.update(r)
-                self.nodes[k] = h.digest()
+            self.nodes[p - 1:2 * p - 1] = sha256_batch(
+                [self.nodes[MerkleTree.get_left_child(k)] +
+                 self.nodes[MerkleTree.get_right_child(k)]
+                 for k in range(p - 1, 2 * p - 1)])
 
     def get_branch(self, i):
         """Gets a branch associated with leaf i.  This will trace the tree
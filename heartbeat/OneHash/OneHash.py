@@ -32,6 +32,7 @@ import hashlib
 import os.path
 
 from ..exc import HeartbeatError
+from ..util import sha256_batch
 
 
 class Challenge(object):
@@ -102,17 +103,19 @@ class OneHash(object):
 
         # List of 2-tuples (seed, hash_response)
         self.challenges = []
-
-        # Generate the corresponding hash for each seed
         for i in range(num):
             self.challenges.append(Challenge(blocks[i], seeds[i]))
-            response = self.meet_challenge(self.challenges[i])
-            self.challenges[i].response = response
 
-    def meet_challenge(self, challenge):
-        """ Get the SHA256 hash of a specific file block plus the provided
-        seed. The default block size is one tenth of the file. If the file is
-        larger than 10KB, 1KB is used as the block size.
+        # Generate the corresponding hash for each seed, all in one batch
+        responses = sha256_batch(
+            [self.challenge_message(c) for c in self.challenges])
+        for (challenge, response) in zip(self.challenges, responses):
+            challenge.response = response
+
+    def challenge_message(self, challenge):
+        """ Get the bytes hashed to meet a challenge, a specific file block
+        plus the provided seed. The default block size is one tenth of the
+        file. If the file is larger than 10KB, 1KB is used as the block size.
 
         :param challenge: challenge as a `Challenge <heartbeat.Challenge>`
         object
@@ -120,22 +123,28 @@ class OneHash(object):
         chunk_size = min(1024, self.file_size // 10)
         seed = challenge.seed
 
-        h = hashlib.sha256()
         self.file_object.seek(challenge.block)
 
         if challenge.block > (self.file_size - chunk_size):
             end_slice = (
                 challenge.block - (self.file_size - chunk_size)
             )
-            h.update(self.file_object.read(end_slice))
+            data = self.file_object.read(end_slice)
             self.file_object.seek(0)
-            h.update(self.file_object.read(chunk_size - end_slice))
+            data += self.file_object.read(chunk_size - end_slice)
         else:
-            h.update(self.file_object.read(chunk_size))
+            data = self.file_object.read(chunk_size)
+
+        return data + seed
 
-        h.update(seed)
+    def meet_challenge(self, challenge):
+        """ Get the SHA256 hash of a specific file block plus the provided
+        seed, as given by `challenge_message()`.
 
-        return h.digest()
+        :param challenge: challenge as a `Challenge <heartbeat.Challenge>`
+        object
+        """
+        return hashlib.sha256(self.challenge_message(challenge)).digest()
 
     @staticmethod
     def generate_seeds(num, root_seed, secret):
@@ -0,0 +1,106 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# This file is part of Heartbeat: https://github.com/Storj/heartbeat
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2014 William T. James
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Content addressed caches of tags and states for Swizzle.encode().
+
+Swizzle.encode(file, cache) hashes the file with the keys and parameters of
+the Swizzle object and looks the key up with cache.get(key), which returns
+(tag, state) or None.  On a miss the file is encoded and the result given to
+cache.put(key, tag, state).  Any object with those two methods can be used.
+"""
+
+import binascii
+import os
+import struct
+import tempfile
+
+from heartbeat import Swizzle
+from heartbeat.exc import HeartbeatError
+
+
+class DirectoryTagCache(object):
+    """Caches tags and states in a directory, one file per key.
+
+    Entries are written to a temporary file and renamed into place, so
+    several processes can share a directory.
+    """
+
+    def __init__(self, path):
+        """Uses the directory at path, creating it if it does not exist
+
+        :param path: the path of the cache directory
+        """
+        self.path = path
+        if not os.path.isdir(path):
+            os.makedirs(path)
+
+    def _entry(self, key):
+        return os.path.join(self.path,
+                            binascii.hexlify(key).decode('ascii'))
+
+    def get(self, key):
+        """Returns the cached (tag, state) of key, or None.  A truncated
+        or foreign entry is treated as a miss.
+
+        :param key: the cache key of the content
+        """
+        try:
+            with open(self._entry(key), 'rb') as f:
+                data = f.read()
+        except (IOError, OSError):
+            return None
+
+        try:
+            (tag_size,) = struct.unpack('>I', data[:4])
+            if len(data) < 4 + tag_size:
+                return None
+            tag = Swizzle.Tag()
+            tag.__setstate__(data[4:4 + tag_size])
+            state = Swizzle.State()
+            state.__setstate__(data[4 + tag_size:])
+        except (struct.error, HeartbeatError, ValueError):
+            return None
+        return (tag, state)
+
+    def put(self, key, tag, state):
+        """Caches the tag and state of key
+
+        :param key: the cache key of the content
+        :param tag: the tag of the content
+        :param state: the state of the content
+        """
+        tag_data = tag.__getstate__()
+        (fd, tmp) = tempfile.mkstemp(dir=self.path)
+        try:
+            with os.fdopen(fd, 'wb') as f:
+                f.write(struct.pack('>I', len(tag_data)))
+                f.write(tag_data)
+                f.write(state.__getstate__())
+            os.rename(tmp, self._entry(key))
+        except Exception:
+            os.remove(tmp)
+            raise
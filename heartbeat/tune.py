@@ -0,0 +1,287 @@
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2014 William T. James
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Tunes the parameters of the Swizzle scheme for the local machine.
+
+For each combination of parameter set, sector count and check fraction this
+encodes, proves and verifies a sample file and reports the throughput, the
+tag overhead, the proof size and the probability that a single challenge
+detects a given amount of corruption.  Optionally it recommends the fastest
+combination within limits on tag overhead and detection probability.
+
+Usage: python -m heartbeat.tune [options] [sample file]
+"""
+
+from __future__ import print_function
+
+import argparse
+import itertools
+import json
+import math
+import os
+import sys
+import tempfile
+import timeit
+
+from heartbeat import Swizzle
+
+# the bits in the prime and the default sector count of each parameter set.
+# sectors are the whole bytes below the prime
+PARAMETER_SETS = {'modp1024': (1024, 10),
+                  'modp1536': (1536, 10),
+                  'modp2048': (2048, 10),
+                  'p25519': (255, 40),
+                  'p521': (521, 20)}
+
+
+def chunk_count(file_size, parameters, sectors):
+    """Returns the number of chunks, and so of tag entries, of a file
+
+    :param file_size: the size of the file in bytes
+    :param parameters: the name of the parameter set
+    :param sectors: the number of sectors per chunk, 0 for the default
+    """
+    (bits, default_sectors) = PARAMETER_SETS[parameters]
+    chunk_size = (sectors or default_sectors) * (bits // 8)
+    return max(1, (file_size + chunk_size - 1) // chunk_size)
+
+
+def detection_probability(chunks, check_fraction, corruption,
+                          distinct=False):
+    """Returns the probability that one challenge detects corruption of the
+    given fraction of chunks, at least one chunk
+
+    :param chunks: the number of chunks in the file
+    :param check_fraction: the fraction of chunks challenged
+    :param corruption: the fraction of chunks corrupted
+    :param distinct: whether the challenge checks distinct chunks
+    """
+    challenged = int(check_fraction * chunks)
+    if (challenged >= chunks):
+        # every chunk is checked
+        return 1.0
+    corrupted = max(1, int(math.ceil(corruption * chunks)))
+    if (not distinct):
+        # challenged chunks are drawn independently
+        return 1.0 - (1.0 - float(corrupted) / chunks) ** challenged
+    # challenged chunks are drawn without replacement
+    missed = 1.0
+    for k in range(challenged):
+        missed *= max(0.0, float(chunks - corrupted - k) / (chunks - k))
+    return 1.0 - missed
+
+
+def measure(path, parameters, sectors, check_fraction, corruption=0.01,
+            repeat=3, distinct=False):
+    """Measures one combination of parameters on the file at path and
+    returns a dictionary of the results.  times are the best of repeat runs
+
+    :param path: the path of the sample file
+    :param parameters: the name of the parameter set
+    :param sectors: the number of sectors per chunk
+    :param check_fraction: the fraction of chunks to check per challenge
+    :param corruption: the fraction of corrupted chunks for which to report
+    the detection probability
+    :param repeat: the number of times to repeat each measurement
+    :param distinct: whether to generate distinct challenges
+    """
+    sectors = sectors or PARAMETER_SETS[parameters][1]
+    beat = Swizzle.Swizzle(check_fraction, sectors, parameters=parameters)
+    public_beat = beat.get_public()
+    file_size = os.path.getsize(path)
+
+    def best(f):
+        times = []
+        for i in range(repeat):
+            start = timeit.default_timer()
+            result = f()
+            times.append(timeit.default_timer() - start)
+        return (min(times), result)
+
+    def encode():
+        with open(path, 'rb') as f:
+            return beat.encode(f)
+
+    (encode_time, (tag, state)) = best(encode)
+    challenge = beat.gen_challenge(state, distinct)
+
+    def prove():
+        with open(path, 'rb') as f:
+            return public_beat.prove(f, challenge, tag)
+
+    (prove_time, proof) = best(prove)
+    (verify_time, valid) = best(lambda: beat.verify(proof, challenge, state))
+
+    if (not valid):
+        raise RuntimeError('Proof invalid for {0} with {1} sectors'.format(
+            parameters, sectors))
+
+    chunks = chunk_count(file_size, parameters, sectors)
+    mb = file_size / 1e6
+
+    return {'parameters': parameters,
+            'sectors': sectors,
+            'check_fraction': check_fraction,
+            'encode_mbps': mb / encode_time if encode_time else float('inf'),
+            'prove_mbps': mb / prove_time if prove_time else float('inf'),
+            'verify_ms': verify_time * 1e3,
+            'tag_overhead': float(len(tag.__getstate__())) / max(1, file_size),
+            'state_bytes': len(state.__getstate__()),
+            'proof_bytes': len(proof.__getstate__()),
+            'detection': detection_probability(chunks, check_fraction,
+                                               corruption, distinct)}
+
+
+def tune(path, parameters=None, sectors=None, check_fractions=None,
+         corruption=0.01, repeat=3, distinct=False):
+    """Measures every combination of the given parameter sets, sector counts
+    and check fractions on the file at path and returns a list of results as
+    returned by measure().  a sector count of 0 uses the default of the
+    parameter set
+
+    :param path: the path of the sample file
+    :param parameters: the names of the parameter sets, defaulting to all
+    :param sectors: the sector counts
+    :param check_fractions: the check fractions
+    :param corruption: the fraction of corrupted chunks for which to report
+    the detection probability
+    :param repeat: the number of times to repeat each measurement
+    :param distinct: whether to generate distinct challenges
+    """
+    if (parameters is None):
+        parameters = sorted(PARAMETER_SETS)
+    if (sectors is None):
+        sectors = [0]
+    if (check_fractions is None):
+        check_fractions = [1.0]
+
+    results = []
+    for (p, s, c) in itertools.product(parameters, sectors, check_fractions):
+        results.append(measure(path, p, s, c, corruption, repeat, distinct))
+    return results
+
+
+def recommend(results, max_tag_overhead=0.1, min_detection=0.99):
+    """Returns the result taking the least time to encode and prove a
+    megabyte which meets the limits, or None if none do
+
+    :param results: a list of results as returned by measure()
+    :param max_tag_overhead: the largest acceptable tag size as a fraction of
+    the file size
+    :param min_detection: the smallest acceptable detection probability
+    """
+    acceptable = [r for r in results
+                  if r['tag_overhead'] <= max_tag_overhead and
+                  r['detection'] >= min_detection]
+    if (not acceptable):
+        return None
+    return min(acceptable,
+               key=lambda r: 1.0 / r['encode_mbps'] + 1.0 / r['prove_mbps'])
+
+
+def format_report(results, column_width=14):
+    """Returns a table of results as a string
+
+    :param results: a list of results as returned by measure()
+    :param column_width: the width of each column
+    """
+    header = ['parameters', 'sectors', 'check frac', 'encode (MB/s)',
+              'prove (MB/s)', 'verify (ms)', 'tag overhead', 'proof (B)',
+              'detection']
+    lines = [''.join('{0:<{width}}'.format(h, width=column_width)
+                     for h in header)]
+    for r in results:
+        lines.append(
+            '{0:<{width}}{1:<{width}}{2:<{width}.4g}{3:<{width}.2f}'
+            '{4:<{width}.2f}{5:<{width}.2f}{6:<{width}.4f}{7:<{width}}'
+            '{8:<{width}.6f}'.format(
+                r['parameters'], r['sectors'], r['check_fraction'],
+                r['encode_mbps'], r['prove_mbps'], r['verify_ms'],
+                r['tag_overhead'], r['proof_bytes'], r['detection'],
+                width=column_width))
+    return '\n'.join(line.rstrip() for line in lines)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='Measures the Swizzle scheme over a grid of parameters.')
+    parser.add_argument('file', nargs='?',
+                        help='sample file, by default a random file of '
+                        '--size bytes')
+    parser.add_argument('--size', type=int, default=10000000,
+                        help='size of the random sample file')
+    parser.add_argument('--parameters', nargs='+',
+                        default=sorted(PARAMETER_SETS),
+                        choices=sorted(PARAMETER_SETS),
+                        help='parameter sets (prime sizes) to try')
+    parser.add_argument('--sectors', nargs='+', type=int, default=[0],
+                        help='sector counts to try, 0 for the default of '
+                        'the parameter set')
+    parser.add_argument('--check-fractions', nargs='+', type=float,
+                        default=[1.0], help='check fractions to try')
+    parser.add_argument('--corruption', type=float, default=0.01,
+                        help='fraction of corrupted chunks for the '
+                        'detection probability')
+    parser.add_argument('--distinct', action='store_true',
+                        help='generate challenges of distinct chunks')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='runs per measurement, the best is reported')
+    parser.add_argument('--recommend', action='store_true',
+                        help='print the recommended Swizzle arguments as JSON')
+    parser.add_argument('--max-tag-overhead', type=float, default=0.1,
+                        help='largest acceptable tag size as a fraction of '
+                        'the file for --recommend')
+    parser.add_argument('--min-detection', type=float, default=0.99,
+                        help='smallest acceptable detection probability for '
+                        '--recommend')
+    args = parser.parse_args(argv)
+
+    path = args.file
+    if (path is None):
+        (fd, path) = tempfile.mkstemp()
+        with os.fdopen(fd, 'wb') as f:
+            f.write(os.urandom(args.size))
+
+    try:
+        results = tune(path, args.parameters, args.sectors,
+                       args.check_fractions, args.corruption, args.repeat,
+                       args.distinct)
+    finally:
+        if (args.file is None):
+            os.remove(path)
+
+    print(format_report(results))
+
+    if (args.recommend):
+        best = recommend(results, args.max_tag_overhead, args.min_detection)
+        if (best is None):
+            print('No parameters meet the limits.', file=sys.stderr)
+            return 1
+        print(json.dumps({'parameters': best['parameters'],
+                          'sectors': best['sectors'],
+                          'check_fraction': best['check_fraction']}))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
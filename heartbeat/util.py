@@ -26,6 +26,10 @@ from Crypto.Util import number
 from Crypto.Cipher import AES
 from Crypto.Hash import SHA256
 
+# sha256_batch(messages) returns the sha256 digests of a list of independent
+# messages, hashed side by side natively
+from .NativeMerkle import sha256_batch  # NOQA
+
 
 def hb_encode(obj):
     if (type(obj) is list):
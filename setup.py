@@ -32,9 +32,9 @@ with open('heartbeat/version.py','r') as f:
     exec(f.read())
 
 copt = {'mingw32': [],
-        'unix': [],
+        'unix': ['-pthread'],
         'msvc': ['/EHsc']}
-lopt = {}
+lopt = {'unix': ['-pthread']}
 libs = {'mingw32': ['cryptopp'],
         'unix': ['cryptopp'],
         'msvc': ['cryptlib']}
@@ -55,6 +55,8 @@ class build_ext_subclass(build_ext):
         build_ext.build_extensions(self)
 
 swizzle_sources = ['cxx/shacham_waters_private.cxx', 'cxx/Swizzle.cxx', 'cxx/base64.cxx']
+merkle_sources = ['cxx/merkle.cxx', 'cxx/NativeMerkle.cxx', 'cxx/sha256_batch.cxx',
+                  'cxx/base64.cxx']
 pycxx_sources = ['cxx/pycxx/Src/cxxsupport.cxx',
                  'cxx/pycxx/Src/cxx_extensions.cxx',
                  'cxx/pycxx/Src/cxxextensions.c',
@@ -66,6 +68,10 @@ swizzle = Extension('heartbeat.Swizzle',
                     include_dirs=['cxx/pycxx','cxx'],
                     sources=all_sources)
 
+native_merkle = Extension('heartbeat.NativeMerkle',
+                          include_dirs=['cxx/pycxx','cxx'],
+                          sources=merkle_sources + pycxx_sources)
+
 setup(
     name='storj-heartbeat',
     version=__version__,
@@ -78,6 +84,6 @@ setup(
         'pycrypto >= 2.6.1',
     ],
     packages=['heartbeat', 'heartbeat.Merkle', 'heartbeat.OneHash', 'heartbeat.PySwizzle'],
-    ext_modules=[swizzle],
+    ext_modules=[swizzle, native_merkle],
     cmdclass={'build_ext': build_ext_subclass}
 )
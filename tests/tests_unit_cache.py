@@ -0,0 +1,120 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# This file is part of Heartbeat: https://github.com/Storj/heartbeat
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2014 William T. James
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+
+import io
+import shutil
+import tempfile
+import unittest
+
+from heartbeat import Swizzle
+from heartbeat.cache import DirectoryTagCache
+
+
+class CountingCache(DirectoryTagCache):
+    def __init__(self, path):
+        DirectoryTagCache.__init__(self, path)
+        self.puts = 0
+
+    def put(self, key, tag, state):
+        self.puts += 1
+        DirectoryTagCache.put(self, key, tag, state)
+
+
+class TestDirectoryTagCache(unittest.TestCase):
+    def setUp(self):
+        self.path = tempfile.mkdtemp()
+        with open('files/test4.txt', 'rb') as f:
+            self.data = f.read()
+
+    def tearDown(self):
+        shutil.rmtree(self.path)
+
+    def test_encode_cached(self):
+        beat = Swizzle.Swizzle()
+        cache = CountingCache(self.path)
+
+        (tag, state) = beat.encode(io.BytesIO(self.data), cache)
+        self.assertEqual(cache.puts, 1)
+
+        # identical content from the start of another file is a hit
+        file = io.BytesIO(b'header' + self.data)
+        file.seek(6)
+        (tag2, state2) = beat.encode(file, cache)
+        self.assertEqual(cache.puts, 1)
+        self.assertEqual(tag2, tag)
+        self.assertEqual(state2, state)
+
+        challenge = beat.gen_challenge(state2)
+        proof = beat.prove(io.BytesIO(self.data), challenge, tag2)
+        self.assertTrue(beat.verify(proof, challenge, state2))
+
+        # other content, and other keys, miss
+        beat.encode(io.BytesIO(self.data[:-1]), cache)
+        self.assertEqual(cache.puts, 2)
+        (tag3, state3) = Swizzle.Swizzle().encode(io.BytesIO(self.data),
+                                                  cache)
+        self.assertEqual(cache.puts, 3)
+        self.assertNotEqual(tag3, tag)
+
+    def test_rotated_alpha(self):
+        beat = Swizzle.Swizzle()
+        cache = CountingCache(self.path)
+
+        (tag, state) = beat.encode(io.BytesIO(self.data), cache)
+        beat.rotate_alpha()
+        (tag2, state2) = beat.encode(io.BytesIO(self.data), cache)
+        # the entry of the old epoch is not reused
+        self.assertEqual(cache.puts, 2)
+        self.assertNotEqual(state2, state)
+
+        beat.encode(io.BytesIO(self.data), cache)
+        self.assertEqual(cache.puts, 2)
+
+    def test_missing_entry(self):
+        cache = DirectoryTagCache(self.path)
+        self.assertIsNone(cache.get(b'\0' * 32))
+
+    def test_bad_entry(self):
+        beat = Swizzle.Swizzle()
+        cache = DirectoryTagCache(self.path)
+        (tag, state) = beat.encode(io.BytesIO(self.data))
+        cache.put(b'\1' * 32, tag, state)
+        with open(cache._entry(b'\1' * 32), 'rb') as f:
+            entry = f.read()
+
+        # truncated entries, down to a partial size, and foreign files are
+        # misses
+        for data in [b'', b'\0\0', entry[:100], entry[:-10],
+                     b'\0\0\0\x08' + b'\xff' * 64]:
+            with open(cache._entry(b'\2' * 32), 'wb') as f:
+                f.write(data)
+            self.assertIsNone(cache.get(b'\2' * 32))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -76,6 +76,19 @@ class TestMerkleHelper(unittest.TestCase):
             self.assertEqual(hash,hash2)
 
 
+    def test_get_chunk_hashes(self):
+        key = os.urandom(32)
+        seeds = [os.urandom(32)]
+        for i in range(0,50):
+            seeds.append(Merkle.MerkleHelper.get_next_seed(key,seeds[-1]))
+        with open('files/test.txt','rb') as file:
+            data = file.read()
+        for chunksz in [1,100,8192,len(data)+1]:
+            hashes = Merkle.MerkleHelper.get_chunk_hashes(io.BytesIO(data),seeds,chunksz=chunksz,bufsz=1000)
+            for (seed,hash) in zip(seeds,hashes):
+                self.assertEqual(hash,Merkle.MerkleHelper.get_chunk_hash(io.BytesIO(data),seed,chunksz=chunksz))
+
+
 class TestMerkleTree(unittest.TestCase):
     def test_build(self):
         leaf_counts = [1, 9, 257]
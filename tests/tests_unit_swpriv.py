@@ -34,12 +34,32 @@ import hashlib
 import unittest
 from decimal import Decimal
 import pickle
+import base64
+import struct
+import multiprocessing
+import tempfile
 
 from heartbeat.exc import HeartbeatError
 from heartbeat import Swizzle
 
 from GenericCorrectnessTests import GenericCorrectnessTests
    
+def encode_range(args):
+    (beat,path,state,first,count) = args
+    with open(path,'rb') as file:
+        return beat.encode_range(file,state,first,count)
+
+def tag_sigmas(tag):
+    raw = tag.__getstate__()
+    sigmas = []
+    offset = 4
+    for i in range(struct.unpack('<I',raw[0:4])[0]):
+        size = struct.unpack('<I',raw[offset:offset+4])[0]
+        sigmas.append(int.from_bytes(raw[offset+4:offset+4+size],'big'))
+        offset += 4 + size
+    return sigmas
+
+
 class TestSubClasses(unittest.TestCase):
     def setUp(self):
         self.challenge1 = Swizzle.Challenge()
@@ -101,6 +121,38 @@ class TestSubClasses(unittest.TestCase):
         self.assertEqual(self.proof1,self.proof2)
         self.assertNotEqual(self.state1,state3)
         
+    def test_hash(self):
+        with open('files/test.txt','rb') as file:
+            (tag,state) = self.beat1.encode(file)
+
+        tag2 = pickle.loads(pickle.dumps(tag))
+        self.assertEqual(hash(tag),hash(tag2))
+        self.assertEqual(len(set([tag,tag2,self.tag1])),2)
+        self.assertEqual(hash(self.beat1),hash(Swizzle.Swizzle.fromdict(self.beat1.todict())))
+
+        # modifying the object must invalidate the cached digest
+        h = hash(tag2)
+        tag2.__setstate__(self.tag1.__getstate__())
+        self.assertNotEqual(hash(tag2),h)
+        self.assertEqual(tag2,self.tag1)
+        self.assertNotEqual(tag2,tag)
+
+        state2 = pickle.loads(pickle.dumps(state))
+        self.assertEqual(hash(state),hash(state2))
+        self.assertEqual(state,state2)
+
+        # a tag serialized with wider entries is equal, and hashes the same
+        sigmas = tag_sigmas(tag)
+        width = struct.unpack('<I',tag.__getstate__()[4:8])[0] + 1
+        wide = Swizzle.Tag()
+        wide.__setstate__(struct.pack('<I',len(sigmas)) + b''.join(
+            struct.pack('<I',width) + sigma.to_bytes(width,'big')
+            for sigma in sigmas))
+        self.assertNotEqual(wide.__getstate__(),tag.__getstate__())
+        self.assertEqual(wide,tag)
+        self.assertEqual(hash(wide),hash(tag))
+        self.assertEqual(wide,tag)
+
     def test_get_set_state(self):
         self.assign_and_compare_states(self.challenge1, self.challenge2)
         self.assign_and_compare_states(self.tag1, self.tag2)
@@ -151,6 +203,16 @@ class TestSubClasses(unittest.TestCase):
         with self.assertRaises(HeartbeatError) as ex:
             proof3 = Swizzle.Swizzle.proof_type().fromdict('invalid object')
 
+    def test_base64_compatibility(self):
+        with open('files/test4.txt','rb') as file:
+            (tag,state) = self.beat1.encode(file)
+
+        for obj in [self.tag1, self.beat1, tag, state]:
+            raw = obj.__getstate__()
+            self.assertEqual(obj.todict(),base64.b64encode(raw).decode('utf-8'))
+            obj2 = type(obj).fromdict(base64.b64encode(raw).decode('utf-8'))
+            self.assertEqual(obj2.__getstate__(),raw)
+
 class TestSwizzle(unittest.TestCase):
     def test_exceptions(self):
         state = Swizzle.State()
@@ -202,7 +264,527 @@ class TestSwizzle(unittest.TestCase):
         # plus some overhead for storage of the integers.  the overhead should be
         # 4 bytes per 128 byte integer, plus 4 bytes for the number of integers
         self.assertLessEqual(len_tag,len_file*0.104 + 4)
-    
+
+    def test_parameters(self):
+        beat = Swizzle.Swizzle()
+        self.assertEqual(beat.parameters(),'modp1024')
+
+        beat = Swizzle.Swizzle(0.5,5,parameters='modp2048')
+        self.assertEqual(beat.parameters(),'modp2048')
+        self.assertEqual(Swizzle.Swizzle(parameters=3).parameters(),'modp2048')
+
+        # the prime is serialized as the id of the parameter set
+        beat2 = pickle.loads(pickle.dumps(beat))
+        self.assertEqual(beat,beat2)
+        self.assertEqual(beat2.parameters(),'modp2048')
+        self.assertLess(len(beat.get_public().__getstate__()),16)
+
+        with self.assertRaises(HeartbeatError):
+            Swizzle.Swizzle(parameters='invalid')
+
+    def test_special_form_parameters(self):
+        for params in ['p25519','p521']:
+            beat = Swizzle.Swizzle(parameters=params)
+            self.assertEqual(beat.parameters(),params)
+            public_beat = Swizzle.Swizzle.fromdict(beat.get_public().todict())
+            with open('files/test4.txt','rb') as file:
+                (tag,state) = beat.encode(file)
+            challenge = beat.gen_challenge(state)
+            with open('files/test4.txt','rb') as file:
+                proof = public_beat.prove(file,challenge,tag)
+            self.assertTrue(beat.verify(proof,challenge,state))
+            self.assertFalse(beat.verify(Swizzle.Proof(),challenge,state))
+
+    def test_encode_append(self):
+        beat = Swizzle.Swizzle()
+        public_beat = beat.get_public()
+        with open('files/test4.txt','rb') as file:
+            data = file.read()
+
+        # 1280 byte chunks, splitting inside a sector, between sectors and
+        # between chunks
+        for split in [0,1000,1280,3840,len(data)-1]:
+            (tag,state) = beat.encode(io.BytesIO(data[:split]))
+            (tag,state) = beat.encode_append(io.BytesIO(data),tag,state)
+
+            challenge = beat.gen_challenge(state)
+            proof = public_beat.prove(io.BytesIO(data),challenge,tag)
+            self.assertTrue(beat.verify(proof,challenge,state))
+            proof = public_beat.prove(io.BytesIO(data[:-1]+b'x'),challenge,tag)
+            self.assertFalse(beat.verify(proof,challenge,state))
+
+        with self.assertRaises(HeartbeatError):
+            beat.encode_append(io.BytesIO(data[:1000]),tag,state)
+
+    def test_encode_append_new_f(self):
+        beat = Swizzle.Swizzle(parameters='p25519')
+        p = 2**255 - 19
+        # two whole chunks of 40 sectors of 31 bytes, so the last chunk is
+        # empty and its sigma is f(2)
+        base = os.urandom(2480)
+        (tag,state) = beat.encode(io.BytesIO(base))
+        s0 = tag_sigmas(tag)[-1]
+
+        # appending x gives f(2) + alpha_0*x under a shared f(2), so that
+        # sigma_1 + sigma_2 - sigma_3 - s0 would be zero
+        sigmas = [tag_sigmas(beat.encode_append(
+            io.BytesIO(base+bytes([x])),tag,state)[0])[-1] for x in [1,2,3]]
+        self.assertNotEqual((sigmas[0]+sigmas[1]-sigmas[2]-s0) % p,0)
+
+    def test_update_chunks(self):
+        beat = Swizzle.Swizzle()
+        public_beat = beat.get_public()
+        with open('files/test4.txt','rb') as file:
+            data = file.read()
+        (tag,state) = beat.encode(io.BytesIO(data))
+        stored = bytearray(tag.__getstate__())
+
+        # rewrite chunks 2, 3 and 40 of the 1280 byte chunks
+        changed = bytearray(data)
+        changed[3000:3900] = b'x' * 900
+        changed[51300] = ord('y')
+        changed = bytes(changed)
+        ranges = [(2,4),(40,41)]
+
+        (updated,updated_state) = beat.update_chunks(io.BytesIO(changed),tag,
+                                                     state,ranges)
+        self.assertNotEqual(updated,tag)
+        self.assertNotEqual(updated_state,state)
+
+        patched_state = beat.update_serialized_chunks(stored,io.BytesIO(changed),
+                                                      state,ranges)
+        patched = Swizzle.Tag()
+        patched.__setstate__(bytes(stored))
+        # only the rewritten chunks are tagged again
+        self.assertEqual(
+            [i for i,(a,b) in enumerate(zip(tag_sigmas(patched),
+                                            tag_sigmas(tag))) if a != b],
+            [2,3,40])
+
+        for (t,s) in [(updated,updated_state),(patched,patched_state)]:
+            challenge = beat.gen_challenge(s)
+            proof = public_beat.prove(io.BytesIO(changed),challenge,t)
+            self.assertTrue(beat.verify(proof,challenge,s))
+            proof = public_beat.prove(io.BytesIO(data),challenge,t)
+            self.assertFalse(beat.verify(proof,challenge,s))
+
+        with self.assertRaises(HeartbeatError):
+            beat.update_chunks(io.BytesIO(changed),tag,state,[(40,51)])
+        with self.assertRaises(HeartbeatError):
+            beat.update_chunks(io.BytesIO(changed[:-1000]),tag,state,ranges)
+
+        # a bad entry after the first patched one leaves the tag untouched
+        bad = bytearray(tag.__getstate__())
+        width = struct.unpack('<I',bad[4:8])[0]
+        bad[4+40*(4+width):8+40*(4+width)] = struct.pack('<I',width+1)
+        before = bytes(bad)
+        with self.assertRaises(HeartbeatError):
+            beat.update_serialized_chunks(bad,io.BytesIO(changed),state,ranges)
+        self.assertEqual(bytes(bad),before)
+
+    def test_update_chunks_new_f(self):
+        beat = Swizzle.Swizzle(parameters='p25519')
+        p = 2**255 - 19
+        base = bytearray(os.urandom(2480))
+        base[30] = 0
+        (tag,state) = beat.encode(io.BytesIO(bytes(base)))
+        s0 = tag_sigmas(tag)[0]
+
+        # rewriting the last byte of the first sector to x adds alpha_0*x to
+        # the sigma, so under a shared f(0) sigma_1 + sigma_2 - sigma_3 - s0
+        # would be zero
+        sigmas = []
+        for x in [1,2,3]:
+            base[30] = x
+            (updated,_) = beat.update_chunks(io.BytesIO(bytes(base)),tag,
+                                             state,[(0,1)])
+            sigmas.append(tag_sigmas(updated)[0])
+        self.assertNotEqual((sigmas[0]+sigmas[1]-sigmas[2]-s0) % p,0)
+
+        # rewrites of the same chunk keep getting new versions
+        for x in [4,5]:
+            base[30] = x
+            (tag,state) = beat.update_chunks(io.BytesIO(bytes(base)),tag,
+                                             state,[(0,1)])
+        challenge = beat.gen_challenge(state)
+        proof = beat.get_public().prove(io.BytesIO(bytes(base)),challenge,tag)
+        self.assertTrue(beat.verify(proof,challenge,state))
+
+    def test_encode_range(self):
+        beat = Swizzle.Swizzle()
+        public_beat = beat.get_public()
+        path = 'files/test4.txt'
+        state = beat.gen_state(os.path.getsize(path))
+
+        # 50 chunks tagged by three processes
+        ranges = [(0,17),(17,20),(37,13)]
+        pool = multiprocessing.Pool(3)
+        try:
+            segments = pool.map(encode_range,
+                                [(beat,path,state,first,count)
+                                 for (first,count) in ranges])
+        finally:
+            pool.close()
+            pool.join()
+        tag = beat.merge_tags(segments)
+        with open(path,'rb') as file:
+            self.assertEqual(tag,beat.encode_range(file,state,0,50))
+
+        challenge = beat.gen_challenge(state)
+        with open(path,'rb') as file:
+            proof = public_beat.prove(file,challenge,tag)
+        self.assertTrue(beat.verify(proof,challenge,state))
+
+        with open(path,'rb') as file:
+            with self.assertRaises(HeartbeatError):
+                beat.encode_range(file,state,40,11)
+        with open('files/test.txt','rb') as file:
+            with self.assertRaises(HeartbeatError):
+                beat.encode_range(file,state,0,1)
+
+    def test_prove_partial(self):
+        beat = Swizzle.Swizzle()
+        public_beat = beat.get_public()
+        with open('files/test4.txt','rb') as file:
+            data = file.read()
+        (tag,state) = beat.encode(io.BytesIO(data))
+        challenge = beat.gen_challenge(state)
+
+        # three shards of the 1280 byte chunks, the last holding the partial
+        # chunk
+        shards = [(0,10),(10,33),(33,50)]
+        partials = [public_beat.prove_partial(
+                        io.BytesIO(data[first*1280:last*1280]),
+                        challenge,tag,first,last)
+                    for (first,last) in shards]
+        proof = public_beat.combine_proofs(partials)
+        self.assertEqual(proof,
+                         public_beat.prove(io.BytesIO(data),challenge,tag))
+        self.assertTrue(beat.verify(proof,challenge,state))
+
+        # a shard missing from the combination fails
+        proof = public_beat.combine_proofs(partials[:2])
+        self.assertFalse(beat.verify(proof,challenge,state))
+
+        with self.assertRaises(HeartbeatError):
+            public_beat.prove_partial(io.BytesIO(data),challenge,tag,40,51)
+
+    def test_sparse_file(self):
+        beat = Swizzle.Swizzle()
+        public_beat = beat.get_public()
+        with open('files/test4.txt','rb') as file:
+            data = file.read()
+
+        with tempfile.TemporaryFile() as sparse:
+            # data at the start and 1 MB in, with holes between and after
+            sparse.write(data)
+            sparse.seek(1 << 20)
+            sparse.write(data)
+            sparse.truncate(3 << 20)
+            sparse.flush()
+            sparse.seek(0)
+            contents = sparse.read()
+            sparse.seek(0)
+
+            # the holes are skipped, and zero sectors are not multiplied
+            (tag,state) = beat.encode_async(sparse).result()
+            challenge = beat.gen_challenge(state)
+            proof = public_beat.prove_async(sparse,challenge,tag).result()
+
+        self.assertEqual(proof,public_beat.prove(io.BytesIO(contents),
+                                                 challenge,tag))
+        self.assertTrue(beat.verify(proof,challenge,state))
+
+    def test_resume_encode(self):
+        beat = Swizzle.Swizzle()
+        public_beat = beat.get_public()
+        with open('files/test4.txt','rb') as file:
+            data = file.read()
+
+        class Crash(Exception):
+            pass
+
+        checkpoints = []
+
+        def checkpoint(segment,state):
+            checkpoints.append((segment,state))
+            if len(checkpoints) == 3:
+                raise Crash()
+
+        # 50 chunks, crashing at the third checkpoint after 21
+        with self.assertRaises(Crash):
+            beat.encode_checkpointed(io.BytesIO(data),checkpoint,7)
+        tag = beat.merge_tags([segment for (segment,state) in checkpoints])
+        self.assertEqual(len(tag.__getstate__()),4+21*132)
+
+        (tag,state) = beat.resume_encode(io.BytesIO(data),tag,
+                                         checkpoints[-1][1],checkpoint,7)
+        self.assertEqual(len(checkpoints),7)
+        self.assertEqual(tag,beat.encode_range(io.BytesIO(data),state,0,50))
+
+        challenge = beat.gen_challenge(state)
+        proof = public_beat.prove(io.BytesIO(data),challenge,tag)
+        self.assertTrue(beat.verify(proof,challenge,state))
+
+        with self.assertRaises(HeartbeatError):
+            beat.resume_encode(io.BytesIO(data[:1000]),tag,state)
+
+    def test_challenge_format(self):
+        # challenges without flags keep the original format, with nothing
+        # after B
+        beat = Swizzle.Swizzle(0.5)
+        with open('files/test4.txt','rb') as file:
+            (tag,state) = beat.encode(file)
+        raw = beat.gen_challenge(state).__getstate__()
+        key_sz = struct.unpack('<I',raw[4:8])[0]
+        b_sz = struct.unpack('<I',raw[8 + key_sz:12 + key_sz])[0]
+        self.assertEqual(len(raw),12 + key_sz + b_sz)
+
+    def test_distinct_challenge(self):
+        beat = Swizzle.Swizzle(0.5)
+        public_beat = beat.get_public()
+        with open('files/test4.txt','rb') as file:
+            (tag,state) = beat.encode(file)
+        challenge = beat.gen_challenge(state,True)
+        # the mode survives serialization
+        self.assertEqual(Swizzle.Challenge.fromdict(challenge.todict()),
+                         challenge)
+        with open('files/test4.txt','rb') as file:
+            proof = public_beat.prove(file,challenge,tag)
+        self.assertTrue(beat.verify(proof,challenge,state))
+
+        # the same key without the mode selects other chunks.  the mode is
+        # marked in the high bit of the key size, which is followed by the
+        # flags byte
+        state_bytes = challenge.__getstate__()
+        self.assertEqual(state_bytes[7] & 0x80,0x80)
+        other = Swizzle.Challenge()
+        other.__setstate__(state_bytes[0:7] + bytes([state_bytes[7] & 0x7f]) +
+                           state_bytes[9:])
+        self.assertNotEqual(other,challenge)
+        self.assertFalse(beat.verify(proof,other,state))
+
+        with open('files/test4.txt','rb') as file:
+            data = bytearray(file.read())
+        for i in range(len(data)):
+            data[i] ^= 0xff
+        proof = public_beat.prove(io.BytesIO(bytes(data)),challenge,tag)
+        self.assertFalse(beat.verify(proof,challenge,state))
+
+    def test_token(self):
+        beat = Swizzle.Swizzle(0.5)
+        public_beat = beat.get_public()
+        with open('files/test4.txt','rb') as file:
+            (tag,state) = beat.encode(file)
+        challenge = beat.gen_challenge(state)
+        token = Swizzle.Token.fromdict(
+            beat.gen_token(challenge,state).todict())
+        with open('files/test4.txt','rb') as file:
+            proof = public_beat.prove(file,challenge,tag)
+        self.assertTrue(beat.verify(proof,challenge,state,token))
+        self.assertFalse(beat.verify(Swizzle.Proof(),challenge,state,token))
+
+        # a token only verifies the challenge it was generated for
+        other = beat.gen_challenge(state)
+        self.assertFalse(beat.verify(proof,challenge,state,
+                                     beat.gen_token(other,state)))
+
+        pairs = beat.gen_challenges(state,4,True)
+        self.assertEqual(len(pairs),4)
+        items = []
+        for (challenge,token) in pairs:
+            with open('files/test4.txt','rb') as file:
+                proof = public_beat.prove(file,challenge,tag)
+            items.append((proof,challenge,state,token))
+        items.append((Swizzle.Proof(),challenge,state,token))
+        self.assertEqual(beat.verify_many(items),[True]*4+[False])
+
+    def test_batch(self):
+        beat = Swizzle.Swizzle()
+        public_beat = beat.get_public()
+        paths = ['files/test.txt','files/test2.txt','files/test4.txt']
+
+        encoded = []
+        for path in paths:
+            with open(path,'rb') as file:
+                encoded.append(beat.encode(file))
+
+        # two challenges share each state
+        items = []
+        for (path,(tag,state)) in zip(paths,encoded):
+            for i in range(2):
+                items.append((path,beat.gen_challenge(state),tag,state))
+
+        with open(paths[0],'rb') as file:
+            proofs = public_beat.prove_many(
+                [(file,items[0][1],items[0][2])] +
+                [(p,c,t) for (p,c,t,s) in items[1:]])
+
+        self.assertEqual(len(proofs),len(items))
+        for (proof,(p,c,t,s)) in zip(proofs,items):
+            with open(p,'rb') as file:
+                self.assertEqual(proof,public_beat.prove(file,c,t))
+
+        # swap two proofs so they fail
+        proofs[0],proofs[2] = proofs[2],proofs[0]
+        results = beat.verify_many([(proof,c,s) for (proof,(p,c,t,s))
+                                    in zip(proofs,items)])
+        self.assertEqual(results,[False,True,False,True,True,True])
+
+        self.assertEqual(public_beat.prove_many([]),[])
+        with self.assertRaises(HeartbeatError):
+            public_beat.prove_many([('files/nonexistent.txt',items[0][1],
+                                     items[0][2])])
+
+    def test_verify_batch(self):
+        beat = Swizzle.Swizzle(0.5)
+        public_beat = beat.get_public()
+        paths = ['files/test.txt','files/test2.txt','files/test4.txt']
+
+        items = []
+        for path in paths:
+            with open(path,'rb') as file:
+                (tag,state) = beat.encode(file)
+            for i in range(3):
+                challenge = beat.gen_challenge(state)
+                with open(path,'rb') as file:
+                    proof = public_beat.prove(file,challenge,tag)
+                items.append((proof,challenge,state))
+        token = beat.gen_token(items[0][1],items[0][2])
+        items.append(items[0]+(token,))
+        self.assertEqual(beat.verify_batch(items),[True]*len(items))
+        self.assertEqual(beat.verify_batch([]),[])
+
+        # failures are found by bisection
+        expected = [True]*len(items)
+        for i in [1,5,6]:
+            items[i] = (items[(i+3) % len(items)][0],)+items[i][1:]
+            expected[i] = False
+        items.append((Swizzle.Proof(),items[0][1],items[0][2]))
+        expected.append(False)
+        items.append(items[1][:3]+(token,))
+        expected.append(False)
+        self.assertEqual(beat.verify_batch(items),expected)
+        self.assertEqual(beat.verify_batch(items),beat.verify_many(items))
+
+        with self.assertRaises(HeartbeatError):
+            beat.verify_batch([(items[0][0],items[0][1])])
+
+    def test_verify_batch_large_token_sum(self):
+        # a token sum larger than sigma makes a negative residual, which
+        # must still reduce into the field and fail
+        for parameters in ['modp1024','p25519']:
+            beat = Swizzle.Swizzle(0.5,parameters=parameters)
+            with open('files/test.txt','rb') as file:
+                (tag,state) = beat.encode(file)
+            challenge = beat.gen_challenge(state)
+            with open('files/test.txt','rb') as file:
+                proof = beat.get_public().prove(file,challenge,tag)
+            raw = base64.b64decode(beat.gen_token(challenge,state).todict())
+            forged = Swizzle.Token.fromdict(base64.b64encode(
+                raw[0:32] + struct.pack('<I',200) + b'\xff'*200).decode())
+            self.assertEqual(beat.verify_batch([(proof,challenge,state,forged)]),
+                             [False])
+
+    def test_aggregate(self):
+        beat = Swizzle.Swizzle(0.5)
+        public_beat = beat.get_public()
+        paths = ['files/test.txt','files/test2.txt','files/test4.txt']
+
+        items = []
+        pairs = []
+        for path in paths:
+            with open(path,'rb') as file:
+                (tag,state) = beat.encode(file)
+            challenge = beat.gen_challenge(state)
+            items.append((path,challenge,tag))
+            pairs.append((challenge,state))
+
+        proof = public_beat.prove_aggregate(items)
+        with open(paths[2],'rb') as file:
+            single = public_beat.prove(file,items[2][1],items[2][2])
+        # the proof does not grow with the number of files
+        self.assertLess(len(proof.__getstate__()),
+                        1.1*len(single.__getstate__()))
+        self.assertTrue(beat.verify_aggregate(proof,pairs))
+
+        # the weights depend on the order of the files
+        self.assertFalse(beat.verify_aggregate(proof,pairs[::-1]))
+        self.assertFalse(beat.verify_aggregate(proof,pairs[:2]))
+        items[1] = ('files/test3.txt',)+items[1][1:]
+        self.assertFalse(beat.verify_aggregate(
+            public_beat.prove_aggregate(items),pairs))
+
+        # the states must be those of this object
+        other = Swizzle.Swizzle(0.5)
+        with open(paths[2],'rb') as file:
+            (tag,state) = other.encode(file)
+        self.assertFalse(beat.verify_aggregate(proof,
+                                               pairs[:2]+[(pairs[2][0],state)]))
+
+    def test_rotate_alpha(self):
+        beat = Swizzle.Swizzle(0.5)
+        public_beat = beat.get_public()
+        self.assertEqual(beat.alpha_epoch(),0)
+
+        items = []
+        pairs = []
+        for path in ['files/test.txt','files/test2.txt']:
+            with open(path,'rb') as file:
+                (tag,state) = beat.encode(file)
+            challenge = beat.gen_challenge(state)
+            items.append((path,challenge,tag))
+            pairs.append((challenge,state))
+            beat.rotate_alpha()
+        self.assertEqual(beat.alpha_epoch(),2)
+
+        # the epoch is kept with the keys
+        beat2 = Swizzle.Swizzle.fromdict(beat.todict())
+        self.assertEqual(beat2.alpha_epoch(),2)
+        self.assertEqual(beat,beat2)
+
+        # files of different epochs have unrelated alphas, so they cannot be
+        # aggregated, but each still verifies on its own
+        proof = public_beat.prove_aggregate(items)
+        self.assertFalse(beat.verify_aggregate(proof,pairs))
+        for (path,challenge,tag),(_,state) in zip(items,pairs):
+            with open(path,'rb') as file:
+                proof = public_beat.prove(file,challenge,tag)
+            self.assertTrue(beat2.verify(proof,challenge,state))
+
+        with self.assertRaises(HeartbeatError):
+            public_beat.rotate_alpha()
+
+    def test_async(self):
+        beat = Swizzle.Swizzle()
+        public_beat = beat.get_public()
+
+        (tag,state) = beat.encode_async('files/test4.txt').result()
+        challenge = beat.gen_challenge(state)
+
+        with open('files/test4.txt','rb') as file:
+            proof = public_beat.prove_async(file,challenge,tag).result()
+            # the position of file objects is left untouched
+            self.assertEqual(file.tell(),0)
+
+        with open('files/test4.txt','rb') as file:
+            self.assertEqual(proof,public_beat.prove(file,challenge,tag))
+            file.seek(0)
+            data = io.BytesIO(file.read())
+
+        self.assertEqual(public_beat.prove_async(data,challenge,tag).result(),
+                         proof)
+        self.assertTrue(beat.verify_async(proof,challenge,state).result())
+        self.assertFalse(beat.verify_async(Swizzle.Proof(),challenge,
+                                           state).result())
+
+        with self.assertRaises(HeartbeatError):
+            public_beat.prove_async('files/nonexistent.txt',challenge,tag)
+
+        future = beat.encode_async(io.BytesIO(os.urandom(1000000)))
+        future.cancel()
+        self.assertTrue(future.done())
+
 class TestCorrectness(unittest.TestCase):
     def test_correctness(self):
         GenericCorrectnessTests.generic_correctness_test(self,Swizzle.Swizzle)
@@ -0,0 +1,75 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# This file is part of Heartbeat: https://github.com/Storj/heartbeat
+#
+# The MIT License (MIT)
+#
+# Copyright (c) 2014 Paul Durivage <pauldurivage+git@gmail.com> for Storj Labs
+# Copyright (c) 2014 Will James <jameswt@gmail.com> for Storj Labs
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+
+import unittest
+import os
+
+from heartbeat import tune
+
+
+class TestTune(unittest.TestCase):
+    def setUp(self):
+        self.path = 'files/test4.txt'
+
+    def test_detection_probability(self):
+        self.assertEqual(tune.detection_probability(100, 1.0, 0.01), 1.0)
+        self.assertAlmostEqual(tune.detection_probability(100, 0.5, 0.01),
+                               1.0 - 0.99 ** 50)
+        # at least one chunk is always corrupt
+        self.assertAlmostEqual(tune.detection_probability(10, 0.5, 0.0),
+                               1.0 - 0.9 ** 5)
+        # distinct chunks detect more for the same number checked
+        self.assertAlmostEqual(
+            tune.detection_probability(10, 0.5, 0.0, True), 0.5)
+        self.assertEqual(tune.detection_probability(10, 0.9, 0.2, True), 1.0)
+
+    def test_tune(self):
+        results = tune.tune(self.path, ['p25519', 'modp1024'], [0, 5],
+                            [0.5, 1.0], repeat=1)
+        self.assertEqual(len(results), 8)
+        for r in results:
+            self.assertGreater(r['encode_mbps'], 0)
+            self.assertGreater(r['proof_bytes'], 0)
+            self.assertGreater(r['tag_overhead'], 0)
+            self.assertNotEqual(r['sectors'], 0)
+        self.assertIn('p25519', tune.format_report(results))
+
+        best = tune.recommend(results, max_tag_overhead=10.0,
+                              min_detection=1.0)
+        self.assertEqual(best['check_fraction'], 1.0)
+        self.assertIsNone(tune.recommend(results, max_tag_overhead=0.0))
+
+    def test_main(self):
+        self.assertEqual(tune.main([self.path, '--parameters', 'p521',
+                                    '--repeat', '1', '--recommend',
+                                    '--max-tag-overhead', '10']), 0)
+
+
+if __name__ == '__main__':
+    unittest.main()